@@ -6,7 +6,11 @@
 #include <cstdlib>
 #include <cstdint>
 #include <algorithm>
+#include <vector>
+#include <stdexcept>
+#include <mutex>
 #include "bst.h"
+#include "parallel_sort.h"
 
 struct KeyError { };
 
@@ -22,12 +26,19 @@ public:
     // Constructor/destructor.
     AVLNode(const Key& key, const Value& value, AVLNode<Key, Value>* parent);
     virtual ~AVLNode();
+    virtual size_t footprint() const override;
 
     // Getter/setter for the node's height.
     int8_t getBalance () const;
     void setBalance (int8_t balance);
     void updateBalance(int8_t diff);
 
+    // Whether the node is a tombstone: its item was removed but the node
+    // is kept for a later reinsert (see TombstoneAVLTree). AVLTree itself
+    // never sets it.
+    bool isDead() const;
+    void setDead(bool dead);
+
     // Getters for parent, left, and right. These need to be redefined since they
     // return pointers to AVLNodes - not plain Nodes. See the Node class in bst.h
     // for more information.
@@ -37,6 +48,7 @@ public:
 
 protected:
     int8_t balance_;    // effectively a signed char
+    bool dead_;         // in the padding after balance_, so free
 };
 
 /*
@@ -50,7 +62,7 @@ protected:
 */
 template<class Key, class Value>
 AVLNode<Key, Value>::AVLNode(const Key& key, const Value& value, AVLNode<Key, Value> *parent) :
-    Node<Key, Value>(key, value, parent), balance_(0)
+    Node<Key, Value>(key, value, parent), balance_(0), dead_(false)
 {
 }
 
@@ -62,6 +74,12 @@ AVLNode<Key, Value>::~AVLNode()
 {
 }
 
+template<class Key, class Value>
+size_t AVLNode<Key, Value>::footprint() const
+{
+    return sizeof(*this);
+}
+
 /**
 * A getter for the balance of a AVLNode.
 */
@@ -89,6 +107,18 @@ void AVLNode<Key, Value>::updateBalance(int8_t diff)
     balance_ += diff;
 }
 
+template<class Key, class Value>
+bool AVLNode<Key, Value>::isDead() const
+{
+    return dead_;
+}
+
+template<class Key, class Value>
+void AVLNode<Key, Value>::setDead(bool dead)
+{
+    dead_ = dead;
+}
+
 /**
 * An overridden function for getting the parent since a static_cast is necessary to make sure
 * that our node is a AVLNode.
@@ -123,60 +153,249 @@ AVLNode<Key, Value> *AVLNode<Key, Value>::getRight() const
   -----------------------------------------------
 */
 
-template <class Key, class Value>
-class AVLTree : public BinarySearchTree<Key, Value>
+/**
+* One entry of a batch for AVLTree::applyBatch(): an upsert of (key, value)
+* or a removal of key (value unused).
+*/
+enum BatchOpKind { BATCH_UPSERT, BATCH_REMOVE };
+
+template <typename Key, typename Value>
+struct BatchOp
+{
+    static BatchOp upsert(const Key& key, const Value& value);
+    static BatchOp remove(const Key& key);
+
+    BatchOpKind kind;
+    Key key;
+    Value value;
+};
+
+template<typename Key, typename Value>
+BatchOp<Key, Value> BatchOp<Key, Value>::upsert(const Key& key, const Value& value)
+{
+    BatchOp op = { BATCH_UPSERT, key, value };
+    return op;
+}
+
+template<typename Key, typename Value>
+BatchOp<Key, Value> BatchOp<Key, Value>::remove(const Key& key)
+{
+    BatchOp op = { BATCH_REMOVE, key, Value() };
+    return op;
+}
+
+/**
+* Node orders for AVLTree::compact(). In-order puts neighbouring keys next
+* to each other, for scans; van Emde Boas order stores the tree as nested
+* blocks of about sqrt(n) nodes, so that a lookup touches O(log_B n) cache
+* lines for any line size B.
+*/
+enum NodeLayout { LAYOUT_IN_ORDER, LAYOUT_VEB };
+
+template <class Key, class Value, class Compare = std::less<Key> >
+class AVLTree : public BinarySearchTree<Key, Value, Compare>
 {
 public:
+    explicit AVLTree(const Compare& comp = Compare());
+    // See BinarySearchTree; copies keep the balances and drop any
+    // unfinished compaction, moves take it along
+    AVLTree(const AVLTree& other);
+    AVLTree(AVLTree&& other);
+    AVLTree& operator=(const AVLTree& other);
+    AVLTree& operator=(AVLTree&& other);
     // Inserts a new item and does balancing magic
     virtual void insert (const std::pair<const Key, Value> &new_item);
     // Removes an item and fixes the tree (hopefully)
     virtual void remove(const Key& key);
-    
+    // Applies upserts/removals sorted by key (equal keys: the last one wins).
+    // Throws std::logic_error on trees that keep equal keys (AVLMultiTree).
+    // Virtual so that trees with state about their nodes keep it in step.
+    virtual void applyBatch(const std::vector<BatchOp<Key, Value> >& sortedOps, unsigned int threads = 1);
+    // Replaces the contents with the (key, value) pairs in [first, last), in
+    // any order; for a repeated key the one that comes last wins, unless the
+    // tree keeps equal keys, which then stay in input order
+    template<typename InputIt>
+    void buildFrom(InputIt first, InputIt last, unsigned int threads = 0);
+    // Moves all nodes into one contiguous block, in the given order.
+    // Iterators are invalidated. Virtual, as is beginCompact(), so that trees
+    // whose nodes do not fit AVLNode slots can refuse it.
+    virtual void compact(NodeLayout layout = LAYOUT_IN_ORDER);
+    // The same in slices: beginCompact() records the target order and each
+    // compactStep() moves at most budget nodes, returning true once all are
+    // in place. The tree may be used and changed between steps; nodes
+    // inserted meanwhile stay where they are. Each step invalidates iterators.
+    virtual void beginCompact(NodeLayout layout = LAYOUT_IN_ORDER);
+    bool compactStep(size_t budget);
+
 protected:
     // Swaps two nodes and their balances (I think)
     virtual void nodeSwap( AVLNode<Key,Value>* n1, AVLNode<Key,Value>* n2);
 
     // Helper functions:
+    AVLNode<Key, Value>* unlinkNode(AVLNode<Key, Value>* node);  // remove without freeing
+    virtual void eraseNode(Node<Key, Value>* node);
+    // Splits out the whole span and joins what is left: O(k + log n)
+    virtual size_t eraseSpan(Node<Key, Value>* first, Node<Key, Value>* last);
     void rebalance(AVLNode<Key, Value>* node);  // fixes unbalanced nodes
-    void rotateLeft(AVLNode<Key, Value>* node);  // rotates left 
-    void rotateRight(AVLNode<Key, Value>* node);  // rotates right 
-    void updateBalanceFactors(AVLNode<Key, Value>* node);  // updates balances after changes
+    // Virtual so that trees keeping per-subtree state (LazyAVLTree) can
+    // settle it before the subtrees change
+    virtual void rotateLeft(AVLNode<Key, Value>* node);  // rotates left, keeping balances exact
+    virtual void rotateRight(AVLNode<Key, Value>* node);  // rotates right, keeping balances exact
     void adjustAfterInsert(AVLNode<Key, Value>* node);  // called after inserting
-    void adjustAfterRemove(AVLNode<Key, Value>* node);  // same but after removing
-    int getNodeHeight(AVLNode<Key, Value>* node) const;  // gets height from node down
-    int getBalanceFactor(AVLNode<Key, Value>* node) const;  // calculats balance
-    void updateNodeHeight(AVLNode<Key, Value>* node);  // updates height and balance
+    // same but after removing: the subtree on node's left (or right) side got shorter
+    void adjustAfterRemove(AVLNode<Key, Value>* node, bool leftShorter);
+    virtual void cloneNodes(const BinarySearchTree<Key, Value, Compare>& other, unsigned int threads);
+    virtual void swapExtra(BinarySearchTree<Key, Value, Compare>& other);
+    // Gives back the slots of an unfinished compaction
+    void abandonCompaction();
+    // validate() hook: balance_ must equal height(right) - height(left), within [-1, 1]
+    virtual TreeViolation checkNode(const Node<Key, Value>* node, SubtreeCheck& check) const;
+
+    // Subtree surgery for batches. Heights are passed in and out alongside
+    // the subtrees so that nothing has to be measured; the returned root's
+    // parent pointer is left for the caller to set. Every node is passed
+    // to settleNode() before its children are read or relinked.
+    virtual void settleNode(AVLNode<Key, Value>* node);
+    static int subtreeHeight(const AVLNode<Key, Value>* node);  // O(height), from balances
+    static void childHeights(const AVLNode<Key, Value>* node, int height, int& left, int& right);
+    static AVLNode<Key, Value>* linkBalanced(AVLNode<Key, Value>* left, int hl, AVLNode<Key, Value>* mid,
+                                             AVLNode<Key, Value>* right, int hr, int& height);
+    AVLNode<Key, Value>* attachRight(AVLNode<Key, Value>* node, int hl,
+                                     AVLNode<Key, Value>* right, int hr, int& height);
+    AVLNode<Key, Value>* attachLeft(AVLNode<Key, Value>* node, AVLNode<Key, Value>* left, int hl,
+                                    int hr, int& height);
+    // left < mid < right, any heights
+    AVLNode<Key, Value>* joinTrees(AVLNode<Key, Value>* left, int hl, AVLNode<Key, Value>* mid,
+                                   AVLNode<Key, Value>* right, int hr, int& height);
+    AVLNode<Key, Value>* joinTrees(AVLNode<Key, Value>* left, int hl,
+                                   AVLNode<Key, Value>* right, int hr, int& height);
+    // Splits the subtree at node into the nodes before path.back() and the
+    // rest; path runs from node (path[at]) down to that node
+    void splitBefore(AVLNode<Key, Value>* node, int h, const std::vector<AVLNode<Key, Value>*>& path, size_t at,
+                     AVLNode<Key, Value>*& before, int& hb, AVLNode<Key, Value>*& from, int& hf);
+    // Detaches the largest node of the subtree into last
+    AVLNode<Key, Value>* splitLast(AVLNode<Key, Value>* node, int h,
+                                   AVLNode<Key, Value>*& last, int& height);
+    // Links nodeAt(first), ..., nodeAt(first + count - 1), already in key
+    // order, into a perfectly balanced subtree. nodeAt is called once per index.
+    template<typename NodeAt>
+    static AVLNode<Key, Value>* buildBalanced(const NodeAt& nodeAt, size_t first, size_t count,
+                                              int& height, ThreadPool* pool, int forkDepth);
+    AVLNode<Key, Value>* applyOps(AVLNode<Key, Value>* node, int& height,
+                                  const BatchOp<Key, Value>* first, const BatchOp<Key, Value>* last,
+                                  ThreadPool* pool, int forkDepth);
+    AVLNode<Key, Value>* buildFromOps(const BatchOp<Key, Value>* first, const BatchOp<Key, Value>* last,
+                                      int& height, ThreadPool* pool, int forkDepth);
+    void mergeRebuild(const std::vector<BatchOp<Key, Value> >& sortedOps, ThreadPool* pool, int forkDepth);
+    // A new node for applyBatch(), as the tree's node type. May be called
+    // from several threads at once.
+    virtual AVLNode<Key, Value>* createBatchNode(const Key& key, const Value& value);
+    // Links buildFrom()'s items, sorted and with repeats settled, into the
+    // empty tree. Virtual for the same reason as applyBatch(); trees with
+    // their own node type override it to call linkSortedAs().
+    virtual void linkSorted(std::vector<std::pair<Key, Value> >& items, ThreadPool* pool, int forkDepth);
+    template<typename NodeType>
+    void linkSortedAs(std::vector<std::pair<Key, Value> >& items, ThreadPool* pool, int forkDepth);
+
+    // Compaction helpers
+    void layoutOrder(NodeLayout layout, std::vector<AVLNode<Key, Value>*>& order) const;
+    static void vebOrder(AVLNode<Key, Value>* node, int levels, std::vector<AVLNode<Key, Value>*>& order);
+    static void collectAtDepth(AVLNode<Key, Value>* node, int depth, std::vector<AVLNode<Key, Value>*>& out);
+    // Copies node into slot, points its neighbours at the copy and frees
+    // node. Virtual for trees that keep pointers to their nodes.
+    virtual void relocateNode(AVLNode<Key, Value>* node, AVLNode<Key, Value>* slot);
+
+    // State of an incremental compaction
+    std::vector<Key> compactKeys_;
+    size_t compactNext_;
+    AVLNode<Key, Value>* compactBlock_;
+    size_t compactFilled_;
+    // Serializes destroyNode between the tasks of a parallel applyBatch,
+    // since freeing a node out of a block updates the shared block list
+    std::mutex batchLock_;
 };
 
+template<class Key, class Value, class Compare>
+AVLTree<Key, Value, Compare>::AVLTree(const Compare& comp) :
+    BinarySearchTree<Key, Value, Compare>(comp),
+    compactNext_(0), compactBlock_(nullptr), compactFilled_(0)
+{
+}
+
+template<class Key, class Value, class Compare>
+AVLTree<Key, Value, Compare>::AVLTree(const AVLTree& other) :
+    BinarySearchTree<Key, Value, Compare>(other.comp_),
+    compactNext_(0), compactBlock_(nullptr), compactFilled_(0)
+{
+    this->template cloneAs<AVLNode<Key, Value> >(other, 1);
+}
+
+template<class Key, class Value, class Compare>
+AVLTree<Key, Value, Compare>::AVLTree(AVLTree&& other) :
+    BinarySearchTree<Key, Value, Compare>(std::move(other)),
+    compactKeys_(std::move(other.compactKeys_)), compactNext_(other.compactNext_),
+    compactBlock_(other.compactBlock_), compactFilled_(other.compactFilled_)
+{
+    other.compactKeys_.clear();
+    other.compactNext_ = 0;
+    other.compactBlock_ = nullptr;
+    other.compactFilled_ = 0;
+}
+
+template<class Key, class Value, class Compare>
+AVLTree<Key, Value, Compare>& AVLTree<Key, Value, Compare>::operator=(const AVLTree& other)
+{
+    BinarySearchTree<Key, Value, Compare>::operator=(other);
+    return *this;
+}
+
+template<class Key, class Value, class Compare>
+AVLTree<Key, Value, Compare>& AVLTree<Key, Value, Compare>::operator=(AVLTree&& other)
+{
+    BinarySearchTree<Key, Value, Compare>::operator=(std::move(other));
+    return *this;
+}
+
 /*
  * Recall: If key is already in the tree, you should 
  * overwrite the current value with the updated value.
  */
-template<class Key, class Value>
-void AVLTree<Key, Value>::insert(const std::pair<const Key, Value> &new_item)
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::insert(const std::pair<const Key, Value> &new_item)
 {
+    BST_STAT(this->counters_.begin(TREE_OP_INSERT));
+    BST_TRACE_SCOPE(trace, TRACE_INSERT, &new_item.first);
+    BST_RECORD_OP(TRACE_INSERT, &new_item.first);
+    this->maintainFilter();
     // First do the regular BST insertion
-    AVLNode<Key, Value>* newNode = new AVLNode<Key, Value>(new_item.first, new_item.second, nullptr);
     if (this->root_ == nullptr) {
-        this->root_ = newNode;
+        this->root_ = this->template createNode<AVLNode<Key, Value> >(new_item.first, new_item.second, nullptr);
         return;}
 
 AVLNode<Key, Value>* current = static_cast<AVLNode<Key, Value>*>(this->root_);
 AVLNode<Key, Value>* parent = nullptr;
+AVLNode<Key, Value>* candidate = nullptr;  // last node we went right at
+bool left = false;
 
 while (current != nullptr) {
         parent = current;
-        if (new_item.first < current->getKey()) {
-            current = current->getLeft();} 
-      else if (new_item.first > current->getKey()) {
-            current = current->getRight();} else 
-    {// if key already exists - update value
-        current->setValue(new_item.second);
-        delete newNode;
-            return; } }
-
-    newNode->setParent(parent);
-    if (new_item.first < parent->getKey()) {
+        BST_STAT(++this->counters_.comparisons[TREE_OP_INSERT]);
+        left = this->comp_(new_item.first, current->getKey());
+        if (left) {
+            current = current->getLeft();
+        } else {
+            candidate = current;
+            current = current->getRight();} }
+
+    BST_STAT(if (candidate != nullptr) ++this->counters_.comparisons[TREE_OP_INSERT]);
+    if (candidate != nullptr && !this->comp_(candidate->getKey(), new_item.first)) {
+        // if key already exists - update value
+        candidate->setValue(new_item.second);
+        return; }
+
+    AVLNode<Key, Value>* newNode = this->createNode(new_item.first, new_item.second, parent);
+    BST_TRACE_AT(trace, newNode, 0);
+    if (left) {
         parent->setLeft(newNode); } 
         else {parent->setRight(newNode); }
 
@@ -187,14 +406,30 @@ while (current != nullptr) {
  * Recall: The writeup specifies that if a node has 2 children you
  * should swap with the predecessor and then remove.
  */
-template<class Key, class Value>
-void AVLTree<Key, Value>::remove(const Key& key)
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::remove(const Key& key)
 {
+    BST_STAT(this->counters_.begin(TREE_OP_REMOVE));
+    BST_TRACE_SCOPE(trace, TRACE_REMOVE, &key);
+    BST_RECORD_OP(TRACE_REMOVE, &key);
     // First find the node to remove
     AVLNode<Key, Value>* nodeToRemove = static_cast<AVLNode<Key, Value>*>(this->internalFind(key));
     if (nodeToRemove == nullptr) {
         return; }
 
+    AVLNode<Key, Value>* parent = unlinkNode(nodeToRemove);
+    BST_TRACE_AT(trace, parent, 1);
+    BST_TRACE_END(trace);  // key may refer into nodeToRemove
+ this->destroyNode(nodeToRemove);}
+
+/*
+ * Takes node out of the tree (swapping it with its predecessor first if it
+ * has two children) and rebalances. Returns the node it was unlinked from.
+ * The caller frees node.
+ */
+template<class Key, class Value, class Compare>
+AVLNode<Key, Value>* AVLTree<Key, Value, Compare>::unlinkNode(AVLNode<Key, Value>* nodeToRemove)
+{
     AVLNode<Key, Value>* parent = nodeToRemove->getParent();
 
     // if the node has 2 children
@@ -208,13 +443,15 @@ void AVLTree<Key, Value>::remove(const Key& key)
     AVLNode<Key, Value>* child = (nodeToRemove->getLeft() != nullptr) ? 
                                 nodeToRemove->getLeft() : nodeToRemove->getRight();
 
+ bool leftShorter = false;
  if (parent == nullptr) {
     this->root_ = child;
     if (child != nullptr) {
         child->setParent(nullptr);
     }
 } else {
-    if (parent->getLeft() == nodeToRemove) {
+    leftShorter = (parent->getLeft() == nodeToRemove);
+    if (leftShorter) {
         parent->setLeft(child);} 
         else {
         parent->setRight(child);}
@@ -222,67 +459,160 @@ void AVLTree<Key, Value>::remove(const Key& key)
         child->setParent(parent); }
 }
 
-    // Update heights and balance factors, then rebalance if needed
-    if (parent != nullptr) { adjustAfterRemove(parent); }
- delete nodeToRemove;}
+    // Update balance factors on the way up, then rebalance if needed
+    if (parent != nullptr) { adjustAfterRemove(parent, leftShorter); }
+    return parent;}
 
-template<class Key, class Value>
-void AVLTree<Key, Value>::nodeSwap(AVLNode<Key,Value>* n1, AVLNode<Key,Value>* n2)
-{BinarySearchTree<Key, Value>::nodeSwap(n1, n2);
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::eraseNode(Node<Key, Value>* node)
+{
+    AVLNode<Key, Value>* avlNode = static_cast<AVLNode<Key, Value>*>(node);
+    unlinkNode(avlNode);
+    this->destroyNode(avlNode);
+}
+
+/**
+* Two splits cut the tree into the nodes before first, the span and the
+* nodes from last on; the span is freed and the outer parts are joined.
+* Each split follows one root-to-node path and costs O(log n) in joins,
+* so only freeing the span depends on its size.
+*/
+template<class Key, class Value, class Compare>
+size_t AVLTree<Key, Value, Compare>::eraseSpan(Node<Key, Value>* first, Node<Key, Value>* last)
+{
+    if (first == last) return 0;
+    std::vector<AVLNode<Key, Value>*> path;
+    for (Node<Key, Value>* n = first; n != nullptr; n = n->getParent()) {
+        path.push_back(static_cast<AVLNode<Key, Value>*>(n));
+    }
+    std::reverse(path.begin(), path.end());
+    AVLNode<Key, Value>* before;
+    AVLNode<Key, Value>* span;
+    int hb, hs;
+    splitBefore(path[0], subtreeHeight(path[0]), path, 0, before, hb, span, hs);
+    span->setParent(nullptr);
+
+    AVLNode<Key, Value>* after = nullptr;
+    int ha = -1;
+    if (last != nullptr) {
+        path.clear();
+        for (Node<Key, Value>* n = last; n != nullptr; n = n->getParent()) {
+            path.push_back(static_cast<AVLNode<Key, Value>*>(n));
+        }
+        std::reverse(path.begin(), path.end());
+        AVLNode<Key, Value>* rest = span;
+        splitBefore(rest, hs, path, 0, span, hs, after, ha);
+    }
+    size_t count = this->destroySubtree(span);
+
+    int height;
+    AVLNode<Key, Value>* root = joinTrees(before, hb, after, ha, height);
+    if (root != nullptr) root->setParent(nullptr);
+    this->root_ = root;
+    return count;
+}
+
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::nodeSwap(AVLNode<Key,Value>* n1, AVLNode<Key,Value>* n2)
+{BinarySearchTree<Key, Value, Compare>::nodeSwap(n1, n2);
    int8_t tmp = n1->getBalance();
 n1->setBalance(n2->getBalance());
 n2->setBalance(tmp);
     
     }
 
-template<class Key, class Value>
-int AVLTree<Key, Value>::getNodeHeight(AVLNode<Key, Value>* node) const
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::cloneNodes(const BinarySearchTree<Key, Value, Compare>& other, unsigned int threads)
 {
-    if (node == nullptr) return -1;
-    //similar to the 1st part of the assignment
-return 1 + std::max(getNodeHeight(node->getLeft()), getNodeHeight(node->getRight()));}
+    abandonCompaction();
+    this->template cloneAs<AVLNode<Key, Value> >(other, threads);
+}
 
-template<class Key, class Value>
-int AVLTree<Key, Value>::getBalanceFactor(AVLNode<Key, Value>* node) const
+/**
+* The compaction block is in blocks_, which the base class swapped, so its
+* progress has to go along with it.
+*/
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::swapExtra(BinarySearchTree<Key, Value, Compare>& other)
 {
-    if (node == nullptr) return 0;
-    return getNodeHeight(node->getRight()) - getNodeHeight(node->getLeft());
+    AVLTree<Key, Value, Compare>& rhs = static_cast<AVLTree<Key, Value, Compare>&>(other);
+    compactKeys_.swap(rhs.compactKeys_);
+    std::swap(compactNext_, rhs.compactNext_);
+    std::swap(compactBlock_, rhs.compactBlock_);
+    std::swap(compactFilled_, rhs.compactFilled_);
 }
 
-template<class Key, class Value>
-void AVLTree<Key, Value>::updateNodeHeight(AVLNode<Key, Value>* node)
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::abandonCompaction()
 {
-    if (node != nullptr) {
-        node->setBalance(getBalanceFactor(node));
-    }
+    if (compactBlock_ == nullptr) return;
+    this->releaseNodeSlots(compactBlock_, compactKeys_.size() - compactFilled_);
+    compactBlock_ = nullptr;
+    std::vector<Key>().swap(compactKeys_);
+    compactNext_ = 0;
+    compactFilled_ = 0;
 }
 
-template<class Key, class Value>
-void AVLTree<Key, Value>::adjustAfterInsert(AVLNode<Key, Value>* node)
+template<class Key, class Value, class Compare>
+TreeViolation AVLTree<Key, Value, Compare>::checkNode(const Node<Key, Value>* node, SubtreeCheck& check) const
 {
-    while (node != nullptr) {
-        updateNodeHeight(node);
-        
-        if (node->getBalance() > 1 || node->getBalance() < -1) {
-    rebalance(node);
-         break;}
-        node = node->getParent(); }}
+    int balance = check.rightHeight - check.leftHeight;
+    check.aux = 0;
+    if (balance > 1 || balance < -1) return TREE_UNBALANCED;
+    if (static_cast<const AVLNode<Key, Value>*>(node)->getBalance() != balance) return TREE_BAD_METADATA;
+    return TREE_OK;
+}
 
-template<class Key, class Value>
-void AVLTree<Key, Value>::adjustAfterRemove(AVLNode<Key, Value>* node)
+/**
+* Walks up from the new leaf, adding one to the balance on the side that
+* grew. A node that ends up balanced absorbs the growth and one that ends
+* up at +-2 is fixed by a rotation that restores its old height, so either
+* way the walk stops there: O(log n) and at most one (double) rotation.
+*/
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::adjustAfterInsert(AVLNode<Key, Value>* node)
 {
-    while (node != nullptr) {
-updateNodeHeight(node);
-        
-        if (node->getBalance() > 1 || node->getBalance() < -1) {
     AVLNode<Key, Value>* parent = node->getParent();
-    rebalance(node);
-    node = parent;
-        } else {
-            node = node->getParent();} }}
+    while (parent != nullptr) {
+        parent->updateBalance(parent->getLeft() == node ? -1 : 1);
+        if (parent->getBalance() == 0) break;
+        if (parent->getBalance() > 1 || parent->getBalance() < -1) {
+            rebalance(parent);
+            break;
+        }
+        node = parent;
+        parent = node->getParent();
+    }
+}
 
-template<class Key, class Value>
-void AVLTree<Key, Value>::rebalance(AVLNode<Key, Value>* node)
+/**
+* The same walk for a shrunken subtree. A node that goes from balanced to
+* +-1 keeps its height and ends it; a rotation only ends it when the
+* heavier child was balanced, since otherwise the rotated subtree is
+* shorter too and the change goes on up.
+*/
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::adjustAfterRemove(AVLNode<Key, Value>* node, bool leftShorter)
+{
+    while (node != nullptr) {
+        AVLNode<Key, Value>* parent = node->getParent();
+        bool isLeft = (parent != nullptr && parent->getLeft() == node);
+        node->updateBalance(leftShorter ? 1 : -1);
+        int8_t balance = node->getBalance();
+        if (balance == 1 || balance == -1) break;
+        if (balance > 1 || balance < -1) {
+            AVLNode<Key, Value>* heavy = (balance > 0) ? node->getRight() : node->getLeft();
+            bool sameHeight = (heavy->getBalance() == 0);
+            rebalance(node);
+            if (sameHeight) break;
+        }
+        node = parent;
+        leftShorter = isLeft;
+    }
+}
+
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::rebalance(AVLNode<Key, Value>* node)
 {
     // Right heavy
     if (node->getBalance() > 1) {
@@ -304,9 +634,10 @@ void AVLTree<Key, Value>::rebalance(AVLNode<Key, Value>* node)
     }
 }
 
-template<class Key, class Value>
-void AVLTree<Key, Value>::rotateLeft(AVLNode<Key, Value>* node)
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::rotateLeft(AVLNode<Key, Value>* node)
 {
+    BST_STAT(++this->counters_.rotations);
     AVLNode<Key, Value>* newRoot = node->getRight();
     AVLNode<Key, Value>* parent = node->getParent();
 
@@ -324,13 +655,14 @@ void AVLTree<Key, Value>::rotateLeft(AVLNode<Key, Value>* node)
         else {
         parent->setRight(newRoot);}
 
-    // U
-    updateNodeHeight(node);
-    updateNodeHeight(newRoot);
+    // Balances follow from the old ones alone, whatever the heights are
+    node->setBalance(node->getBalance() - 1 - std::max<int8_t>(newRoot->getBalance(), 0));
+    newRoot->setBalance(newRoot->getBalance() - 1 + std::min<int8_t>(node->getBalance(), 0));
 }
-template<class Key, class Value>
-void AVLTree<Key, Value>::rotateRight(AVLNode<Key, Value>* node)
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::rotateRight(AVLNode<Key, Value>* node)
 {
+    BST_STAT(++this->counters_.rotations);
     AVLNode<Key, Value>* newRoot = node->getLeft();
     AVLNode<Key, Value>* parent = node->getParent();
 
@@ -351,8 +683,622 @@ void AVLTree<Key, Value>::rotateRight(AVLNode<Key, Value>* node)
         parent->setRight(newRoot);
     }
 
-    // basically Update    balance  after rotation
-    updateNodeHeight(node);
-    updateNodeHeight(newRoot);
+    // mirror image of rotateLeft
+    node->setBalance(node->getBalance() + 1 - std::min<int8_t>(newRoot->getBalance(), 0));
+    newRoot->setBalance(newRoot->getBalance() + 1 + std::max<int8_t>(node->getBalance(), 0));
+}
+
+/**
+* Applies a batch of upserts and removals sorted by key.
+*
+* Small batches are pushed down the tree: each subtree gets the slice of
+* the batch that falls inside it, so neighbouring keys share the descent
+* above their common ancestor, and the pieces are put back together with
+* AVL joins, which rebalance once per affected subtree. That is
+* O(m log(n / m + 1)) work. The two halves of each split are independent,
+* so the top few levels are run as parallel tasks when threads > 1.
+*
+* Batches that are large next to the tree are merged with the in-order
+* node list instead and the tree is relinked from scratch in O(n + m).
+*/
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::applyBatch(const std::vector<BatchOp<Key, Value> >& sortedOps, unsigned int threads)
+{
+    if (!this->uniqueKeys()) throw std::logic_error("applyBatch: not defined for trees with equal keys");
+    if (sortedOps.empty()) return;
+    for (size_t i = 1; i < sortedOps.size(); ++i) {
+        if (this->comp_(sortedOps[i].key, sortedOps[i - 1].key)) {
+            throw std::invalid_argument("applyBatch: ops are not sorted by key");
+        }
+    }
+#ifdef BST_STATS
+    threads = 1;  // the counters updated by createNode/destroyNode are not atomic
+#endif
+
+    // Nodes are created on several threads and old ones freed in any order,
+    // so the filter sits out the batch and is told about the upserts after.
+    // Upserts of keys already present and removed keys stay in it as stale
+    // entries, which only cost false positives until it is next regrown.
+    this->maintainFilter();
+    this->pauseFilter();
+    int height = subtreeHeight(static_cast<AVLNode<Key, Value>*>(this->root_));
+    ThreadPool* pool = nullptr;
+    int forkDepth = 0;
+    if (threads > 1) {
+        pool = new ThreadPool(threads);
+        // a few tasks per thread
+        while ((1u << forkDepth) < 4 * threads) ++forkDepth;
+    }
+
+    // An AVL tree of height h has between 1.618^h and 2^(h+1) nodes, and
+    // usually about 2^h; rebuild once the batch is a sizeable fraction of that.
+    if (height < 0 || (height < 62 && (size_t(1) << height) <= 4 * sortedOps.size())) {
+        mergeRebuild(sortedOps, pool, forkDepth);
+    } else {
+        const BatchOp<Key, Value>* ops = &sortedOps[0];
+        AVLNode<Key, Value>* root = applyOps(static_cast<AVLNode<Key, Value>*>(this->root_), height,
+                                             ops, ops + sortedOps.size(), pool, forkDepth);
+        if (root != nullptr) root->setParent(nullptr);
+        this->root_ = root;
+    }
+    delete pool;
+    this->resumeFilter();
+    if (this->filter_ != nullptr) {
+        for (size_t i = 0; i < sortedOps.size(); ++i) {
+            if (sortedOps[i].kind == BATCH_UPSERT) this->filterAdd(sortedOps[i].key);
+        }
+    }
+}
+
+/**
+* Splits the batch at node's key, recurses into both children with their
+* halves, and joins the results back under node (or without it, if the
+* batch removes it).
+*/
+template<class Key, class Value, class Compare>
+AVLNode<Key, Value>* AVLTree<Key, Value, Compare>::applyOps(AVLNode<Key, Value>* node, int& height,
+                                                            const BatchOp<Key, Value>* first,
+                                                            const BatchOp<Key, Value>* last,
+                                                            ThreadPool* pool, int forkDepth)
+{
+    if (first == last) return node;
+    if (node == nullptr) return buildFromOps(first, last, height, pool, forkDepth);
+    settleNode(node);
+
+    const Compare& comp = this->comp_;
+    const BatchOp<Key, Value>* lo = first;
+    const BatchOp<Key, Value>* hi = last;
+    // [first, lo) goes left, [lo, hi) has node's key, [hi, last) goes right
+    while (lo != hi) {
+        const BatchOp<Key, Value>* mid = lo + (hi - lo) / 2;
+        if (comp(mid->key, node->getKey())) lo = mid + 1; else hi = mid;
+    }
+    hi = lo;
+    while (hi != last && !comp(node->getKey(), hi->key)) ++hi;
+
+    int hl, hr;
+    childHeights(node, height, hl, hr);
+    AVLNode<Key, Value>* left = node->getLeft();
+    AVLNode<Key, Value>* right = node->getRight();
+    if (pool != nullptr && forkDepth > 0 && first != lo && hi != last) {
+        TaskGroup group(*pool);
+        group.run([&]() { left = applyOps(left, hl, first, lo, pool, forkDepth - 1); });
+        right = applyOps(right, hr, hi, last, pool, forkDepth - 1);
+        group.wait();
+    } else {
+        left = applyOps(left, hl, first, lo, pool, forkDepth - 1);
+        right = applyOps(right, hr, hi, last, pool, forkDepth - 1);
+    }
+
+    if (lo != hi && (hi - 1)->kind == BATCH_REMOVE) {
+        if (pool != nullptr) {
+            std::lock_guard<std::mutex> guard(batchLock_);
+            this->destroyNode(node);
+        } else {
+            this->destroyNode(node);
+        }
+        return joinTrees(left, hl, right, hr, height);
+    }
+    if (lo != hi) node->setValue((hi - 1)->value);
+    return joinTrees(left, hl, node, right, hr, height);
+}
+
+/**
+* New nodes for the last op of each run of equal keys, if it is an upsert,
+* linked into a balanced subtree.
+*/
+template<class Key, class Value, class Compare>
+AVLNode<Key, Value>* AVLTree<Key, Value, Compare>::buildFromOps(const BatchOp<Key, Value>* first,
+                                                                const BatchOp<Key, Value>* last,
+                                                                int& height, ThreadPool* pool, int forkDepth)
+{
+    std::vector<AVLNode<Key, Value>*> nodes;
+    for (const BatchOp<Key, Value>* op = first; op != last; ++op) {
+        if (op + 1 != last && !this->comp_(op->key, (op + 1)->key)) continue;
+        if (op->kind == BATCH_UPSERT) {
+            nodes.push_back(createBatchNode(op->key, op->value));
+        }
+    }
+    if (nodes.empty()) {
+        height = -1;
+        return nullptr;
+    }
+    auto nodeAt = [&nodes](size_t i) { return nodes[i]; };
+    return buildBalanced(nodeAt, 0, nodes.size(), height, pool, forkDepth);
+}
+
+/**
+* Merges the in-order node list with the batch (reusing the nodes that
+* stay) and relinks everything into a perfectly balanced tree.
+*/
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::mergeRebuild(const std::vector<BatchOp<Key, Value> >& sortedOps,
+                                                ThreadPool* pool, int forkDepth)
+{
+    this->settleAll();
+    // collect first: freeing nodes mid-walk would break the parent links
+    std::vector<AVLNode<Key, Value>*> nodes;
+    for (Node<Key, Value>* n = this->getSmallestNode(); n != nullptr; n = this->successor(n)) {
+        nodes.push_back(static_cast<AVLNode<Key, Value>*>(n));
+    }
+
+    std::vector<AVLNode<Key, Value>*> merged;
+    merged.reserve(nodes.size() + sortedOps.size());
+    size_t n = 0;
+    size_t i = 0;
+    while (n < nodes.size() || i < sortedOps.size()) {
+        if (i == sortedOps.size() || (n < nodes.size() && this->comp_(nodes[n]->getKey(), sortedOps[i].key))) {
+            merged.push_back(nodes[n++]);
+            continue;
+        }
+        // the last op on this key decides
+        size_t end = i + 1;
+        while (end < sortedOps.size() && !this->comp_(sortedOps[i].key, sortedOps[end].key)) ++end;
+        const BatchOp<Key, Value>& op = sortedOps[end - 1];
+        i = end;
+        AVLNode<Key, Value>* existing = nullptr;
+        if (n < nodes.size() && !this->comp_(op.key, nodes[n]->getKey())) existing = nodes[n++];
+        if (op.kind == BATCH_UPSERT) {
+            if (existing != nullptr) {
+                existing->setValue(op.value);
+                merged.push_back(existing);
+            } else {
+                merged.push_back(createBatchNode(op.key, op.value));
+            }
+        } else if (existing != nullptr) {
+            this->destroyNode(existing);
+        }
+    }
+
+    int height;
+    auto nodeAt = [&merged](size_t i) { return merged[i]; };
+    AVLNode<Key, Value>* root = buildBalanced(nodeAt, 0, merged.size(), height, pool, forkDepth);
+    if (root != nullptr) root->setParent(nullptr);
+    this->root_ = root;
+}
+
+template<class Key, class Value, class Compare>
+template<typename NodeAt>
+AVLNode<Key, Value>* AVLTree<Key, Value, Compare>::buildBalanced(const NodeAt& nodeAt, size_t first, size_t count,
+                                                                 int& height, ThreadPool* pool, int forkDepth)
+{
+    if (count == 0) {
+        height = -1;
+        return nullptr;
+    }
+    // the left half gets the extra node, so balances are 0 or -1
+    size_t mid = count / 2;
+    AVLNode<Key, Value>* node = nodeAt(first + mid);
+    int hl, hr;
+    AVLNode<Key, Value>* left;
+    AVLNode<Key, Value>* right;
+    if (pool != nullptr && forkDepth > 0 && count > 1024) {
+        TaskGroup group(*pool);
+        group.run([&]() { left = buildBalanced(nodeAt, first, mid, hl, pool, forkDepth - 1); });
+        right = buildBalanced(nodeAt, first + mid + 1, count - mid - 1, hr, pool, forkDepth - 1);
+        group.wait();
+    } else {
+        left = buildBalanced(nodeAt, first, mid, hl, nullptr, 0);
+        right = buildBalanced(nodeAt, first + mid + 1, count - mid - 1, hr, nullptr, 0);
+    }
+    return linkBalanced(left, hl, node, right, hr, height);
+}
+
+/**
+* Bulk load. The input is copied out and stable-sorted in parallel, each
+* run of equal keys is cut down to its last entry (on trees with unique
+* keys; AVLMultiTree keeps the whole run, oldest first), and the nodes are then
+* constructed straight into one block and linked into a perfectly balanced
+* tree, with both halves of the big subtrees built in parallel.
+*/
+template<class Key, class Value, class Compare>
+template<typename InputIt>
+void AVLTree<Key, Value, Compare>::buildFrom(InputIt first, InputIt last, unsigned int threads)
+{
+    this->clear();
+    std::vector<std::pair<Key, Value> > items;
+    for (; first != last; ++first) items.push_back(std::pair<Key, Value>(first->first, first->second));
+    if (items.empty()) return;
+#ifdef BST_STATS
+    threads = 1;  // see applyBatch
+#endif
+
+    ThreadPool pool(threads);
+    const Compare& comp = this->comp_;
+    parallelStableSort(items, [&comp](const std::pair<Key, Value>& a, const std::pair<Key, Value>& b) {
+        return comp(a.first, b.first);
+    }, pool);
+
+    // last writer wins: keep the final entry of every run of equal keys
+    if (this->uniqueKeys()) {
+        size_t kept = 0;
+        for (size_t i = 0; i < items.size(); ++i) {
+            if (i + 1 < items.size() && !comp(items[i].first, items[i + 1].first)) continue;
+            if (kept != i) items[kept] = std::move(items[i]);
+            ++kept;
+        }
+        items.resize(kept);
+    }
+
+    int forkDepth = 0;
+    while ((1u << forkDepth) < 4 * pool.size()) ++forkDepth;
+    linkSorted(items, pool.size() > 1 ? &pool : nullptr, forkDepth);
+    if (this->filter_ != nullptr) this->rebuildFilter();
+}
+
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::settleNode(AVLNode<Key, Value>* node)
+{
+}
+
+template<class Key, class Value, class Compare>
+AVLNode<Key, Value>* AVLTree<Key, Value, Compare>::createBatchNode(const Key& key, const Value& value)
+{
+    return this->template createNode<AVLNode<Key, Value> >(key, value, nullptr);
+}
+
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::linkSorted(std::vector<std::pair<Key, Value> >& items,
+                                              ThreadPool* pool, int forkDepth)
+{
+    linkSortedAs<AVLNode<Key, Value> >(items, pool, forkDepth);
+}
+
+template<class Key, class Value, class Compare>
+template<typename NodeType>
+void AVLTree<Key, Value, Compare>::linkSortedAs(std::vector<std::pair<Key, Value> >& items,
+                                                ThreadPool* pool, int forkDepth)
+{
+    NodeType* block = this->template allocateNodeBlock<NodeType>(items.size());
+    auto nodeAt = [block, &items](size_t i) {
+        return new (block + i) NodeType(items[i].first, items[i].second, nullptr);
+    };
+    int height;
+    AVLNode<Key, Value>* root = buildBalanced(nodeAt, 0, items.size(), height, pool, forkDepth);
+    root->setParent(nullptr);
+    this->root_ = root;
+}
+
+template<class Key, class Value, class Compare>
+int AVLTree<Key, Value, Compare>::subtreeHeight(const AVLNode<Key, Value>* node)
+{
+    int height = -1;
+    while (node != nullptr) {
+        ++height;
+        node = (node->getBalance() > 0) ? node->getRight() : node->getLeft();
+    }
+    return height;
+}
+
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::childHeights(const AVLNode<Key, Value>* node, int height, int& left, int& right)
+{
+    left = (node->getBalance() > 0) ? height - 2 : height - 1;
+    right = (node->getBalance() < 0) ? height - 2 : height - 1;
+}
+
+/**
+* Makes left and right (heights within one of each other) mid's children.
+*/
+template<class Key, class Value, class Compare>
+AVLNode<Key, Value>* AVLTree<Key, Value, Compare>::linkBalanced(AVLNode<Key, Value>* left, int hl,
+                                                                AVLNode<Key, Value>* mid,
+                                                                AVLNode<Key, Value>* right, int hr, int& height)
+{
+    mid->setLeft(left);
+    if (left != nullptr) left->setParent(mid);
+    mid->setRight(right);
+    if (right != nullptr) right->setParent(mid);
+    mid->setBalance(hr - hl);
+    height = 1 + std::max(hl, hr);
+    return mid;
+}
+
+/**
+* Replaces node's right subtree (node's left has height hl) with one of
+* height hr <= hl + 2, rotating once or twice if it is now too tall.
+*/
+template<class Key, class Value, class Compare>
+AVLNode<Key, Value>* AVLTree<Key, Value, Compare>::attachRight(AVLNode<Key, Value>* node, int hl,
+                                                               AVLNode<Key, Value>* right, int hr, int& height)
+{
+    if (hr <= hl + 1) return linkBalanced(node->getLeft(), hl, node, right, hr, height);
+
+    BST_STAT(++this->counters_.rotations);
+    settleNode(right);
+    int hrl, hrr;
+    childHeights(right, hr, hrl, hrr);
+    int hnode;
+    if (hrr >= hrl) {
+        // single rotation: right's left subtree moves under node
+        linkBalanced(node->getLeft(), hl, node, right->getLeft(), hrl, hnode);
+        return linkBalanced(node, hnode, right, right->getRight(), hrr, height);
+    }
+    // double rotation through right's left child
+    AVLNode<Key, Value>* inner = right->getLeft();
+    settleNode(inner);
+    int hil, hir, hright;
+    childHeights(inner, hrl, hil, hir);
+    linkBalanced(node->getLeft(), hl, node, inner->getLeft(), hil, hnode);
+    linkBalanced(inner->getRight(), hir, right, right->getRight(), hrr, hright);
+    return linkBalanced(node, hnode, inner, right, hright, height);
+}
+
+/**
+* Mirror image of attachRight.
+*/
+template<class Key, class Value, class Compare>
+AVLNode<Key, Value>* AVLTree<Key, Value, Compare>::attachLeft(AVLNode<Key, Value>* node, AVLNode<Key, Value>* left,
+                                                              int hl, int hr, int& height)
+{
+    if (hl <= hr + 1) return linkBalanced(left, hl, node, node->getRight(), hr, height);
+
+    BST_STAT(++this->counters_.rotations);
+    settleNode(left);
+    int hll, hlr;
+    childHeights(left, hl, hll, hlr);
+    int hnode;
+    if (hll >= hlr) {
+        linkBalanced(left->getRight(), hlr, node, node->getRight(), hr, hnode);
+        return linkBalanced(left->getLeft(), hll, left, node, hnode, height);
+    }
+    AVLNode<Key, Value>* inner = left->getRight();
+    settleNode(inner);
+    int hil, hir, hleft;
+    childHeights(inner, hlr, hil, hir);
+    linkBalanced(inner->getRight(), hir, node, node->getRight(), hr, hnode);
+    linkBalanced(left->getLeft(), hll, left, inner->getLeft(), hil, hleft);
+    return linkBalanced(left, hleft, inner, node, hnode, height);
+}
+
+/**
+* AVL join: walks down the spine of the taller tree to a subtree about as
+* tall as the other one, hangs both under mid there and rebalances on the
+* way back up. O(|hl - hr|).
+*/
+template<class Key, class Value, class Compare>
+AVLNode<Key, Value>* AVLTree<Key, Value, Compare>::joinTrees(AVLNode<Key, Value>* left, int hl,
+                                                             AVLNode<Key, Value>* mid,
+                                                             AVLNode<Key, Value>* right, int hr, int& height)
+{
+    if (hl > hr + 1) {
+        settleNode(left);
+        int hll, hlr, hsub;
+        childHeights(left, hl, hll, hlr);
+        AVLNode<Key, Value>* sub = joinTrees(left->getRight(), hlr, mid, right, hr, hsub);
+        return attachRight(left, hll, sub, hsub, height);
+    }
+    if (hr > hl + 1) {
+        settleNode(right);
+        int hrl, hrr, hsub;
+        childHeights(right, hr, hrl, hrr);
+        AVLNode<Key, Value>* sub = joinTrees(left, hl, mid, right->getLeft(), hrl, hsub);
+        return attachLeft(right, sub, hsub, hrr, height);
+    }
+    return linkBalanced(left, hl, mid, right, hr, height);
+}
+
+/**
+* Join without a middle node: the largest node of left is taken out and
+* used as the middle.
+*/
+template<class Key, class Value, class Compare>
+AVLNode<Key, Value>* AVLTree<Key, Value, Compare>::joinTrees(AVLNode<Key, Value>* left, int hl,
+                                                             AVLNode<Key, Value>* right, int hr, int& height)
+{
+    if (left == nullptr) {
+        height = hr;
+        return right;
+    }
+    if (right == nullptr) {
+        height = hl;
+        return left;
+    }
+    AVLNode<Key, Value>* mid;
+    int hrest;
+    AVLNode<Key, Value>* rest = splitLast(left, hl, mid, hrest);
+    return joinTrees(rest, hrest, mid, right, hr, height);
+}
+
+/**
+* Recurses down the path and joins the pieces back on the way up: the
+* subtrees hanging off to the left of the path end up in before, those to
+* the right in from. The joins cost O(log n) in total, as each one is
+* paid for by the height difference it closes.
+*/
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::splitBefore(AVLNode<Key, Value>* node, int h,
+                                               const std::vector<AVLNode<Key, Value>*>& path, size_t at,
+                                               AVLNode<Key, Value>*& before, int& hb,
+                                               AVLNode<Key, Value>*& from, int& hf)
+{
+    settleNode(node);
+    int hl, hr;
+    childHeights(node, h, hl, hr);
+    AVLNode<Key, Value>* left = node->getLeft();
+    AVLNode<Key, Value>* right = node->getRight();
+    if (at + 1 == path.size()) {
+        before = left;
+        hb = hl;
+        from = joinTrees(nullptr, -1, node, right, hr, hf);
+    } else if (path[at + 1] == left) {
+        AVLNode<Key, Value>* mid;
+        int hm;
+        splitBefore(left, hl, path, at + 1, before, hb, mid, hm);
+        from = joinTrees(mid, hm, node, right, hr, hf);
+    } else {
+        AVLNode<Key, Value>* mid;
+        int hm;
+        splitBefore(right, hr, path, at + 1, mid, hm, from, hf);
+        before = joinTrees(left, hl, node, mid, hm, hb);
+    }
+}
+
+template<class Key, class Value, class Compare>
+AVLNode<Key, Value>* AVLTree<Key, Value, Compare>::splitLast(AVLNode<Key, Value>* node, int h,
+                                                             AVLNode<Key, Value>*& last, int& height)
+{
+    settleNode(node);
+    int hl, hr;
+    childHeights(node, h, hl, hr);
+    if (node->getRight() == nullptr) {
+        last = node;
+        height = hl;
+        return node->getLeft();
+    }
+    int hrest;
+    AVLNode<Key, Value>* rest = splitLast(node->getRight(), hr, last, hrest);
+    return joinTrees(node->getLeft(), hl, node, rest, hrest, height);
+}
+
+/**
+* Moving a node is O(1): only its parent and children point at it, so the
+* nodes can be moved one by one in any order.
+*/
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::compact(NodeLayout layout)
+{
+    std::vector<AVLNode<Key, Value>*> order;
+    layoutOrder(layout, order);
+    if (order.empty()) return;
+    AVLNode<Key, Value>* block = this->template allocateNodeBlock<AVLNode<Key, Value> >(order.size());
+    for (size_t i = 0; i < order.size(); ++i) relocateNode(order[i], block + i);
+}
+
+/**
+* The target order is kept as keys rather than node pointers, so that the
+* tree can change between steps: a step looks each key up again, skips the
+* ones removed in the meantime and leaves their slots unused.
+*/
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::beginCompact(NodeLayout layout)
+{
+    abandonCompaction();
+    std::vector<AVLNode<Key, Value>*> order;
+    layoutOrder(layout, order);
+    compactKeys_.clear();
+    compactKeys_.reserve(order.size());
+    for (size_t i = 0; i < order.size(); ++i) compactKeys_.push_back(order[i]->getKey());
+    compactNext_ = 0;
+    compactFilled_ = 0;
+    if (!order.empty()) {
+        compactBlock_ = this->template allocateNodeBlock<AVLNode<Key, Value> >(order.size());
+    }
+}
+
+template<class Key, class Value, class Compare>
+bool AVLTree<Key, Value, Compare>::compactStep(size_t budget)
+{
+    if (compactBlock_ == nullptr) return true;
+    AVLNode<Key, Value>* blockEnd = compactBlock_ + compactKeys_.size();
+    for (; budget > 0 && compactNext_ < compactKeys_.size(); --budget) {
+        const Key& key = compactKeys_[compactNext_++];
+        // with equal keys (AVLMultiTree), the first one not yet moved
+        Node<Key, Value>* node = this->lowerBoundNode(key);
+        while (node != nullptr && !this->comp_(key, node->getKey()) &&
+               static_cast<AVLNode<Key, Value>*>(node) >= compactBlock_ &&
+               static_cast<AVLNode<Key, Value>*>(node) < blockEnd) {
+            node = this->successor(node);
+        }
+        if (node == nullptr || this->comp_(key, node->getKey())) continue;
+        relocateNode(static_cast<AVLNode<Key, Value>*>(node), compactBlock_ + compactFilled_++);
+    }
+    if (compactNext_ < compactKeys_.size()) return false;
+
+    this->releaseNodeSlots(compactBlock_, compactKeys_.size() - compactFilled_);
+    compactBlock_ = nullptr;
+    std::vector<Key>().swap(compactKeys_);
+    return true;
+}
+
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::layoutOrder(NodeLayout layout, std::vector<AVLNode<Key, Value>*>& order) const
+{
+    if (layout == LAYOUT_VEB) {
+        AVLNode<Key, Value>* root = static_cast<AVLNode<Key, Value>*>(this->root_);
+        vebOrder(root, subtreeHeight(root) + 1, order);
+        return;
+    }
+    for (Node<Key, Value>* n = this->getSmallestNode(); n != nullptr; n = this->successor(n)) {
+        order.push_back(static_cast<AVLNode<Key, Value>*>(n));
+    }
+}
+
+/**
+* The top half of the levels is laid out first, recursively, followed by
+* each subtree hanging below it, left to right, each laid out the same way.
+*/
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::vebOrder(AVLNode<Key, Value>* node, int levels,
+                                            std::vector<AVLNode<Key, Value>*>& order)
+{
+    if (node == nullptr) return;
+    if (levels == 1) {
+        order.push_back(node);
+        return;
+    }
+    int top = levels / 2;
+    vebOrder(node, top, order);
+    std::vector<AVLNode<Key, Value>*> bottoms;
+    collectAtDepth(node, top, bottoms);
+    for (size_t i = 0; i < bottoms.size(); ++i) vebOrder(bottoms[i], levels - top, order);
+}
+
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::collectAtDepth(AVLNode<Key, Value>* node, int depth,
+                                                  std::vector<AVLNode<Key, Value>*>& out)
+{
+    if (node == nullptr) return;
+    if (depth == 0) {
+        out.push_back(node);
+        return;
+    }
+    collectAtDepth(node->getLeft(), depth - 1, out);
+    collectAtDepth(node->getRight(), depth - 1, out);
 }
-#endif
\ No newline at end of file
+
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::relocateNode(AVLNode<Key, Value>* node, AVLNode<Key, Value>* slot)
+{
+    AVLNode<Key, Value>* parent = node->getParent();
+    // the key stays in the tree, so the filter keeps it
+    this->pauseFilter();
+    AVLNode<Key, Value>* moved = new (slot) AVLNode<Key, Value>(node->getKey(), node->getValue(), parent);
+    moved->setBalance(node->getBalance());
+    moved->setDead(node->isDead());
+    moved->setLeft(node->getLeft());
+    moved->setRight(node->getRight());
+    if (node->getLeft() != nullptr) node->getLeft()->setParent(moved);
+    if (node->getRight() != nullptr) node->getRight()->setParent(moved);
+    if (parent == nullptr) {
+        this->root_ = moved;
+    } else if (parent->getLeft() == node) {
+        parent->setLeft(moved);
+    } else {
+        parent->setRight(moved);
+    }
+    this->destroyNode(node);
+    this->resumeFilter();
+}
+
+#endif
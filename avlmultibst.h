@@ -0,0 +1,144 @@
+#ifndef AVLMULTIBST_H
+#define AVLMULTIBST_H
+
+#include <iostream>
+#include <exception>
+#include <cstdlib>
+#include <utility>
+#include "avlbst.h"
+
+/**
+* An AVL tree that keeps every inserted item, including items whose keys
+* are equal. Equal keys are stored next to each other in insertion order,
+* so iterating over equal_range(key) gives them oldest first. find(),
+* operator[] and remove() act on the oldest item with the key.
+* buildFrom() keeps every input item, equal keys in input order.
+* applyBatch() upserts and so has no meaning here; it throws
+* std::logic_error and leaves the tree alone.
+*
+* Balancing is AVLTree's; only the descent on insert differs (equal keys
+* go right, so a new item lands after all the existing ones).
+*/
+template <class Key, class Value, class Compare = std::less<Key> >
+class AVLMultiTree : public AVLTree<Key, Value, Compare>
+{
+public:
+    typedef typename BinarySearchTree<Key, Value, Compare>::iterator iterator;
+
+    explicit AVLMultiTree(const Compare& comp = Compare());
+
+    // Always adds a new item, after any items with an equal key
+    virtual void insert(const std::pair<const Key, Value>& new_item);
+
+    // The items with the given key, as [first, second)
+    std::pair<iterator, iterator> equal_range(const Key& key) const;
+    // Number of items with the given key
+    size_t count(const Key& key) const;
+    // Removes every item with the given key and returns how many there were
+    size_t remove_all(const Key& key);
+
+protected:
+    virtual bool uniqueKeys() const;
+};
+
+/*
+--------------------------------------------------
+Begin implementations for the AVLMultiTree class.
+--------------------------------------------------
+*/
+
+template<class Key, class Value, class Compare>
+AVLMultiTree<Key, Value, Compare>::AVLMultiTree(const Compare& comp) :
+    AVLTree<Key, Value, Compare>(comp)
+{
+}
+
+/**
+* Like AVLTree::insert, except that there is no equality check at the
+* bottom: keys equal to a node's are sent to its right.
+*/
+template<class Key, class Value, class Compare>
+void AVLMultiTree<Key, Value, Compare>::insert(const std::pair<const Key, Value>& new_item)
+{
+    BST_STAT(this->counters_.begin(TREE_OP_INSERT));
+    BST_TRACE_SCOPE(trace, TRACE_INSERT, &new_item.first);
+    BST_RECORD_OP(TRACE_INSERT, &new_item.first);
+    this->maintainFilter();
+    if (this->root_ == nullptr) {
+        this->root_ = this->template createNode<AVLNode<Key, Value> >(new_item.first, new_item.second, nullptr);
+        return;
+    }
+
+    AVLNode<Key, Value>* current = static_cast<AVLNode<Key, Value>*>(this->root_);
+    AVLNode<Key, Value>* parent = nullptr;
+    bool left = false;
+    while (current != nullptr) {
+        parent = current;
+        BST_STAT(++this->counters_.comparisons[TREE_OP_INSERT]);
+        left = this->comp_(new_item.first, current->getKey());
+        current = left ? current->getLeft() : current->getRight();
+    }
+
+    AVLNode<Key, Value>* newNode = this->createNode(new_item.first, new_item.second, parent);
+    BST_TRACE_AT(trace, newNode, 0);
+    if (left) {
+        parent->setLeft(newNode);
+    } else {
+        parent->setRight(newNode);
+    }
+    this->adjustAfterInsert(newNode);
+}
+
+/**
+* Two descents, one for each end of the run of equal keys.
+*/
+template<class Key, class Value, class Compare>
+std::pair<typename AVLMultiTree<Key, Value, Compare>::iterator,
+          typename AVLMultiTree<Key, Value, Compare>::iterator>
+AVLMultiTree<Key, Value, Compare>::equal_range(const Key& key) const
+{
+    return std::make_pair(this->lower_bound(key), this->upper_bound(key));
+}
+
+/**
+* O(log n + k): one descent to the first match, then an in-order walk
+* over the k matches.
+*/
+template<class Key, class Value, class Compare>
+size_t AVLMultiTree<Key, Value, Compare>::count(const Key& key) const
+{
+    size_t n = 0;
+    for (iterator it = this->lower_bound(key); it != this->end() && !this->comp_(key, it->first); ++it) {
+        ++n;
+    }
+    return n;
+}
+
+/**
+* O(log n + k): the matches are the span between lower and upper bound,
+* which eraseSpan cuts out with two splits and a join.
+*/
+template<class Key, class Value, class Compare>
+size_t AVLMultiTree<Key, Value, Compare>::remove_all(const Key& key)
+{
+    BST_STAT(this->counters_.begin(TREE_OP_REMOVE));
+    BST_TRACE_SCOPE(trace, TRACE_REMOVE, NULL);  // key may refer into a match
+    Node<Key, Value>* first = this->lowerBoundNode(key);
+    Node<Key, Value>* last = this->upperBoundNode(key);
+    BST_RECORD_SPAN(TRACE_REMOVE, first, last);
+    return this->eraseSpan(first, last);
+}
+
+template<class Key, class Value, class Compare>
+bool AVLMultiTree<Key, Value, Compare>::uniqueKeys() const
+{
+    return false;
+}
+
+/*
+------------------------------------------------
+End implementations for the AVLMultiTree class.
+------------------------------------------------
+*/
+
+#endif
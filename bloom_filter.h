@@ -0,0 +1,161 @@
+#ifndef BLOOM_FILTER_H
+#define BLOOM_FILTER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+#include "key_hash.h"
+
+/**
+ * A blocked counting Bloom filter over 64-bit key hashes. Each key maps
+ * to one 64-byte block (one cache line) and bumps PROBES of its 128
+ * four-bit counters, so a lookup reads a single line and a key can be
+ * taken out again by decrementing them. A counter that reaches 15 stays
+ * there: it can no longer tell how many keys share it, and staying set
+ * only costs false positives.
+ *
+ * False negatives are impossible as long as every hash removed was added
+ * before. Adding a key twice, or never removing one that is gone, is
+ * harmless beyond a higher false-positive rate, and counts towards size()
+ * until the owner rebuilds the filter.
+ */
+class CountingBloomFilter
+{
+public:
+    explicit CountingBloomFilter(size_t expectedKeys = 0);
+    CountingBloomFilter(const CountingBloomFilter& other);
+    CountingBloomFilter& operator=(const CountingBloomFilter& other);
+
+    void add(uint64_t hash);
+    void remove(uint64_t hash);
+    bool mightContain(uint64_t hash) const;
+    // Forgets every key, keeping the size
+    void clear();
+
+    // Adds minus removes
+    size_t size() const;
+    // Keys it was sized for, at about a 1% false-positive rate
+    size_t capacity() const;
+    bool overloaded() const;
+    size_t bytes() const;
+
+private:
+    static const size_t BLOCK_BYTES = 64;
+    static const size_t KEYS_PER_BLOCK = 12;  // about 10 counters per key
+    static const int PROBES = 4;
+
+    unsigned char* blockFor(uint64_t mixed) const;
+    void allocate(size_t blocks);
+
+    std::vector<unsigned char> storage_;  // the blocks, plus slack to align them
+    unsigned char* blocks_;               // first cache-line aligned byte of storage_
+    size_t blockCount_;
+    size_t entries_;
+};
+
+inline CountingBloomFilter::CountingBloomFilter(size_t expectedKeys) :
+    blocks_(nullptr), blockCount_(0), entries_(0)
+{
+    allocate(std::max<size_t>(1, (expectedKeys + KEYS_PER_BLOCK - 1) / KEYS_PER_BLOCK));
+}
+
+inline CountingBloomFilter::CountingBloomFilter(const CountingBloomFilter& other) :
+    blocks_(nullptr), blockCount_(0), entries_(other.entries_)
+{
+    allocate(other.blockCount_);
+    memcpy(blocks_, other.blocks_, blockCount_ * BLOCK_BYTES);
+}
+
+inline CountingBloomFilter& CountingBloomFilter::operator=(const CountingBloomFilter& other)
+{
+    if (this != &other) {
+        allocate(other.blockCount_);
+        memcpy(blocks_, other.blocks_, blockCount_ * BLOCK_BYTES);
+        entries_ = other.entries_;
+    }
+    return *this;
+}
+
+inline void CountingBloomFilter::allocate(size_t blocks)
+{
+    storage_.assign(blocks * BLOCK_BYTES + BLOCK_BYTES - 1, 0);
+    uintptr_t at = reinterpret_cast<uintptr_t>(&storage_[0]);
+    blocks_ = &storage_[0] + (BLOCK_BYTES - at % BLOCK_BYTES) % BLOCK_BYTES;
+    blockCount_ = blocks;
+}
+
+/**
+ * The high half of the mixed hash picks the block, the low 28 bits the
+ * counters in it, 7 bits (one of 128) per probe.
+ */
+inline unsigned char* CountingBloomFilter::blockFor(uint64_t mixed) const
+{
+    return blocks_ + ((mixed >> 32) * blockCount_ >> 32) * BLOCK_BYTES;
+}
+
+inline void CountingBloomFilter::add(uint64_t hash)
+{
+    uint64_t mixed = mixHash(hash);
+    unsigned char* block = blockFor(mixed);
+    for (int i = 0; i < PROBES; ++i) {
+        unsigned cell = (mixed >> (7 * i)) & 127;
+        unsigned shift = (cell & 1) * 4;
+        unsigned count = (block[cell / 2] >> shift) & 15;
+        if (count < 15) block[cell / 2] += (unsigned char)(1 << shift);
+    }
+    ++entries_;
+}
+
+inline void CountingBloomFilter::remove(uint64_t hash)
+{
+    uint64_t mixed = mixHash(hash);
+    unsigned char* block = blockFor(mixed);
+    for (int i = 0; i < PROBES; ++i) {
+        unsigned cell = (mixed >> (7 * i)) & 127;
+        unsigned shift = (cell & 1) * 4;
+        unsigned count = (block[cell / 2] >> shift) & 15;
+        if (count > 0 && count < 15) block[cell / 2] -= (unsigned char)(1 << shift);
+    }
+    if (entries_ > 0) --entries_;
+}
+
+inline bool CountingBloomFilter::mightContain(uint64_t hash) const
+{
+    uint64_t mixed = mixHash(hash);
+    const unsigned char* block = blockFor(mixed);
+    for (int i = 0; i < PROBES; ++i) {
+        unsigned cell = (mixed >> (7 * i)) & 127;
+        if (((block[cell / 2] >> ((cell & 1) * 4)) & 15) == 0) return false;
+    }
+    return true;
+}
+
+inline void CountingBloomFilter::clear()
+{
+    memset(blocks_, 0, blockCount_ * BLOCK_BYTES);
+    entries_ = 0;
+}
+
+inline size_t CountingBloomFilter::size() const
+{
+    return entries_;
+}
+
+inline size_t CountingBloomFilter::capacity() const
+{
+    return blockCount_ * KEYS_PER_BLOCK;
+}
+
+inline bool CountingBloomFilter::overloaded() const
+{
+    return entries_ > capacity();
+}
+
+inline size_t CountingBloomFilter::bytes() const
+{
+    return storage_.size();
+}
+
+#endif
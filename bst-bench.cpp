@@ -0,0 +1,757 @@
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <cstdlib>
+#include <cmath>
+#include <thread>
+#include "bst.h"
+#include "avlbst.h"
+#include "splaybst.h"
+#include "rbbst.h"
+#include "stringavlbst.h"
+#include "tombstoneavlbst.h"
+#include "lazyavlbst.h"
+#include "hashedavlbst.h"
+#include "slab_value.h"
+#include "ordered_cache.h"
+#include "bst_export.h"
+
+using namespace std;
+
+// Benchmarks for the tree engines.
+// Usage: bst-bench [n] [ops] [walk]
+
+typedef chrono::steady_clock Clock;
+
+static double secondsSince(Clock::time_point start)
+{
+    return chrono::duration<double>(Clock::now() - start).count();
+}
+
+/**
+ * Draws ranks 0..n-1 with probability proportional to 1/(rank+1)^s.
+ */
+class ZipfGenerator
+{
+public:
+    ZipfGenerator(size_t n, double s, unsigned seed) : cdf_(n), rng_(seed), uniform_(0.0, 1.0)
+    {
+        double sum = 0.0;
+        for (size_t i = 0; i < n; ++i) {
+            sum += 1.0 / pow(i + 1.0, s);
+            cdf_[i] = sum;
+        }
+        for (size_t i = 0; i < n; ++i) cdf_[i] /= sum;
+    }
+
+    size_t next()
+    {
+        double u = uniform_(rng_);
+        return lower_bound(cdf_.begin(), cdf_.end(), u) - cdf_.begin();
+    }
+
+private:
+    vector<double> cdf_;
+    mt19937_64 rng_;
+    uniform_real_distribution<double> uniform_;
+};
+
+template <class Tree>
+void fill(Tree& tree, const vector<int>& keys)
+{
+    for (size_t i = 0; i < keys.size(); ++i) {
+        tree.insert(make_pair(keys[i], (int)i));
+    }
+}
+
+/**
+ * Times ops lookups whose ranks follow a Zipf(s) distribution over keys.
+ */
+template <class Tree>
+double zipfLookups(Tree& tree, const vector<int>& keys, const vector<size_t>& ranks)
+{
+    long long sum = 0;
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < ranks.size(); ++i) {
+        sum += tree.find(keys[ranks[i]])->second;
+    }
+    double secs = secondsSince(start);
+    if (sum == -1) cout << "";
+    return secs;
+}
+
+static void report(const string& name, size_t ops, double secs)
+{
+    ostringstream rate;
+    rate << fixed << setprecision(2) << ops / secs / 1e6;
+    cout << "  " << left << setw(24) << name << right << setw(10) << rate.str() << " Mops/s" << endl;
+}
+
+static void benchSplayVsAvl(size_t n, size_t ops)
+{
+    vector<int> keys(n);
+    for (size_t i = 0; i < n; ++i) keys[i] = (int)i * 2;
+    mt19937 rng(42);
+    shuffle(keys.begin(), keys.end(), rng);
+
+    const double skews[] = { 0.8, 0.99, 1.2 };
+    for (size_t s = 0; s < sizeof(skews) / sizeof(skews[0]); ++s) {
+        ZipfGenerator zipf(n, skews[s], 7);
+        vector<size_t> ranks(ops);
+        for (size_t i = 0; i < ops; ++i) ranks[i] = zipf.next();
+
+        cout << "Zipf lookups, s = " << skews[s] << ", n = " << n << endl;
+        {
+            AVLTree<int, int> avl;
+            fill(avl, keys);
+            report("AVLTree", ops, zipfLookups(avl, keys, ranks));
+        }
+        const unsigned periods[] = { 1, 4, 16 };
+        for (size_t p = 0; p < sizeof(periods) / sizeof(periods[0]); ++p) {
+            SplayTree<int, int> splay(periods[p]);
+            fill(splay, keys);
+            report("SplayTree (period " + to_string(periods[p]) + ")", ops,
+                   zipfLookups(splay, keys, ranks));
+        }
+    }
+}
+
+/**
+ * Delete-heavy churn: each op removes a random present key and inserts a
+ * random absent one, so the tree size stays at n.
+ */
+template <class Tree>
+void churn(const string& name, size_t n, size_t ops)
+{
+    Tree tree;
+    vector<int> keys(2 * n);
+    for (size_t i = 0; i < keys.size(); ++i) keys[i] = (int)i;
+    mt19937 rng(11);
+    shuffle(keys.begin(), keys.end(), rng);
+    for (size_t i = 0; i < n; ++i) tree.insert(make_pair(keys[i], 0));
+#ifdef BST_STATS
+    tree.resetCounters();
+#endif
+
+    // keys[0, n) are present, keys[n, 2n) are absent
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < ops; ++i) {
+        size_t out = rng() % n;
+        size_t in = n + rng() % n;
+        tree.remove(keys[out]);
+        tree.insert(make_pair(keys[in], (int)i));
+        swap(keys[out], keys[in]);
+    }
+    report(name, 2 * ops, secondsSince(start));
+#ifdef BST_STATS
+    cout << "    rotations/update: " << (double)tree.counters().rotations / (2 * ops) << endl;
+#endif
+}
+
+static void benchRedBlackVsAvl(size_t n, size_t ops)
+{
+    cout << "Remove/insert churn, n = " << n << endl;
+    churn<AVLTree<int, int> >("AVLTree", n, ops);
+    churn<RedBlackTree<int, int> >("RedBlackTree", n, ops);
+#ifndef BST_STATS
+    cout << "  (build with DEFS=-DBST_STATS for rotation counts)" << endl;
+#endif
+}
+
+/**
+ * A sorted batch of count ops on keys drawn from [0, range): two thirds
+ * upserts, one third removes.
+ */
+static vector<BatchOp<int, int> > makeBatch(size_t count, size_t range, mt19937& rng)
+{
+    vector<BatchOp<int, int> > ops;
+    for (size_t i = 0; i < count; ++i) {
+        int key = (int)(rng() % range);
+        if (rng() % 3 == 0) ops.push_back(BatchOp<int, int>::remove(key));
+        else ops.push_back(BatchOp<int, int>::upsert(key, (int)i));
+    }
+    stable_sort(ops.begin(), ops.end(),
+                [](const BatchOp<int, int>& a, const BatchOp<int, int>& b) { return a.key < b.key; });
+    return ops;
+}
+
+static void benchBatch(size_t n, size_t batch)
+{
+    mt19937 rng(3);
+    vector<BatchOp<int, int> > initial;
+    for (size_t i = 0; i < n; ++i) initial.push_back(BatchOp<int, int>::upsert((int)(2 * i), (int)i));
+
+    cout << "Sorted batches on AVLTree, n = " << n << endl;
+    const size_t sizes[] = { batch, n };
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+        vector<BatchOp<int, int> > ops = makeBatch(sizes[s], 2 * n, rng);
+        {
+            AVLTree<int, int> tree;
+            tree.applyBatch(initial);
+            Clock::time_point start = Clock::now();
+            for (size_t i = 0; i < ops.size(); ++i) {
+                if (ops[i].kind == BATCH_UPSERT) tree.insert(make_pair(ops[i].key, ops[i].value));
+                else tree.remove(ops[i].key);
+            }
+            report("one at a time, m = " + to_string(ops.size()), ops.size(), secondsSince(start));
+        }
+        const unsigned threads[] = { 1, 4 };
+        for (size_t t = 0; t < sizeof(threads) / sizeof(threads[0]); ++t) {
+            AVLTree<int, int> tree;
+            tree.applyBatch(initial);
+            Clock::time_point start = Clock::now();
+            tree.applyBatch(ops, threads[t]);
+            report("applyBatch, " + to_string(threads[t]) + " threads", ops.size(), secondsSince(start));
+        }
+    }
+}
+
+/**
+ * parallel_reduce over a tree of n entries, built in O(n) with a batch.
+ */
+static void benchParallelWalk(size_t n)
+{
+    AVLTree<int, long long> tree;
+    {
+        vector<BatchOp<int, long long> > ops;
+        ops.reserve(n);
+        for (size_t i = 0; i < n; ++i) ops.push_back(BatchOp<int, long long>::upsert((int)i, (long long)i));
+        tree.applyBatch(ops);
+    }
+
+    cout << "parallel_reduce (sum of values), n = " << n
+         << ", hardware threads = " << thread::hardware_concurrency() << endl;
+    const unsigned threads[] = { 1, 2, 4, 8, 16, 32 };
+    for (size_t t = 0; t < sizeof(threads) / sizeof(threads[0]); ++t) {
+        Clock::time_point start = Clock::now();
+        long long sum = tree.parallel_reduce(0LL,
+            [](const pair<const int, long long>& item) { return item.second; },
+            [](long long a, long long b) { return a + b; },
+            threads[t]);
+        double secs = secondsSince(start);
+        if (sum != (long long)n * ((long long)n - 1) / 2) cout << "  wrong sum!" << endl;
+        report(to_string(threads[t]) + " threads", n, secs);
+    }
+}
+
+/**
+ * buildFrom on n shuffled pairs (with about 1% repeated keys), against
+ * inserting the first small of them one at a time.
+ */
+static void benchBuildFrom(size_t n, size_t small)
+{
+    mt19937 rng(4);
+    vector<pair<int, int> > items;
+    items.reserve(n);
+    for (size_t i = 0; i < n; ++i) items.push_back(make_pair((int)(rng() % (n + n / 100)), (int)i));
+
+    cout << "buildFrom on unsorted input, n = " << n << endl;
+    const unsigned threads[] = { 1, 2, 4, 8 };
+    for (size_t t = 0; t < sizeof(threads) / sizeof(threads[0]); ++t) {
+        AVLTree<int, int> tree;
+        Clock::time_point start = Clock::now();
+        tree.buildFrom(items.begin(), items.end(), threads[t]);
+        report(to_string(threads[t]) + " threads", n, secondsSince(start));
+    }
+    {
+        AVLTree<int, int> tree;
+        Clock::time_point start = Clock::now();
+        for (size_t i = 0; i < small; ++i) tree.insert(items[i]);
+        report("insert loop, n = " + to_string(small), small, secondsSince(start));
+    }
+    {
+        AVLTree<int, int> tree;
+        Clock::time_point start = Clock::now();
+        tree.buildFrom(items.begin(), items.begin() + small, 1);
+        report("buildFrom, n = " + to_string(small), small, secondsSince(start));
+    }
+}
+
+/**
+ * Duplicating an AVLTree of n: re-inserting every item against the
+ * structural clone, sequential and parallel, and a move.
+ */
+static void benchClone(size_t n)
+{
+    vector<pair<int, int> > items;
+    items.reserve(n);
+    for (size_t i = 0; i < n; ++i) items.push_back(make_pair((int)i, (int)i));
+    AVLTree<int, int> source;
+    source.buildFrom(items.begin(), items.end(), 1);
+
+    cout << "Copying an AVLTree, n = " << n << endl;
+    {
+        Clock::time_point start = Clock::now();
+        AVLTree<int, int> copy;
+        for (AVLTree<int, int>::iterator it = source.begin(); it != source.end(); ++it) copy.insert(*it);
+        report("insert loop", n, secondsSince(start));
+    }
+    {
+        Clock::time_point start = Clock::now();
+        AVLTree<int, int> copy(source);
+        report("copy constructor", n, secondsSince(start));
+    }
+    const unsigned threads[] = { 2, 4, 8 };
+    for (size_t t = 0; t < sizeof(threads) / sizeof(threads[0]); ++t) {
+        AVLTree<int, int> copy;
+        Clock::time_point start = Clock::now();
+        copy.copyFrom(source, threads[t]);
+        report("copyFrom, " + to_string(threads[t]) + " threads", n, secondsSince(start));
+    }
+    {
+        Clock::time_point start = Clock::now();
+        AVLTree<int, int> moved(std::move(source));
+        report("move constructor", n, secondsSince(start));
+    }
+}
+
+/**
+ * Erasing a run of k neighbouring keys from an AVLTree of n: remove() per
+ * key against one eraseRange().
+ */
+static void benchEraseRange(size_t n, size_t k)
+{
+    vector<BatchOp<int, int> > initial;
+    for (size_t i = 0; i < n; ++i) initial.push_back(BatchOp<int, int>::upsert((int)i, (int)i));
+    int lo = (int)((n - k) / 2);
+    int hi = lo + (int)k;
+
+    cout << "Erasing " << k << " neighbouring keys from AVLTree, n = " << n << endl;
+    {
+        AVLTree<int, int> tree;
+        tree.applyBatch(initial);
+        Clock::time_point start = Clock::now();
+        for (int key = lo; key < hi; ++key) tree.remove(key);
+        report("remove per key", k, secondsSince(start));
+    }
+    {
+        AVLTree<int, int> tree;
+        tree.applyBatch(initial);
+        Clock::time_point start = Clock::now();
+        tree.eraseRange(lo, hi);
+        report("eraseRange", k, secondsSince(start));
+    }
+}
+
+/**
+ * Merge-join style lookups on an AVLTree of n even keys: ascending probes
+ * a given stride apart, half of them missing, from the root with find()
+ * against a Cursor that starts each one where the last ended.
+ */
+static void benchFingerSearch(size_t n)
+{
+    vector<pair<int, int> > items;
+    items.reserve(n);
+    for (size_t i = 0; i < n; ++i) items.push_back(make_pair((int)(2 * i), (int)i));
+    AVLTree<int, int> tree;
+    tree.buildFrom(items.begin(), items.end(), 1);
+
+    cout << "Ascending lookups on AVLTree, n = " << n << endl;
+    const int strides[] = { 1, 64 };
+    for (size_t s = 0; s < sizeof(strides) / sizeof(strides[0]); ++s) {
+        int stride = strides[s];
+        size_t probes = 0;
+        long long sum = 0;
+        Clock::time_point start = Clock::now();
+        for (int key = 0; key < (int)(2 * n); key += stride, ++probes) {
+            AVLTree<int, int>::iterator it = tree.find(key);
+            if (it != tree.end()) sum += it->second;
+        }
+        report("find, stride " + to_string(stride), probes, secondsSince(start));
+        AVLTree<int, int>::Cursor cursor(tree);
+        start = Clock::now();
+        for (int key = 0; key < (int)(2 * n); key += stride) {
+            AVLTree<int, int>::iterator it = cursor.find(key);
+            if (it != tree.end()) sum -= it->second;
+        }
+        report("Cursor::find, stride " + to_string(stride), probes, secondsSince(start));
+        if (sum != 0) cout << "mismatch" << endl;
+    }
+}
+
+/**
+ * Inserts and lookups of n URL-like keys sharing long prefixes:
+ * AVLTree<std::string> against StringAVLTree, with the bytes each one
+ * spends per key (node plus key heap buffer, before malloc overhead).
+ */
+static void benchStringKeys(size_t n)
+{
+    mt19937 rng(9);
+    vector<string> keys;
+    for (size_t i = 0; i < n; ++i) {
+        ostringstream url;
+        url << "https://shop.example.com/catalog/" << (rng() % 2 ? "electronics" : "garden")
+            << "/item/" << (rng() % 1000000);
+        keys.push_back(url.str());
+    }
+    vector<string> probes(keys);
+    shuffle(probes.begin(), probes.end(), rng);
+
+    cout << "URL keys, n = " << n << endl;
+    {
+        AVLTree<string, int> tree;
+        Clock::time_point start = Clock::now();
+        for (size_t i = 0; i < n; ++i) tree.insert(make_pair(keys[i], (int)i));
+        report("std::string, insert", n, secondsSince(start));
+        long long sum = 0;
+        start = Clock::now();
+        for (size_t i = 0; i < n; ++i) sum += tree.find(probes[i])->second;
+        report("std::string, find", n, secondsSince(start));
+        size_t bytes = 0, count = 0;
+        for (AVLTree<string, int>::iterator it = tree.begin(); it != tree.end(); ++it, ++count) {
+            bytes += sizeof(AVLNode<string, int>);
+            if (it->first.capacity() > 15) bytes += it->first.capacity() + 1;
+        }
+        cout << "  std::string, bytes/key " << setw(12) << bytes / count << endl;
+        if (sum == 42) cout << endl;
+    }
+    {
+        StringAVLTree<int> tree;
+        Clock::time_point start = Clock::now();
+        for (size_t i = 0; i < n; ++i) tree.insert(make_pair(PrefixString(keys[i]), (int)i));
+        report("PrefixString, insert", n, secondsSince(start));
+        vector<PrefixString> prefixProbes(probes.begin(), probes.end());
+        long long sum = 0;
+        start = Clock::now();
+        for (size_t i = 0; i < n; ++i) sum += tree.find(prefixProbes[i])->second;
+        report("PrefixString, find", n, secondsSince(start));
+        size_t bytes = 0, count = 0;
+        for (StringAVLTree<int>::iterator it = tree.begin(); it != tree.end(); ++it, ++count) {
+            bytes += sizeof(AVLNode<PrefixString, int>) + it->first.heapBytes();
+        }
+        cout << "  PrefixString, bytes/key" << setw(12) << bytes / count << endl;
+        if (sum == 42) cout << endl;
+    }
+}
+
+/**
+ * Lookups on an AVLTree of n even keys where 70% of the probes are odd
+ * (absent), with and without the key filter.
+ */
+static void benchFilter(size_t n)
+{
+    mt19937 rng(12);
+    vector<pair<int, int> > items;
+    items.reserve(n);
+    for (size_t i = 0; i < n; ++i) items.push_back(make_pair((int)(2 * i), (int)i));
+    vector<int> probes;
+    for (size_t i = 0; i < n; ++i) probes.push_back((int)(2 * (rng() % n) + (rng() % 10 < 7 ? 1 : 0)));
+    AVLTree<int, int> tree;
+    tree.buildFrom(items.begin(), items.end(), 1);
+
+    cout << "Lookups, 70% misses, AVLTree, n = " << n << endl;
+    for (int pass = 0; pass < 2; ++pass) {
+        if (pass == 1) tree.enableFilter();
+        size_t hits = 0;
+        Clock::time_point start = Clock::now();
+        for (size_t i = 0; i < probes.size(); ++i) hits += (tree.find(probes[i]) != tree.end());
+        report(pass == 0 ? "find" : "find, filtered", probes.size(), secondsSince(start));
+        if (hits == 42) cout << endl;
+    }
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < n; ++i) tree.insert(make_pair((int)(2 * (n + i)), 0));
+    report("insert, filtered", n, secondsSince(start));
+}
+
+/**
+ * Remove/reinsert churn on a tree of n keys: each step removes a random
+ * key and reinserts the one removed 16 steps earlier.
+ */
+template <class Tree>
+static void churn(const string& name, const vector<int>& keys, size_t ops)
+{
+    Tree tree;
+    fill(tree, keys);
+    mt19937 rng(13);
+    vector<int> removed(16, -1);
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < ops; ++i) {
+        int key = keys[rng() % keys.size()];
+        tree.remove(key);
+        int& back = removed[i % removed.size()];
+        if (back >= 0) tree.insert(make_pair(back, (int)i));
+        back = key;
+    }
+    report(name, ops, secondsSince(start));
+}
+
+static void benchTombstones(size_t n, size_t ops)
+{
+    vector<int> keys(n);
+    for (size_t i = 0; i < n; ++i) keys[i] = (int)i;
+    shuffle(keys.begin(), keys.end(), mt19937(14));
+    cout << "Remove/reinsert churn, n = " << n << endl;
+    churn<AVLTree<int, int> >("AVLTree", keys, ops);
+    churn<TombstoneAVLTree<int, int> >("TombstoneAVLTree", keys, ops);
+}
+
+/**
+ * Adding a delta to every value in random windows of k of n keys:
+ * operator[] on each key of an AVLTree against one updateRange() on a
+ * LazyAVLTree.
+ */
+static void benchRangeUpdates(size_t n, size_t k, size_t updates)
+{
+    AVLTree<int, long long> plain;
+    LazyAVLTree<int, long long> lazy;
+    for (size_t i = 0; i < n; ++i) {
+        plain.insert(make_pair((int)i, 0LL));
+        lazy.insert(make_pair((int)i, 0LL));
+    }
+    mt19937 rng(15);
+    vector<int> starts(updates);
+    for (size_t i = 0; i < updates; ++i) starts[i] = (int)(rng() % (n - k));
+
+    // rates are of values updated
+    cout << "Range updates of " << k << " keys, n = " << n << endl;
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < updates; ++i) {
+        for (int key = starts[i]; key < starts[i] + (int)k; ++key) plain[key] += 1;
+    }
+    report("AVLTree operator[]", updates * k, secondsSince(start));
+    start = Clock::now();
+    for (size_t i = 0; i < updates; ++i) lazy.updateRange(starts[i], starts[i] + (int)k, AddUpdate<long long>(1));
+    report("LazyAVLTree", updates * k, secondsSince(start));
+    if (lazy[(int)(n / 2)] != plain[(int)(n / 2)]) cout << "  mismatch!" << endl;
+}
+
+/**
+ * Random hits and misses on n keys, walking the tree against probing the
+ * hash index beside it, then the index's cost on insert and remove.
+ */
+static void benchHashIndex(size_t n)
+{
+    vector<int> keys(n);
+    for (size_t i = 0; i < n; ++i) keys[i] = (int)(2 * i);
+    shuffle(keys.begin(), keys.end(), mt19937(16));
+    mt19937 rng(17);
+    vector<int> probes(n);
+    for (size_t i = 0; i < n; ++i) probes[i] = (int)(rng() % (2 * n));
+
+    cout << "Point lookups, half misses, n = " << n << endl;
+    AVLTree<int, int> plain;
+    HashedAVLTree<int, int> hashed;
+    Clock::time_point start = Clock::now();
+    fill(plain, keys);
+    report("AVLTree insert", n, secondsSince(start));
+    start = Clock::now();
+    fill(hashed, keys);
+    report("HashedAVLTree insert", n, secondsSince(start));
+    size_t hits = 0;
+    start = Clock::now();
+    for (size_t i = 0; i < n; ++i) hits += (plain.find(probes[i]) != plain.end());
+    report("AVLTree find", n, secondsSince(start));
+    start = Clock::now();
+    for (size_t i = 0; i < n; ++i) hits -= (hashed.find(probes[i]) != hashed.end());
+    report("HashedAVLTree find", n, secondsSince(start));
+    if (hits != 0) cout << "  mismatch!" << endl;
+    start = Clock::now();
+    for (size_t i = 0; i < n; ++i) plain.remove(keys[i]);
+    report("AVLTree remove", n, secondsSince(start));
+    start = Clock::now();
+    for (size_t i = 0; i < n; ++i) hashed.remove(keys[i]);
+    report("HashedAVLTree remove", n, secondsSince(start));
+}
+
+// A 200-byte value, the size that makes inline storage hurt
+struct Payload
+{
+    int id;
+    char bytes[196];
+};
+
+static ostream& operator<<(ostream& os, const Payload& payload)
+{
+    return os << payload.id;
+}
+
+/**
+ * Random lookups on an AVLTree of n keys with 200-byte values, stored in
+ * the nodes against out of line in a ValueSlab.
+ */
+template <class V>
+static void benchValueStorage(const string& name, size_t n)
+{
+    mt19937 rng(10);
+    vector<pair<int, V> > items;
+    items.reserve(n);
+    for (size_t i = 0; i < n; ++i) {
+        Payload payload;
+        payload.id = (int)i;
+        items.push_back(make_pair((int)(2 * i), V(payload)));
+    }
+    AVLTree<int, V> tree;
+    tree.buildFrom(items.begin(), items.end(), 1);
+    items.clear();
+    vector<int> probes;
+    for (size_t i = 0; i < n; ++i) probes.push_back((int)(2 * (rng() % n)));
+
+    long long sum = 0;
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < probes.size(); ++i) {
+        const Payload& payload = tree.find(probes[i])->second;
+        sum += payload.id;
+    }
+    report(name + ", find", probes.size(), secondsSince(start));
+    cout << "  " << left << setw(24) << (name + ", node bytes") << right << setw(10)
+         << sizeof(AVLNode<int, V>) << endl;
+    if (sum == 42) cout << endl;
+}
+
+static void benchSlabValues(size_t n)
+{
+    cout << "200-byte values, n = " << n << endl;
+    benchValueStorage<Payload>("inline", n);
+    benchValueStorage<SlabValue<Payload> >("SlabValue", n);
+}
+
+/**
+ * Scans and lookups on an AVLTree of about n nodes whose nodes were
+ * allocated in random key order by many small batches, then again after
+ * compact() into each layout.
+ */
+static void benchCompact(size_t n)
+{
+    mt19937 rng(6);
+    AVLTree<int, int> tree;
+    for (size_t done = 0; done < 2 * n; done += n / 50) {
+        tree.applyBatch(makeBatch(n / 50, 2 * n, rng));
+    }
+    vector<int> probes;
+    for (size_t i = 0; i < n; ++i) probes.push_back((int)(rng() % (2 * n)));
+
+    cout << "Scans and lookups before and after compact(), n = " << n << endl;
+    const char* names[] = { "scattered", "in-order", "vEB" };
+    for (int pass = 0; pass < 3; ++pass) {
+        if (pass == 1) tree.compact(LAYOUT_IN_ORDER);
+        if (pass == 2) tree.compact(LAYOUT_VEB);
+        size_t items = 0;
+        long long sum = 0;
+        Clock::time_point start = Clock::now();
+        for (AVLTree<int, int>::iterator it = tree.begin(); it != tree.end(); ++it) {
+            sum += it->second;
+            ++items;
+        }
+        report(string(names[pass]) + ", scan", items, secondsSince(start));
+        start = Clock::now();
+        for (size_t i = 0; i < probes.size(); ++i) {
+            if (tree.find(probes[i]) != tree.end()) ++sum;
+        }
+        report(string(names[pass]) + ", find", probes.size(), secondsSince(start));
+        if (sum == 42) cout << endl;
+    }
+}
+
+/**
+ * OrderedCache under steady-state churn: a full cache of capacity entries
+ * gets ops operations on keys drawn from twice that many, three finds to
+ * each insert, so about half of the finds miss and most inserts evict.
+ */
+static void benchCache(size_t capacity, size_t ops)
+{
+    cout << "OrderedCache churn, capacity = " << capacity << endl;
+    const EvictionPolicy policies[] = { EVICT_LRU, EVICT_FIFO, EVICT_LRU };
+    const char* names[] = { "LRU", "FIFO", "LRU + TTL" };
+    for (int c = 0; c < 3; ++c) {
+        // a TTL long enough that entries are evicted as often as they expire
+        OrderedCache<int, int>::Duration ttl = (c == 2) ? chrono::microseconds(50 * capacity)
+                                                        : OrderedCache<int, int>::Duration::max();
+        OrderedCache<int, int> cache(capacity, 0, policies[c], ttl);
+        mt19937 rng(7);
+        for (size_t i = 0; i < capacity; ++i) cache.insert((int)i, (int)i);
+        Clock::time_point start = Clock::now();
+        for (size_t i = 0; i < ops; ++i) {
+            int key = (int)(rng() % (2 * capacity));
+            if (i % 4 == 3) cache.insert(key, (int)i);
+            else cache.find(key);
+        }
+        double secs = secondsSince(start);
+        const CacheStats& stats = cache.stats();
+        report(names[c], ops, secs);
+        cout << "    hits " << stats.hits << ", misses " << stats.misses << ", evictions " << stats.evictions
+             << ", expirations " << stats.expirations << endl;
+    }
+}
+
+/**
+ * Discards what it is given, counting the bytes.
+ */
+class CountingBuffer : public streambuf
+{
+public:
+    CountingBuffer() : bytes(0) {}
+    size_t bytes;
+
+protected:
+    virtual int_type overflow(int_type c)
+    {
+        ++bytes;
+        return traits_type::not_eof(c);
+    }
+    virtual streamsize xsputn(const char*, streamsize n)
+    {
+        bytes += (size_t)n;
+        return n;
+    }
+};
+
+/**
+ * Each export format over an AVLTree of n nodes, written to a sink.
+ */
+static void benchExport(size_t n)
+{
+    vector<pair<int, int> > items;
+    items.reserve(n);
+    for (size_t i = 0; i < n; ++i) items.push_back(make_pair((int)i, (int)i));
+    AVLTree<int, int> tree;
+    tree.buildFrom(items.begin(), items.end());
+    vector<pair<int, int> >().swap(items);
+
+    cout << "exportTree, n = " << n << endl;
+    const char* names[] = { "DOT", "JSON", "text" };
+    for (int f = 0; f < 3; ++f) {
+        CountingBuffer sink;
+        ostream out(&sink);
+        ExportOptions options;
+        options.format = (ExportFormat)f;
+        Clock::time_point start = Clock::now();
+        size_t written = exportTree(tree, out, options);
+        double secs = secondsSince(start);
+        report(names[f], written, secs);
+        ostringstream took;
+        took << fixed << setprecision(2) << secs;
+        cout << "    " << sink.bytes / (1 << 20) << " MB in " << took.str() << " s" << endl;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    size_t n = (argc > 1) ? strtoul(argv[1], NULL, 10) : 20000;
+    size_t ops = (argc > 2) ? strtoul(argv[2], NULL, 10) : 1000000;
+    // 100000000 needs about 6.5GB
+    size_t walk = (argc > 3) ? strtoul(argv[3], NULL, 10) : 10000000;
+
+    benchSplayVsAvl(n, ops);
+    benchRedBlackVsAvl(n, ops / 10);
+    benchBatch(n, n / 20);
+    benchParallelWalk(walk);
+    benchBuildFrom(walk, n);
+    benchEraseRange(n, n / 4);
+    benchCompact(walk / 10);
+    benchClone(walk / 10);
+    benchFingerSearch(walk / 10);
+    benchStringKeys(walk / 10);
+    benchSlabValues(walk / 20);
+    benchFilter(walk / 10);
+    benchTombstones(walk / 10, ops);
+    benchRangeUpdates(n * 10, n, ops / 100);
+    benchHashIndex(walk / 10);
+    benchCache(n / 4, ops / 10);
+    benchExport(walk);
+    return 0;
+}
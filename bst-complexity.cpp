@@ -0,0 +1,189 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include "bst.h"
+#include "avlbst.h"
+#include "complexity.h"
+
+using namespace std;
+
+// Checks the growth rate of every public tree operation (see complexity.h).
+// Run by `make check`; exits non-zero if any operation is in a worse
+// complexity class than expected.
+
+typedef chrono::steady_clock Clock;
+
+static double secondsSince(Clock::time_point start)
+{
+    return chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Keeps results alive so the timed calls are not optimized away
+static volatile size_t sink;
+
+enum InsertOrder { ORDER_RANDOM, ORDER_SORTED, ORDER_REVERSE, ORDER_ZIGZAG };
+
+static const char* orderName(InsertOrder order)
+{
+    static const char* names[] = { "random", "sorted", "reverse", "zig-zag" };
+    return names[order];
+}
+
+enum TreeOperation { OP_INSERT, OP_REMOVE, OP_FIND, OP_INDEX, OP_BEGIN, OP_INCREMENT, OP_CLEAR, OP_IS_BALANCED };
+
+static const char* operationName(TreeOperation op)
+{
+    static const char* names[] = { "insert", "remove", "find", "operator[]", "begin", "++", "clear", "isBalanced" };
+    return names[op];
+}
+
+/**
+ * The even keys 0, 2, ..., 2n - 2 in the given order (zig-zag alternates
+ * between the smallest and largest left), so the odd keys are free for
+ * timed inserts that land all over the tree.
+ */
+static vector<int> insertionKeys(size_t n, InsertOrder order, mt19937& rng)
+{
+    vector<int> keys(n);
+    for (size_t i = 0; i < n; ++i) keys[i] = (int)(2 * i);
+    switch (order) {
+    case ORDER_RANDOM:
+        shuffle(keys.begin(), keys.end(), rng);
+        break;
+    case ORDER_SORTED:
+        break;
+    case ORDER_REVERSE:
+        reverse(keys.begin(), keys.end());
+        break;
+    case ORDER_ZIGZAG:
+        for (size_t i = 0, lo = 0, hi = n - 1; i < n; ++i) {
+            keys[i] = (int)(2 * ((i % 2 == 0) ? lo++ : hi--));
+        }
+        break;
+    }
+    return keys;
+}
+
+/**
+ * Builds a tree of n keys in the given order (untimed), then times the
+ * operation. Per-call operations return the time per call, clear() and
+ * isBalanced() the time of the one call on the whole tree.
+ *
+ * Per-call operations go over the same few probe keys round after round,
+ * undoing inserts and removes untimed in between, so their paths stay in
+ * cache at every size and the time follows the path length instead of
+ * where in the memory hierarchy the tree happens to fit.
+ */
+template<class Tree>
+static double timeOperation(TreeOperation op, InsertOrder order, size_t n)
+{
+    static const size_t PROBES = 4, ROUNDS = 512, STEPS = 64;
+    mt19937 rng((unsigned)n);
+    vector<int> keys = insertionKeys(n, order, rng);
+    Tree tree;
+    for (size_t i = 0; i < n; ++i) tree.insert(make_pair(keys[i], keys[i]));
+
+    if (op == OP_CLEAR || op == OP_IS_BALANCED) {
+        Clock::time_point start = Clock::now();
+        if (op == OP_CLEAR) tree.clear();
+        else sink = tree.isBalanced();
+        return secondsSince(start);
+    }
+
+    // distinct keys from the tree
+    vector<int> probes(keys);
+    shuffle(probes.begin(), probes.end(), rng);
+    probes.resize(PROBES);
+    size_t sum = 0;
+    double seconds = 0.0;
+    size_t calls = PROBES * ROUNDS;
+
+    // round 0 only warms the cache and is not counted
+    for (size_t round = 0; round <= ROUNDS; ++round) {
+        if (round == 1) seconds = 0.0;
+        Clock::time_point start = Clock::now();
+        switch (op) {
+        case OP_INSERT:
+            for (size_t i = 0; i < PROBES; ++i) tree.insert(make_pair(probes[i] + 1, probes[i]));
+            seconds += secondsSince(start);
+            for (size_t i = 0; i < PROBES; ++i) tree.remove(probes[i] + 1);
+            break;
+        case OP_REMOVE:
+            for (size_t i = 0; i < PROBES; ++i) tree.remove(probes[i]);
+            seconds += secondsSince(start);
+            for (size_t i = 0; i < PROBES; ++i) tree.insert(make_pair(probes[i], probes[i]));
+            break;
+        case OP_FIND:
+            for (size_t i = 0; i < PROBES; ++i) sum += (tree.find(probes[i]) != tree.end());
+            seconds += secondsSince(start);
+            break;
+        case OP_INDEX:
+            for (size_t i = 0; i < PROBES; ++i) sum += tree[probes[i]];
+            seconds += secondsSince(start);
+            break;
+        case OP_BEGIN:
+            for (size_t i = 0; i < PROBES; ++i) sum += tree.begin()->first;
+            seconds += secondsSince(start);
+            break;
+        case OP_INCREMENT: {
+            // from the smallest key, over a window far longer than the height
+            typename Tree::iterator it = tree.find(0);
+            start = Clock::now();
+            for (size_t i = 0; i < STEPS; ++i) ++it;
+            seconds += secondsSince(start);
+            sum += it->first;
+            calls = STEPS * ROUNDS;
+            break;
+        }
+        default:
+            break;
+        }
+    }
+    sink = sum;
+    return seconds / calls;
+}
+
+/**
+ * Each operation on each insertion order. Without balancing, every order
+ * but the random one leaves the tree a linked list, so there the per-call
+ * operations are expected to be O(n) (and are measured at smaller sizes,
+ * since building such a tree is quadratic).
+ */
+template<class Tree>
+static void checkTree(ComplexityGate& gate, const string& treeName, bool balanced)
+{
+    static const TreeOperation ops[] = {
+        OP_INSERT, OP_REMOVE, OP_FIND, OP_INDEX, OP_BEGIN, OP_INCREMENT, OP_CLEAR, OP_IS_BALANCED
+    };
+    static const InsertOrder orders[] = { ORDER_RANDOM, ORDER_SORTED, ORDER_REVERSE, ORDER_ZIGZAG };
+    for (size_t o = 0; o < sizeof(orders) / sizeof(orders[0]); ++o) {
+        InsertOrder order = orders[o];
+        bool degenerate = !balanced && order != ORDER_RANDOM;
+        for (size_t i = 0; i < sizeof(ops) / sizeof(ops[0]); ++i) {
+            TreeOperation op = ops[i];
+            Complexity expected;
+            if (op == OP_CLEAR || op == OP_IS_BALANCED) {
+                expected = COMPLEXITY_LINEAR;
+            } else if (op == OP_INCREMENT) {
+                expected = COMPLEXITY_CONSTANT;  // amortized
+            } else {
+                expected = degenerate ? COMPLEXITY_LINEAR : COMPLEXITY_LOGARITHMIC;
+            }
+            string name = treeName + " " + operationName(op) + " (" + orderName(order) + ")";
+            gate.check(name, expected, degenerate ? 7 : 10, degenerate ? 11 : 16,
+                       [op, order](size_t n) { return timeOperation<Tree>(op, order, n); });
+        }
+    }
+}
+
+int main()
+{
+    ComplexityGate gate(cout);
+    checkTree<BinarySearchTree<int, int> >(gate, "BinarySearchTree", false);
+    checkTree<AVLTree<int, int> >(gate, "AVLTree", true);
+    cout << gate.checks() - gate.failures() << "/" << gate.checks() << " complexity checks passed" << endl;
+    return gate.failures() == 0 ? 0 : 1;
+}
@@ -0,0 +1,160 @@
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <random>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include "bst.h"
+#include "avlbst.h"
+#include "splaybst.h"
+#include "rbbst.h"
+#include "bst_record.h"
+
+using namespace std;
+
+// Replays an operation trace (see bst_record.h) against tree engines.
+// Usage: bst-replay <trace> [avl|rb|splay|bst|all]
+//        bst-replay --synthetic <ops> <trace>   writes a sample trace
+
+typedef chrono::steady_clock Clock;
+
+/**
+ * Runs every record against a fresh Tree<uint64_t, uint64_t>, timing each
+ * one. Finds and iterator steps share one cursor, the way a scan after a
+ * lookup would: a step from the end (or before any find) starts over at
+ * begin().
+ */
+template <class Tree>
+static void replay(const string& name, const vector<TraceRecord>& trace)
+{
+    LatencyHistogram hist[TRACE_OP_COUNT];
+    Tree tree;
+    typename Tree::iterator cursor = tree.end();
+    uint64_t checksum = 0;
+
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < trace.size(); ++i) {
+        const TraceRecord& r = trace[i];
+        uint64_t began = traceTicks();
+        switch (r.op) {
+        case TRACE_INSERT:
+            tree.insert(make_pair(r.key, (uint64_t)i));
+            break;
+        case TRACE_FIND:
+            cursor = tree.find(r.key);
+            if (cursor != tree.end()) checksum += cursor->second;
+            break;
+        case TRACE_REMOVE:
+            // the cursor may be on the removed node
+            cursor = tree.end();
+            tree.remove(r.key);
+            break;
+        case TRACE_ITERATE:
+            if (cursor == tree.end()) cursor = tree.begin();
+            else ++cursor;
+            if (cursor != tree.end()) checksum += cursor->second;
+            break;
+        case TRACE_CLEAR:
+            cursor = tree.end();
+            tree.clear();
+            break;
+        default:
+            break;
+        }
+        hist[r.op].record(traceTicks() - began);
+    }
+    double secs = chrono::duration<double>(Clock::now() - start).count();
+
+    ostringstream rate;
+    rate << fixed << setprecision(2) << trace.size() / secs / 1e6;
+    cout << name << ": " << trace.size() << " ops in " << setprecision(3) << secs << " s, "
+         << rate.str() << " Mops/s (checksum " << checksum << ")" << endl;
+    for (int op = 0; op < TRACE_OP_COUNT; ++op) {
+        vector<uint64_t> counts(LatencyHistogram::BUCKETS, 0);
+        hist[op].addTo(counts);
+        LatencySummary s = summarizeLatencies(counts);
+        if (s.count == 0) continue;
+        cout << "  " << left << setw(8) << traceOpName(static_cast<TraceOp>(op)) << right << s << endl;
+    }
+}
+
+/**
+ * A trace with some structure to it: a growing key space with sequential
+ * runs of inserts, Zipf-ish lookups, short scans and occasional removes.
+ */
+static void writeSynthetic(size_t ops, ostream& out)
+{
+    TraceWriter writer(out);
+    mt19937_64 rng(11);
+    uint64_t next = 0;
+    for (size_t i = 0; i < ops; ) {
+        uint64_t key;
+        switch (rng() % 8) {
+        case 0:
+        case 1:
+            for (int run = 0; run < 4 && i < ops; ++run, ++i) {
+                key = next++;
+                writer.write(TRACE_INSERT, &key);
+            }
+            break;
+        case 2:
+            if (next == 0) break;
+            key = rng() % next;
+            writer.write(TRACE_REMOVE, &key);
+            ++i;
+            break;
+        case 3:
+            if (next == 0) break;
+            key = rng() % next;
+            writer.write(TRACE_FIND, &key);
+            ++i;
+            for (int step = 0; step < 8 && i < ops; ++step, ++i) writer.write(TRACE_ITERATE, NULL);
+            break;
+        default:
+            if (next == 0) break;
+            // skewed towards recent keys
+            key = next - 1 - (uint64_t)(next * pow((double)(rng() % 1000000) / 1e6, 4.0));
+            writer.write(TRACE_FIND, &key);
+            ++i;
+            break;
+        }
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc == 4 && strcmp(argv[1], "--synthetic") == 0) {
+        ofstream out(argv[3], ios::binary);
+        writeSynthetic(strtoul(argv[2], NULL, 10), out);
+        return out ? 0 : 1;
+    }
+    if (argc < 2) {
+        cerr << "usage: " << argv[0] << " <trace> [avl|rb|splay|bst|all]" << endl
+             << "       " << argv[0] << " --synthetic <ops> <trace>" << endl;
+        return 1;
+    }
+
+    ifstream in(argv[1], ios::binary);
+    TraceReader reader(in);
+    if (!reader.ok()) {
+        cerr << argv[1] << ": not a trace file" << endl;
+        return 1;
+    }
+    vector<TraceRecord> trace;
+    TraceRecord record;
+    while (reader.next(record)) trace.push_back(record);
+
+    string engine = (argc > 2) ? argv[2] : "all";
+    bool all = (engine == "all");
+    if (all || engine == "avl") replay<AVLTree<uint64_t, uint64_t> >("AVLTree", trace);
+    if (all || engine == "rb") replay<RedBlackTree<uint64_t, uint64_t> >("RedBlackTree", trace);
+    if (all || engine == "splay") replay<SplayTree<uint64_t, uint64_t> >("SplayTree", trace);
+    // unbalanced, so only on request
+    if (engine == "bst") replay<BinarySearchTree<uint64_t, uint64_t> >("BinarySearchTree", trace);
+    return 0;
+}
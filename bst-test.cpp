@@ -1,7 +1,19 @@
 #include <iostream>
 #include <map>
+#include <string>
+#include <vector>
 #include "bst.h"
 #include "avlbst.h"
+#include "splaybst.h"
+#include "rbbst.h"
+#include "avlmultibst.h"
+#include "ordered_cache.h"
+#include "bst_export.h"
+#include "stringavlbst.h"
+#include "slab_value.h"
+#include "tombstoneavlbst.h"
+#include "lazyavlbst.h"
+#include "hashedavlbst.h"
 
 using namespace std;
 
@@ -44,5 +56,335 @@ int main(int argc, char *argv[])
     cout << "Erasing b" << endl;
     at.remove('b');
 
+    cout << "\nAVLTree shape:" << endl;
+    cout << at.stats();
+
+    // Splay Tree Tests
+    SplayTree<char,int> st;
+    st.insert(std::make_pair('a',1));
+    st.insert(std::make_pair('b',2));
+
+    cout << "\nSplayTree contents:" << endl;
+    for(SplayTree<char,int>::iterator it = st.begin(); it != st.end(); ++it) {
+        cout << it->first << " " << it->second << endl;
+    }
+    if(st.find('a') != st.end()) {
+        cout << "Found a" << endl;
+    }
+    else {
+        cout << "Did not find a" << endl;
+    }
+    cout << "Erasing b" << endl;
+    st.remove('b');
+
+    // Red-Black Tree Tests
+    RedBlackTree<char,int> rt;
+    rt.insert(std::make_pair('a',1));
+    rt.insert(std::make_pair('b',2));
+
+    cout << "\nRedBlackTree contents:" << endl;
+    for(RedBlackTree<char,int>::iterator it = rt.begin(); it != rt.end(); ++it) {
+        cout << it->first << " " << it->second << endl;
+    }
+    if(rt.find('b') != rt.end()) {
+        cout << "Found b" << endl;
+    }
+    else {
+        cout << "Did not find b" << endl;
+    }
+    cout << "Erasing b" << endl;
+    rt.remove('b');
+
+    // Comparator Tests
+    AVLTree<std::string,int,TransparentLess> ct;
+    ct.insert(std::make_pair(std::string("apple"),1));
+    ct.insert(std::make_pair(std::string("banana"),2));
+    ct.insert(std::make_pair(std::string("cherry"),3));
+
+    cout << "\nAVLTree<string> lookups without temporaries:" << endl;
+    if(ct.find("banana") != ct.end()) {
+        cout << "Found banana" << endl;
+    }
+    else {
+        cout << "Did not find banana" << endl;
+    }
+    cout << "lower_bound(\"b\"): " << ct.lower_bound("b")->first << endl;
+    cout << "upper_bound(\"banana\"): " << ct.upper_bound("banana")->first << endl;
+
+    // AVL Multimap Tests
+    AVLMultiTree<char,int> mt;
+    mt.insert(std::make_pair('a',1));
+    mt.insert(std::make_pair('b',2));
+    mt.insert(std::make_pair('a',3));
+
+    cout << "\nAVLMultiTree contents:" << endl;
+    for(AVLMultiTree<char,int>::iterator it = mt.begin(); it != mt.end(); ++it) {
+        cout << it->first << " " << it->second << endl;
+    }
+    cout << "count(a): " << mt.count('a') << endl;
+    cout << "Erasing all a: " << mt.remove_all('a') << endl;
+
+    std::multimap<char,int> reference;
+    reference.insert(std::make_pair('b',2));
+    std::vector<BatchOp<char,int> > batch;
+    batch.push_back(BatchOp<char,int>::upsert('b',5));
+    bool rejected = false;
+    try {
+        static_cast<AVLTree<char,int>&>(mt).applyBatch(batch);
+    }
+    catch(const std::logic_error&) {
+        rejected = true;
+    }
+    bool same = true;
+    AVLMultiTree<char,int>::iterator mit = mt.begin();
+    for(std::multimap<char,int>::iterator rit = reference.begin(); rit != reference.end(); ++rit, ++mit) {
+        same = same && mit != mt.end() && *mit == *rit;
+    }
+    same = same && mit == mt.end();
+    cout << "applyBatch rejected: " << (rejected ? "yes" : "no") << ", matches std::multimap: "
+         << (same ? "yes" : "no") << endl;
+
+    std::vector<std::pair<char,int> > repeated;
+    repeated.push_back(std::make_pair('c',1));
+    repeated.push_back(std::make_pair('a',2));
+    repeated.push_back(std::make_pair('c',3));
+    repeated.push_back(std::make_pair('a',4));
+    repeated.push_back(std::make_pair('b',5));
+    reference = std::multimap<char,int>(repeated.begin(), repeated.end());
+    mt.buildFrom(repeated.begin(), repeated.end(), 2);
+    same = true;
+    mit = mt.begin();
+    for(std::multimap<char,int>::iterator rit = reference.begin(); rit != reference.end(); ++rit, ++mit) {
+        same = same && mit != mt.end() && *mit == *rit;
+    }
+    same = same && mit == mt.end();
+    cout << "buildFrom kept " << mt.count('c') << " c, matches std::multimap: " << (same ? "yes" : "no") << endl;
+
+    // Bulk Build Tests
+    std::vector<std::pair<char,int> > unsorted;
+    unsorted.push_back(std::make_pair('c',1));
+    unsorted.push_back(std::make_pair('a',2));
+    unsorted.push_back(std::make_pair('c',3));
+    unsorted.push_back(std::make_pair('b',4));
+    AVLTree<char,int> ut;
+    ut.buildFrom(unsorted.begin(), unsorted.end(), 2);
+
+    cout << "\nAVLTree built from unsorted input:" << endl;
+    for(AVLTree<char,int>::iterator it = ut.begin(); it != ut.end(); ++it) {
+        cout << it->first << " " << it->second << endl;
+    }
+    cout << "Balanced: " << (ut.isBalanced() ? "yes" : "no") << endl;
+
+    // Erase Tests
+    AVLTree<int,int> et;
+    for(int i = 0; i < 10; ++i) {
+        et.insert(std::make_pair(i, i * i));
+    }
+    AVLTree<int,int>::iterator next = et.erase(et.find(3));
+    cout << "\nErased 3, next is " << next->first << endl;
+    cout << "eraseRange(5, 8): " << et.eraseRange(5, 8) << endl;
+    et.erase(et.begin(), et.find(2));
+    cout << "AVLTree after erasing:" << endl;
+    for(AVLTree<int,int>::iterator it = et.begin(); it != et.end(); ++it) {
+        cout << it->first << " " << it->second << endl;
+    }
+    cout << "Balanced: " << (et.isBalanced() ? "yes" : "no") << endl;
+
+    // Compaction Tests
+    et.insert(std::make_pair(6, 36));
+    et.compact(LAYOUT_VEB);
+    et.beginCompact();
+    while(!et.compactStep(2)) {
+        et.insert(std::make_pair(1, 1));
+    }
+    cout << "\nAVLTree after compacting:" << endl;
+    for(AVLTree<int,int>::iterator it = et.begin(); it != et.end(); ++it) {
+        cout << it->first << " " << it->second << endl;
+    }
+    cout << "Valid: " << (et.validate().ok() ? "yes" : "no") << endl;
+
+    // Ordered Cache Tests
+    OrderedCache<std::string,int> cache(2);
+    cache.insert("a", 1);
+    cache.insert("b", 2);
+    cache.find("a");
+    cache.insert("c", 3);
+
+    cout << "\nOrderedCache after evicting the least recently used:" << endl;
+    for(OrderedCache<std::string,int>::iterator it = cache.begin(); it != cache.end(); ++it) {
+        cout << it->first << " " << it->second.value << endl;
+    }
+
+    // Export Tests
+    ExportOptions options;
+    options.format = EXPORT_JSON;
+    options.maxDepth = 1;
+    cout << "\nAVLTree exported as JSON, depth <= 1:" << endl;
+    exportTree(et, cout, options);
+
+    // Copy and Move Tests
+    AVLTree<int,int> copied(et);
+    copied.remove(1);
+    AVLTree<int,int> moved(std::move(copied));
+    moved.swap(copied);
+    cout << "\nAVLTree copy after removing 1, moved and swapped back:" << endl;
+    for(AVLTree<int,int>::iterator it = copied.begin(); it != copied.end(); ++it) {
+        cout << it->first << " " << it->second << endl;
+    }
+    cout << "Original still has 1: " << (et.find(1) != et.end() ? "yes" : "no") << endl;
+
+    // Finger Search Tests
+    AVLTree<int,int>::Cursor cursor(et);
+    cout << "\nAVLTree lookups through a cursor:" << endl;
+    for(int key = 3; key <= 9; key += 3) {
+        AVLTree<int,int>::iterator it = cursor.lower_bound(key);
+        cout << key << " -> " << (it != et.end() ? it->first : -1) << endl;
+    }
+    cout << "find_from(end(), 9): " << (et.find_from(et.end(), 9) != et.end() ? "found" : "missing") << endl;
+
+    // String Key Tests
+    StringAVLTree<int> urls;
+    urls.insert(std::make_pair(PrefixString("https://example.com/docs/guide"), 1));
+    urls.insert(std::make_pair(PrefixString("https://example.com/docs"), 2));
+    urls.insert(std::make_pair(PrefixString("https://example.com/blog/2024/hello-world"), 3));
+    urls.remove("https://example.com/docs");
+    cout << "\nStringAVLTree contents:" << endl;
+    for(StringAVLTree<int>::iterator it = urls.begin(); it != urls.end(); ++it) {
+        cout << it->first << " " << it->second << endl;
+    }
+    cout << "Found guide: " << (urls.find("https://example.com/docs/guide") != urls.end() ? "yes" : "no") << endl;
+
+    // Out-of-line Value Tests
+    AVLTree<int,SlabValue<std::string> > slabbed;
+    slabbed.insert(std::make_pair(2, std::string("two")));
+    slabbed.insert(std::make_pair(1, std::string("one")));
+    slabbed[2] = std::string("deux");
+    cout << "\nAVLTree with SlabValue values:" << endl;
+    for(AVLTree<int,SlabValue<std::string> >::iterator it = slabbed.begin(); it != slabbed.end(); ++it) {
+        cout << it->first << " " << it->second << " (" << it->second->size() << " chars)" << endl;
+    }
+
+    // Filter Tests
+    AVLTree<int,int> filtered;
+    filtered.enableFilter();
+    for(int key = 0; key < 100; key += 2) {
+        filtered.insert(std::make_pair(key, key * key));
+    }
+    filtered.remove(10);
+    cout << "\nAVLTree with a key filter:" << endl;
+    cout << "Found 12: " << (filtered.find(12) != filtered.end() ? "yes" : "no") << endl;
+    cout << "Found 10: " << (filtered.find(10) != filtered.end() ? "yes" : "no") << endl;
+    cout << "Found 13: " << (filtered.find(13) != filtered.end() ? "yes" : "no") << endl;
+
+    // Tombstone Tests
+    TombstoneAVLTree<int,int> lazy;
+    for(int key = 1; key <= 8; ++key) {
+        lazy.insert(std::make_pair(key, key * 10));
+    }
+    lazy.remove(3);
+    lazy.remove(6);
+    lazy.insert(std::make_pair(3, 33));
+    cout << "\nTombstoneAVLTree after removing 3 and 6 and reinserting 3:" << endl;
+    for(TombstoneAVLTree<int,int>::iterator it = lazy.begin(); it != lazy.end(); ++it) {
+        cout << it->first << " " << it->second << endl;
+    }
+    cout << "Size " << lazy.size() << ", tombstones " << lazy.tombstones() << endl;
+
+    size_t visited = 0;
+    lazy.parallel_for_each([&visited](const std::pair<const int, int>&) { ++visited; }, 1);
+    int keySum = lazy.parallel_reduce(0, [](const std::pair<const int, int>& item) { return item.first; },
+                                      [](int a, int b) { return a + b; });
+    TombstoneAVLTree<int,int>::Cursor lazyCursor(lazy);
+    cout << "Walked " << visited << " items, key sum " << keySum << endl;
+    cout << "Cursor find(6): " << (lazyCursor.find(6) != lazy.end() ? "found" : "missing")
+         << ", lower_bound(6) -> " << lazyCursor.lower_bound(6)->first << endl;
+    TombstoneAVLTree<int,int,TransparentLess> graves;
+    for(int key = 1; key <= 4; ++key) {
+        graves.insert(std::make_pair(key, key));
+    }
+    graves.remove(2);
+    BinarySearchTree<int,int,TransparentLess>& gravesBase = graves;
+    cout << "Through BinarySearchTree&: find(2L) " << (gravesBase.find(2L) != gravesBase.end() ? "found" : "missing")
+         << ", lower_bound(2L) -> " << gravesBase.lower_bound(2L)->first
+         << ", upper_bound(1) -> " << gravesBase.upper_bound(1)->first << endl;
+
+    AVLTree<int,int>& lazyBase = lazy;
+    std::vector<BatchOp<int,int> > lazyOps;
+    lazyOps.push_back(BatchOp<int,int>::upsert(1, 11));
+    lazyOps.push_back(BatchOp<int,int>::remove(2));
+    lazyOps.push_back(BatchOp<int,int>::upsert(6, 66));
+    lazyBase.applyBatch(lazyOps);
+    size_t walked = 0;
+    for(TombstoneAVLTree<int,int>::iterator it = lazy.begin(); it != lazy.end(); ++it) {
+        ++walked;
+    }
+    cout << "After a batch through AVLTree&: size " << lazy.size() << ", iterated " << walked
+         << ", 6 -> " << lazy.find(6)->second << endl;
+    lazyBase.buildFrom(unsorted.begin(), unsorted.end());
+    cout << "After buildFrom through AVLTree&: size " << lazy.size() << ", tombstones " << lazy.tombstones() << endl;
+
+    // Range Update Tests
+    LazyAVLTree<int,int> counters;
+    for(int key = 1; key <= 8; ++key) {
+        counters.insert(std::make_pair(key, 0));
+    }
+    counters.updateRange(2, 7, AddUpdate<int>(10));
+    counters.updateRange(5, 9, AddUpdate<int>(1));
+    counters.remove(4);
+    cout << "\nLazyAVLTree after adding 10 to [2, 7) and 1 to [5, 9):" << endl;
+    for(LazyAVLTree<int,int>::iterator it = counters.begin(); it != counters.end(); ++it) {
+        cout << it->first << " " << it->second << endl;
+    }
+
+    AVLTree<int,int>& countersBase = counters;
+    std::vector<BatchOp<int,int> > counterOps;
+    counterOps.push_back(BatchOp<int,int>::upsert(4, 0));
+    counterOps.push_back(BatchOp<int,int>::remove(8));
+    counterOps.push_back(BatchOp<int,int>::upsert(9, 0));
+    countersBase.applyBatch(counterOps);
+    counters.updateRange(3, 10, AddUpdate<int>(100));
+    cout << "After a batch through AVLTree& and adding 100 to [3, 10):" << endl;
+    for(LazyAVLTree<int,int>::iterator it = counters.begin(); it != counters.end(); ++it) {
+        cout << it->first << " " << it->second << endl;
+    }
+    rejected = false;
+    try {
+        countersBase.compact();
+    }
+    catch(const std::logic_error&) {
+        rejected = true;
+    }
+    cout << "compact rejected: " << (rejected ? "yes" : "no") << endl;
+
+    counters.updateRange(0, 100, AddUpdate<int>(5));
+    LazyAVLTree<int,int>::Cursor counterCursor(counters);
+    int valueSum = counters.parallel_reduce(0, [](const std::pair<const int, int>& item) { return item.second; },
+                                            [](int a, int b) { return a + b; });
+    cout << "After adding 5 to everything: cursor find(7) -> " << counterCursor.find(7)->second
+         << ", lower_bound(8) -> " << counterCursor.lower_bound(8)->second
+         << ", parallel sum " << valueSum << endl;
+
+    // Hash Index Tests
+    HashedAVLTree<std::string,int> hashed;
+    hashed.insert(std::make_pair(std::string("pear"), 1));
+    hashed.insert(std::make_pair(std::string("fig"), 2));
+    hashed.insert(std::make_pair(std::string("kiwi"), 3));
+    hashed.insert(std::make_pair(std::string("fig"), 4));
+    hashed.remove("pear");
+    cout << "\nHashedAVLTree contents:" << endl;
+    for(HashedAVLTree<std::string,int>::iterator it = hashed.begin(); it != hashed.end(); ++it) {
+        cout << it->first << " " << it->second << endl;
+    }
+    cout << "Found kiwi: " << (hashed.find("kiwi") != hashed.end() ? "yes" : "no") << endl;
+    cout << "Size " << hashed.size() << endl;
+
+    AVLTree<std::string,int>& hashedBase = hashed;
+    std::vector<BatchOp<std::string,int> > hashedOps;
+    hashedOps.push_back(BatchOp<std::string,int>::remove("fig"));
+    hashedOps.push_back(BatchOp<std::string,int>::upsert("lime", 5));
+    hashedBase.applyBatch(hashedOps);
+    cout << "After a batch through AVLTree&: found fig: " << (hashed.find("fig") != hashed.end() ? "yes" : "no")
+         << ", found lime: " << (hashed.find("lime") != hashed.end() ? "yes" : "no") << ", size " << hashed.size() << endl;
+
     return 0;
 }
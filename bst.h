@@ -4,7 +4,19 @@
 #include <iostream>
 #include <exception>
 #include <cstdlib>
+#include <cstdint>
 #include <utility>
+#include <vector>
+#include <algorithm>
+#include <deque>
+#include <new>
+#include <stdexcept>
+#include <typeinfo>
+#include "bst_stats.h"
+#include "bst_trace.h"
+#include "bst_record.h"
+#include "bloom_filter.h"
+#include "thread_pool.h"
 
 /**
  * A templated class for a Node in a search tree.
@@ -19,6 +31,9 @@ class Node
 public:
     Node(const Key& key, const Value& value, Node<Key, Value>* parent);
     virtual ~Node();
+    // sizeof the node's own type, for the byte counters; every node type
+    // overrides it
+    virtual size_t footprint() const;
 
     const std::pair<const Key, Value>& getItem() const;
     std::pair<const Key, Value>& getItem();
@@ -72,6 +87,12 @@ Node<Key, Value>::~Node()
 
 }
 
+template<typename Key, typename Value>
+size_t Node<Key, Value>::footprint() const
+{
+    return sizeof(*this);
+}
+
 /**
 * A const getter for the item.
 */
@@ -187,23 +208,169 @@ void Node<Key, Value>::setValue(const Value& value)
 */
 
 /**
-* A templated unbalanced binary search tree.
+* The kinds of problems BinarySearchTree::validate() reports.
 */
-template <typename Key, typename Value>
+enum TreeViolation
+{
+    TREE_OK,
+    TREE_BAD_ORDER,     // a key is out of order with respect to an ancestor
+    TREE_BAD_LINK,      // a child's parent pointer does not point back at it
+    TREE_BAD_METADATA,  // per-node data of the tree type (AVL balance, RB color) is wrong
+    TREE_UNBALANCED     // sibling subtree heights differ by more than one
+};
+
+inline const char* treeViolationName(TreeViolation violation)
+{
+    static const char* names[] = { "ok", "bad order", "bad link", "bad metadata", "unbalanced" };
+    return names[violation];
+}
+
+/**
+* What validate() knows about a node once both of its subtrees are done.
+* Heights of missing children are -1. aux is a per-tree-type summary
+* (e.g. black height) that checkNode() computes from the children's.
+*/
+struct SubtreeCheck
+{
+    int leftHeight;
+    int rightHeight;
+    int leftAux;
+    int rightAux;
+    int aux;
+};
+
+/**
+* The partial result of one task of a parallel walk (see
+* BinarySearchTree::parallel_reduce). Tasks that were split off from this
+* one hold the items after it, and are listed in the order they were
+* split off, which is right to left.
+*/
+template <typename T>
+struct WalkResult
+{
+    WalkResult() : has(false), value() { }
+    ~WalkResult()
+    {
+        for (size_t i = 0; i < splits.size(); ++i) delete splits[i];
+    }
+
+    bool has;
+    T value;
+    std::vector<WalkResult*> splits;
+};
+
+/**
+* A less-than that accepts any pair of argument types, so that a tree
+* declared with it can be searched with anything its keys compare
+* against (e.g. a const char* in a std::string-keyed tree) without
+* building a temporary Key. Same as C++14's std::less<void>.
+*/
+struct TransparentLess
+{
+    typedef void is_transparent;
+
+    template<typename A, typename B>
+    bool operator()(const A& a, const B& b) const
+    {
+        return a < b;
+    }
+};
+
+/**
+* A templated unbalanced binary search tree, ordered by Compare (a strict
+* weak ordering on keys, std::less by default). Descents make a single
+* Compare call per level and settle equality once at the bottom.
+*/
+template <typename Key, typename Value, typename Compare = std::less<Key> >
 class BinarySearchTree
 {
 public:
-    BinarySearchTree(); //TODO
+    explicit BinarySearchTree(const Compare& comp = Compare()); //TODO
+    // Copies clone the tree shape node for node in O(n), into one block;
+    // moves and swap() just hand the nodes over, in O(1). Assignment and
+    // swap() need both trees to be of the same type (std::invalid_argument).
+    BinarySearchTree(const BinarySearchTree& other);
+    BinarySearchTree(BinarySearchTree&& other);
+    BinarySearchTree& operator=(const BinarySearchTree& other);
+    BinarySearchTree& operator=(BinarySearchTree&& other);
     virtual ~BinarySearchTree(); //TODO
+    void swap(BinarySearchTree& other);
+    // Copy assignment with the subtrees below the top few levels cloned in
+    // parallel; threads = 0 means one per hardware thread
+    void copyFrom(const BinarySearchTree& other, unsigned int threads = 0);
+    // Puts a counting Bloom filter (see bloom_filter.h) in front of find(),
+    // operator[], find_from() and remove(), so that most lookups of absent
+    // keys end after one cache line instead of a descent. It is kept up to
+    // date by every change to the tree and regrows as the tree does.
+    // hash defaults to keyHash(); keys that Compare finds equivalent must
+    // hash the same. Copies take the filter along.
+    void enableFilter(size_t expectedKeys = 0,
+                      const std::function<uint64_t(const Key&)>& hash = std::function<uint64_t(const Key&)>());
+    void disableFilter();
+    bool hasFilter() const;
     virtual void insert(const std::pair<const Key, Value>& keyValuePair); //TODO
     virtual void remove(const Key& key); //TODO
-    void clear(); //TODO
+    // Virtual for trees that keep state about their nodes alongside them
+    virtual void clear(); //TODO
     bool isBalanced() const; //TODO
     void print() const;
     bool empty() const;
+    TreeShape stats() const;
 
-    template<typename PPKey, typename PPValue>
-    friend void prettyPrintBST(BinarySearchTree<PPKey, PPValue> & tree);
+    /**
+    * The outcome of validate(). When the tree is invalid, node is where the
+    * first violation was found (at the given depth); otherwise height is the
+    * tree height. nodes is the number of nodes checked.
+    */
+    struct ValidationReport
+    {
+        bool ok() const;
+
+        TreeViolation violation;
+        Node<Key, Value>* node;
+        int depth;
+        int height;
+        size_t nodes;
+    };
+    ValidationReport validate(unsigned int threads = 1) const;
+
+    // Calls f(item) for every item (or every item with low <= key < high)
+    // from several threads at once; f must be safe to call concurrently.
+    // Subtrees are handed out to a work-stealing pool; grain is how many
+    // items a task visits between checks for idle threads to split off to.
+    // threads = 0 means one per hardware thread.
+    template<typename F>
+    void parallel_for_each(F f, unsigned int threads = 0, size_t grain = 1024) const;
+    template<typename F>
+    void parallel_for_each(const Key& low, const Key& high, F f,
+                           unsigned int threads = 0, size_t grain = 1024) const;
+    // combine(init, combine(map(item1), combine(map(item2), ...))) in key
+    // order, computed in parallel; combine must be associative.
+    template<typename T, typename Map, typename Combine>
+    T parallel_reduce(T init, Map map, Combine combine,
+                      unsigned int threads = 0, size_t grain = 1024) const;
+    template<typename T, typename Map, typename Combine>
+    T parallel_reduce(const Key& low, const Key& high, T init, Map map, Combine combine,
+                      unsigned int threads = 0, size_t grain = 1024) const;
+#ifdef BST_STATS
+    const TreeCounters& counters() const;
+    void resetCounters();
+#endif
+#ifdef BST_TRACE
+    static OpTracer<Key>& tracer();
+#endif
+#ifdef BST_RECORD
+    // Where ops on trees of this type are recorded; NULL (the default)
+    // records nothing. Set it while no other thread uses such a tree.
+    static OpRecorder<Key>* recorder();
+    static void setRecorder(OpRecorder<Key>* recorder);
+#endif
+
+    template<typename PPKey, typename PPValue, typename PPCompare>
+    friend void prettyPrintBST(BinarySearchTree<PPKey, PPValue, PPCompare> & tree);
+    // streaming dumps, see bst_export.h
+    template<typename EKey, typename EValue, typename ECompare>
+    friend class TreeExporter;
 public:
     /**
     * An internal iterator class for traversing the contents of the BST.
@@ -222,23 +389,76 @@ public:
         iterator& operator++();
 
     protected:
-        friend class BinarySearchTree<Key, Value>;
+        friend class BinarySearchTree<Key, Value, Compare>;
         iterator(Node<Key,Value>* ptr);
         Node<Key, Value> *current_;
     };
 
+    /**
+    * Keeps a finger on the node its last lookup ended at, so that lookups
+    * of nearby keys (a merge-join walking two sorted inputs, say) start
+    * from there instead of the root; see find_from(). The finger is as
+    * fragile as an iterator: removing its node, or clear(), requires a
+    * reset() before the next lookup.
+    */
+    class Cursor
+    {
+    public:
+        explicit Cursor(const BinarySearchTree& tree);
+
+        iterator find(const Key& key);
+        iterator lower_bound(const Key& key);
+        // The item the finger is on, or end() before the first hit
+        iterator position() const;
+        void reset();
+
+    private:
+        const BinarySearchTree* tree_;
+        Node<Key, Value>* finger_;
+    };
+
 public:
     iterator begin() const;
     iterator end() const;
     iterator find(const Key& key) const;
+    // Like find, but searches outward from finger (end() means the root):
+    // about O(log d) for a key d items away instead of O(log n)
+    iterator find_from(iterator finger, const Key& key) const;
+    // First item whose key is not less than / greater than key
+    iterator lower_bound(const Key& key) const;
+    iterator upper_bound(const Key& key) const;
+    // Heterogeneous lookups, only available when Compare::is_transparent exists
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    iterator find(const K& key) const;
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    iterator lower_bound(const K& key) const;
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    iterator upper_bound(const K& key) const;
+    // Removes the item at pos; returns an iterator to the item after it
+    iterator erase(iterator pos);
+    // Removes the items in [first, last) and returns last
+    iterator erase(iterator first, iterator last);
+    // Removes every item with lo <= key < hi; returns how many there were
+    size_t eraseRange(const Key& lo, const Key& hi);
     Value& operator[](const Key& key);
     Value const & operator[](const Key& key) const;
+    const Compare& getComparator() const;
 
 protected:
     // Mandatory helper functions
-    Node<Key, Value>* internalFind(const Key& k) const; // TODO
+    virtual Node<Key, Value>* internalFind(const Key& k) const; // TODO
+    // One Compare call per level; K is Key or, with a transparent
+    // comparator, anything Compare accepts alongside a Key.
+    template<typename K>
+    Node<Key, Value>* findNode(const K& key) const;
+    template<typename K>
+    Node<Key, Value>* lowerBoundNode(const K& key) const;
+    template<typename K>
+    Node<Key, Value>* upperBoundNode(const K& key) const;
+    Node<Key, Value>* lowerBoundFrom(Node<Key, Value>* finger, const Key& key) const;
     Node<Key, Value> *getSmallestNode() const;  // TODO
     static Node<Key, Value>* predecessor(Node<Key, Value>* current); // TODO
+    static Node<Key, Value>* successor(Node<Key, Value>* current);
     // Note:  static means these functions don't have a "this" pointer
     //        and instead just use the input argument.
 
@@ -246,12 +466,137 @@ protected:
     virtual void printRoot (Node<Key, Value> *r) const;
     virtual void nodeSwap( Node<Key,Value>* n1, Node<Key,Value>* n2) ;
 
+    // Unlinks and frees node, which must be in this tree. Trees only ever
+    // move nodes around, never items between nodes, so other node pointers
+    // (and iterators) stay valid.
+    virtual void eraseNode(Node<Key, Value>* node);
+    // Erases from first up to but not including last (NULL for the end) and
+    // returns the count. The default erases one node at a time.
+    virtual size_t eraseSpan(Node<Key, Value>* first, Node<Key, Value>* last);
+    // Plain BST unlink (swapping with the predecessor first if node has two
+    // children); returns the node's final parent
+    Node<Key, Value>* detachNode(Node<Key, Value>* node);
+
     // Add helper functions here
+    // All node allocation goes through these so that bookkeeping
+    // (e.g. the BST_STATS counters) lives in one place.
+    template<typename NodeType>
+    NodeType* createNode(const Key& key, const Value& value, NodeType* parent);
+    template<typename NodeType>
+    void destroyNode(NodeType* node);
+    // Uninitialized room for count nodes in one allocation, for bulk builds.
+    // The caller must construct all of them (placement new); destroyNode
+    // knows block nodes and frees the block with its last node.
+    template<typename NodeType>
+    NodeType* allocateNodeBlock(size_t count);
+    // Gives up on filling unused of the block's slots, freeing the block if
+    // nothing else in it is live
+    template<typename NodeType>
+    void releaseNodeSlots(NodeType* block, size_t unused);
+    // Frees every node of a detached subtree in O(size) time and O(1) space;
+    // returns how many there were
+    template<typename NodeType>
+    size_t destroySubtree(NodeType* node);
+    // Clones other's nodes into this (empty) tree as the tree's node type.
+    // Derived trees with their own node type override it to call cloneAs().
+    virtual void cloneNodes(const BinarySearchTree& other, unsigned int threads);
+    // NodeType must be the type of other's nodes or a base of it
+    template<typename NodeType>
+    void cloneAs(const BinarySearchTree& other, unsigned int threads);
+    // Copies the subtree at src into slots in preorder, under parent
+    template<typename NodeType>
+    static NodeType* cloneSubtree(const NodeType* src, NodeType* slots, NodeType* parent);
+    static size_t countNodes(const Node<Key, Value>* node);
+    // For state a derived tree keeps beside its nodes; other is the same type
+    virtual void swapExtra(BinarySearchTree& other);
+    // Key filter upkeep. createNode() and destroyNode() add and remove keys
+    // unless the filter is paused, which bulk operations do around work
+    // that creates nodes out of order or on several threads, patching the
+    // filter up afterwards. Inserts call maintainFilter() first, while the
+    // tree is whole, so that an overloaded filter can be regrown there.
+    bool filterRejects(const Key& key) const;  // key is certainly absent
+    void filterAdd(const Key& key);
+    void pauseFilter();
+    void resumeFilter();
+    void maintainFilter();
+    void rebuildFilter();
+    // Parallel walk machinery. walkRange() visits [low, high) (either may be
+    // NULL for unbounded) and returns whether anything was visited.
+    template<typename T, typename Map, typename Combine>
+    bool walkRange(const Key* low, const Key* high, T& result, Map& map, Combine& combine,
+                   unsigned int threads, size_t grain) const;
+    // One task: the subtree at node (whole) or node and then its right subtree
+    template<typename T, typename Map, typename Combine>
+    void walkSpan(Node<Key, Value>* node, bool whole, const Key* low, const Key* high,
+                  WalkResult<T>* out, Map& map, Combine& combine,
+                  ThreadPool* pool, TaskGroup* group, size_t grain) const;
+    template<typename T, typename Combine>
+    static void foldWalkResult(WalkResult<T>& result, Combine& combine);
+    // Lets derived trees hand out iterators to nodes they located themselves
+    static iterator makeIterator(Node<Key, Value>* node);
+
+    // False for trees that hold several items with the same key; validate()
+    // then accepts keys equal to an ancestor's
+    virtual bool uniqueKeys() const;
+    // True for a node that stays linked but holds no item, such as a
+    // TombstoneAVLTree tombstone; lookups, Cursor and the parallel walks
+    // pass over it. Always false here.
+    virtual bool hidden(const Node<Key, Value>* node) const;
+    // node, or the first node after it that is not hidden
+    Node<Key, Value>* skipHidden(Node<Key, Value>* node) const;
+    // Bring stored values up to date in trees that defer updates
+    // (LazyAVLTree) before a node is handed out: settlePath() on node's
+    // root path, returning node, and settleAll() everywhere ahead of a
+    // walk. No-ops here.
+    virtual Node<Key, Value>* settlePath(Node<Key, Value>* node) const;
+    virtual void settleAll() const;
+    // Which properties checkSubtree() verifies
+    enum CheckFlags {
+        CHECK_ORDER = 1,
+        CHECK_LINKS = 2,
+        CHECK_NODE = 4,     // the checkNode() hook
+        CHECK_HEIGHT = 8
+    };
+    // Per-node invariants of the tree type, called by validate() once a
+    // node's subtrees are checked. Sets check.aux for the parent's use.
+    virtual TreeViolation checkNode(const Node<Key, Value>* node, SubtreeCheck& check) const;
+    struct SubtreeResult {
+        ValidationReport report;
+        int aux;
+    };
+    // Iterative single-pass check of the subtree at root, whose keys must lie
+    // strictly between low and high (either may be NULL). If cut is given,
+    // subtrees at cutDepth are not visited; their results are taken from
+    // cut, in left-to-right order.
+    SubtreeResult checkSubtree(Node<Key, Value>* root, const Node<Key, Value>* low,
+                               const Node<Key, Value>* high, int depth, unsigned int checks,
+                               int cutDepth, const std::vector<SubtreeResult>* cut) const;
 
 
 protected:
     Node<Key, Value>* root_;
     // You should not need other data members
+    Compare comp_;
+    struct NodeBlock {
+        char* begin;
+        char* end;
+        size_t live;
+    };
+    std::vector<NodeBlock> blocks_;
+    struct KeyFilter {
+        CountingBloomFilter bloom;
+        std::function<uint64_t(const Key&)> hash;  // empty for keyHash()
+        size_t expectedKeys;
+        int paused;
+        uint64_t hashOf(const Key& key) const { return hash ? hash(key) : keyHash(key); }
+    };
+    KeyFilter* filter_;  // NULL unless enableFilter() was called
+#ifdef BST_STATS
+    mutable TreeCounters counters_;
+#endif
+#ifdef BST_RECORD
+    static OpRecorder<Key>*& recorderSlot();
+#endif
 };
 
 /*
@@ -263,8 +608,8 @@ Begin implementations for the BinarySearchTree::iterator class.
 /**
 * Explicit constructor that initializes an iterator with a given node pointer.
 */
-template<class Key, class Value>
-BinarySearchTree<Key, Value>::iterator::iterator(Node<Key,Value> *ptr)
+template<class Key, class Value, class Compare>
+BinarySearchTree<Key, Value, Compare>::iterator::iterator(Node<Key,Value> *ptr)
 
 {
     // TODO
@@ -275,8 +620,8 @@ BinarySearchTree<Key, Value>::iterator::iterator(Node<Key,Value> *ptr)
 /**
 * A default constructor that initializes the iterator to NULL.
 */
-template<class Key, class Value>
-BinarySearchTree<Key, Value>::iterator::iterator() 
+template<class Key, class Value, class Compare>
+BinarySearchTree<Key, Value, Compare>::iterator::iterator() 
 {
     // TODO
     current_ = NULL;
@@ -286,9 +631,9 @@ BinarySearchTree<Key, Value>::iterator::iterator()
 /**
 * Provides access to the item.
 */
-template<class Key, class Value>
+template<class Key, class Value, class Compare>
 std::pair<const Key,Value> &
-BinarySearchTree<Key, Value>::iterator::operator*() const
+BinarySearchTree<Key, Value, Compare>::iterator::operator*() const
 {
     return current_->getItem();
 }
@@ -296,9 +641,9 @@ BinarySearchTree<Key, Value>::iterator::operator*() const
 /**
 * Provides access to the address of the item.
 */
-template<class Key, class Value>
+template<class Key, class Value, class Compare>
 std::pair<const Key,Value> *
-BinarySearchTree<Key, Value>::iterator::operator->() const
+BinarySearchTree<Key, Value, Compare>::iterator::operator->() const
 {
     return &(current_->getItem());
 }
@@ -307,10 +652,10 @@ BinarySearchTree<Key, Value>::iterator::operator->() const
 * Checks if 'this' iterator's internals have the same value
 * as 'rhs'
 */
-template<class Key, class Value>
+template<class Key, class Value, class Compare>
 bool
-BinarySearchTree<Key, Value>::iterator::operator==(
-    const BinarySearchTree<Key, Value>::iterator& rhs) const
+BinarySearchTree<Key, Value, Compare>::iterator::operator==(
+    const BinarySearchTree<Key, Value, Compare>::iterator& rhs) const
 {
     // TODO
     return current_ == rhs.current_;
@@ -320,10 +665,10 @@ BinarySearchTree<Key, Value>::iterator::operator==(
 * Checks if 'this' iterator's internals have a different value
 * as 'rhs'
 */
-template<class Key, class Value>
+template<class Key, class Value, class Compare>
 bool
-BinarySearchTree<Key, Value>::iterator::operator!=(
-    const BinarySearchTree<Key, Value>::iterator& rhs) const
+BinarySearchTree<Key, Value, Compare>::iterator::operator!=(
+    const BinarySearchTree<Key, Value, Compare>::iterator& rhs) const
 {
     // TODO
 
@@ -334,11 +679,14 @@ BinarySearchTree<Key, Value>::iterator::operator!=(
 /**
 * Advances the iterator's location using an in-order sequencing
 */
-template<class Key, class Value>
-typename BinarySearchTree<Key, Value>::iterator&
-BinarySearchTree<Key, Value>::iterator::operator++()
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator&
+BinarySearchTree<Key, Value, Compare>::iterator::operator++()
 {
     if (current_ == NULL) return *this;
+    BST_TRACE_SCOPE(trace, TRACE_ITERATE, &current_->getKey());
+    BST_RECORD_OP(TRACE_ITERATE, NULL);
+    BST_TRACE_AT(trace, current_, 0);
     // trying to find next node - go to right child but most left node
     // If right child exists
     if (current_->getRight() != NULL) {
@@ -362,6 +710,62 @@ End implementations for the BinarySearchTree::iterator class.
 -------------------------------------------------------------
 */
 
+/*
+-------------------------------------------------------------
+Begin implementations for the BinarySearchTree::Cursor class.
+-------------------------------------------------------------
+*/
+
+template<class Key, class Value, class Compare>
+BinarySearchTree<Key, Value, Compare>::Cursor::Cursor(const BinarySearchTree& tree) :
+    tree_(&tree), finger_(NULL)
+{
+}
+
+/**
+* Moves the finger to the item found, or leaves it where it was on a miss.
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::Cursor::find(const Key& key)
+{
+    iterator found = tree_->find_from(iterator(finger_), key);
+    if (found.current_ != NULL) finger_ = found.current_;
+    return found;
+}
+
+/**
+* Moves the finger to the first item not less than key, if there is one.
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::Cursor::lower_bound(const Key& key)
+{
+    BST_STAT(tree_->counters_.begin(TREE_OP_FIND));
+    Node<Key, Value>* found = tree_->settlePath(tree_->skipHidden(tree_->lowerBoundFrom(finger_, key)));
+    if (found != NULL) finger_ = found;
+    return iterator(found);
+}
+
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::Cursor::position() const
+{
+    return iterator(finger_);
+}
+
+template<class Key, class Value, class Compare>
+void BinarySearchTree<Key, Value, Compare>::Cursor::reset()
+{
+    finger_ = NULL;
+}
+
+/*
+-----------------------------------------------------------
+End implementations for the BinarySearchTree::Cursor class.
+-----------------------------------------------------------
+*/
+
 /*
 -----------------------------------------------------
 Begin implementations for the BinarySearchTree class.
@@ -371,29 +775,100 @@ Begin implementations for the BinarySearchTree class.
 /**
 * Default constructor for a BinarySearchTree, which sets the root to NULL.
 */
-template<class Key, class Value>
-BinarySearchTree<Key, Value>::BinarySearchTree() 
+template<class Key, class Value, class Compare>
+BinarySearchTree<Key, Value, Compare>::BinarySearchTree(const Compare& comp) :
+    comp_(comp), filter_(NULL)
 {
     // TODO
     root_ = NULL;}
 
-template<typename Key, typename Value>
-BinarySearchTree<Key, Value>::~BinarySearchTree()
+template<typename Key, typename Value, typename Compare>
+BinarySearchTree<Key, Value, Compare>::BinarySearchTree(const BinarySearchTree& other) :
+    root_(NULL), comp_(other.comp_), filter_(NULL)
+{
+    cloneAs<Node<Key, Value> >(other, 1);
+}
+
+template<typename Key, typename Value, typename Compare>
+BinarySearchTree<Key, Value, Compare>::BinarySearchTree(BinarySearchTree&& other) :
+    root_(other.root_), comp_(other.comp_), filter_(other.filter_)
+{
+    other.root_ = NULL;
+    other.filter_ = NULL;
+    blocks_.swap(other.blocks_);
+#ifdef BST_STATS
+    counters_ = other.counters_;
+    other.counters_ = TreeCounters();
+#endif
+}
+
+template<typename Key, typename Value, typename Compare>
+BinarySearchTree<Key, Value, Compare>&
+BinarySearchTree<Key, Value, Compare>::operator=(const BinarySearchTree& other)
+{
+    if (this != &other) copyFrom(other, 1);
+    return *this;
+}
+
+/**
+* The old nodes are freed here, and other is left empty.
+*/
+template<typename Key, typename Value, typename Compare>
+BinarySearchTree<Key, Value, Compare>&
+BinarySearchTree<Key, Value, Compare>::operator=(BinarySearchTree&& other)
+{
+    if (this != &other) {
+        clear();
+        swap(other);
+    }
+    return *this;
+}
+
+template<typename Key, typename Value, typename Compare>
+BinarySearchTree<Key, Value, Compare>::~BinarySearchTree()
 {
     // TODO
-    clear();}
+    clear();
+    // slots of a block that were never filled (an unfinished compaction)
+    for (size_t i = 0; i < blocks_.size(); ++i) ::operator delete(blocks_[i].begin);
+    delete filter_;
+}
+
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::swap(BinarySearchTree& other)
+{
+    if (typeid(*this) != typeid(other)) throw std::invalid_argument("swap: trees of different types");
+    std::swap(root_, other.root_);
+    std::swap(comp_, other.comp_);
+    blocks_.swap(other.blocks_);
+    std::swap(filter_, other.filter_);
+#ifdef BST_STATS
+    std::swap(counters_, other.counters_);
+#endif
+    swapExtra(other);
+}
+
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::copyFrom(const BinarySearchTree& other, unsigned int threads)
+{
+    if (typeid(*this) != typeid(other)) throw std::invalid_argument("copyFrom: trees of different types");
+    if (this == &other) return;
+    clear();
+    comp_ = other.comp_;
+    cloneNodes(other, threads);
+}
 
 /**
  * Returns true if tree is empty
 */
-template<class Key, class Value>
-bool BinarySearchTree<Key, Value>::empty() const
+template<class Key, class Value, class Compare>
+bool BinarySearchTree<Key, Value, Compare>::empty() const
 {
     return root_ == NULL;
 }
 
-template<typename Key, typename Value>
-void BinarySearchTree<Key, Value>::print() const
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::print() const
 {
     printRoot(root_);
     std::cout << "\n";
@@ -402,22 +877,22 @@ void BinarySearchTree<Key, Value>::print() const
 /**
 * Returns an iterator to the "smallest" item in the tree
 */
-template<class Key, class Value>
-typename BinarySearchTree<Key, Value>::iterator
-BinarySearchTree<Key, Value>::begin() const
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::begin() const
 {
-    BinarySearchTree<Key, Value>::iterator begin(getSmallestNode());
+    BinarySearchTree<Key, Value, Compare>::iterator begin(getSmallestNode());
     return begin;
 }
 
 /**
 * Returns an iterator whose value means INVALID
 */
-template<class Key, class Value>
-typename BinarySearchTree<Key, Value>::iterator
-BinarySearchTree<Key, Value>::end() const
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::end() const
 {
-    BinarySearchTree<Key, Value>::iterator end(NULL);
+    BinarySearchTree<Key, Value, Compare>::iterator end(NULL);
     return end;
 }
 
@@ -425,30 +900,106 @@ BinarySearchTree<Key, Value>::end() const
 * Returns an iterator to the item with the given key, k
 * or the end iterator if k does not exist in the tree
 */
-template<class Key, class Value>
-typename BinarySearchTree<Key, Value>::iterator
-BinarySearchTree<Key, Value>::find(const Key & k) const
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::find(const Key & k) const
 {
+    BST_STAT(counters_.begin(TREE_OP_FIND));
+    BST_TRACE_SCOPE(trace, TRACE_FIND, &k);
+    BST_RECORD_OP(TRACE_FIND, &k);
     Node<Key, Value> *curr = internalFind(k);
-    BinarySearchTree<Key, Value>::iterator it(curr);
+    BST_TRACE_AT(trace, curr, 0);
+    BinarySearchTree<Key, Value, Compare>::iterator it(curr);
     return it;
 }
 
+template<class Key, class Value, class Compare>
+template<typename K, typename C, typename>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::find(const K& key) const
+{
+    BST_STAT(counters_.begin(TREE_OP_FIND));
+    Node<Key, Value>* found = findNode(key);
+    return iterator(found != NULL && hidden(found) ? NULL : settlePath(found));
+}
+
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::find_from(iterator finger, const Key& key) const
+{
+    BST_STAT(counters_.begin(TREE_OP_FIND));
+    BST_TRACE_SCOPE(trace, TRACE_FIND, &key);
+    BST_RECORD_OP(TRACE_FIND, &key);
+    Node<Key, Value>* found = filterRejects(key) ? NULL : lowerBoundFrom(finger.current_, key);
+    BST_STAT(if (found != NULL) ++counters_.comparisons[counters_.current]);
+    if (found != NULL && (comp_(key, found->getKey()) || hidden(found))) found = NULL;
+    BST_TRACE_AT(trace, found, 0);
+    return iterator(settlePath(found));
+}
+
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::lower_bound(const Key& key) const
+{
+    BST_STAT(counters_.begin(TREE_OP_FIND));
+    return iterator(settlePath(skipHidden(lowerBoundNode(key))));
+}
+
+template<class Key, class Value, class Compare>
+template<typename K, typename C, typename>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::lower_bound(const K& key) const
+{
+    BST_STAT(counters_.begin(TREE_OP_FIND));
+    return iterator(settlePath(skipHidden(lowerBoundNode(key))));
+}
+
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::upper_bound(const Key& key) const
+{
+    BST_STAT(counters_.begin(TREE_OP_FIND));
+    return iterator(settlePath(skipHidden(upperBoundNode(key))));
+}
+
+template<class Key, class Value, class Compare>
+template<typename K, typename C, typename>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::upper_bound(const K& key) const
+{
+    BST_STAT(counters_.begin(TREE_OP_FIND));
+    return iterator(settlePath(skipHidden(upperBoundNode(key))));
+}
+
+template<class Key, class Value, class Compare>
+const Compare& BinarySearchTree<Key, Value, Compare>::getComparator() const
+{
+    return comp_;
+}
+
 /**
  * @precondition The key exists in the map
  * Returns the value associated with the key
  */
-template<class Key, class Value>
-Value& BinarySearchTree<Key, Value>::operator[](const Key& key)
+template<class Key, class Value, class Compare>
+Value& BinarySearchTree<Key, Value, Compare>::operator[](const Key& key)
 {
+    BST_STAT(counters_.begin(TREE_OP_FIND));
+    BST_TRACE_SCOPE(trace, TRACE_FIND, &key);
+    BST_RECORD_OP(TRACE_FIND, &key);
     Node<Key, Value> *curr = internalFind(key);
+    BST_TRACE_AT(trace, curr, 0);
     if(curr == NULL) throw std::out_of_range("Invalid key");
     return curr->getValue();
 }
-template<class Key, class Value>
-Value const & BinarySearchTree<Key, Value>::operator[](const Key& key) const
+template<class Key, class Value, class Compare>
+Value const & BinarySearchTree<Key, Value, Compare>::operator[](const Key& key) const
 {
+    BST_STAT(counters_.begin(TREE_OP_FIND));
+    BST_TRACE_SCOPE(trace, TRACE_FIND, &key);
+    BST_RECORD_OP(TRACE_FIND, &key);
     Node<Key, Value> *curr = internalFind(key);
+    BST_TRACE_AT(trace, curr, 0);
     if(curr == NULL) throw std::out_of_range("Invalid key");
     return curr->getValue();
 }
@@ -459,29 +1010,43 @@ Value const & BinarySearchTree<Key, Value>::operator[](const Key& key) const
 * Recall: If key is already in the tree, you should 
 * overwrite the current value with the updated value.
 */
-template<class Key, class Value>
-void BinarySearchTree<Key, Value>::insert(const std::pair<const Key, Value> &keyValuePair)
+template<class Key, class Value, class Compare>
+void BinarySearchTree<Key, Value, Compare>::insert(const std::pair<const Key, Value> &keyValuePair)
 {
+    BST_STAT(counters_.begin(TREE_OP_INSERT));
+    BST_TRACE_SCOPE(trace, TRACE_INSERT, &keyValuePair.first);
+    BST_RECORD_OP(TRACE_INSERT, &keyValuePair.first);
+    maintainFilter();
    if (root_ == NULL) {
-    root_ = new Node<Key, Value>(keyValuePair.first, keyValuePair.second, NULL);
+    root_ = createNode<Node<Key, Value> >(keyValuePair.first, keyValuePair.second, NULL);
     return;
 }
 Node<Key, Value>* current = root_;
 Node<Key, Value>* parent = NULL;
+// last node we went right at: the only possible match for the key
+Node<Key, Value>* candidate = NULL;
+bool left = false;
 while (current != NULL) {
     parent = current;
-    if (keyValuePair.first == current->getKey()) {
-        current->setValue(keyValuePair.second);
- return;
-    } else if (keyValuePair.first < current->getKey()) {
+    BST_STAT(++counters_.comparisons[TREE_OP_INSERT]);
+    left = comp_(keyValuePair.first, current->getKey());
+    if (left) {
    current = current->getLeft();
     } else {
+        candidate = current;
         current = current->getRight();}
 }
-if (keyValuePair.first < parent->getKey()) {
-    parent->setLeft(new Node<Key, Value>(keyValuePair.first, keyValuePair.second, parent));
+BST_STAT(if (candidate != NULL) ++counters_.comparisons[TREE_OP_INSERT]);
+if (candidate != NULL && !comp_(candidate->getKey(), keyValuePair.first)) {
+    candidate->setValue(keyValuePair.second);
+    BST_TRACE_AT(trace, candidate, 0);
+    return;
+}
+BST_TRACE_AT(trace, parent, 1);
+if (left) {
+    parent->setLeft(createNode<Node<Key, Value> >(keyValuePair.first, keyValuePair.second, parent));
 } else {
-    parent->setRight(new Node<Key, Value>(keyValuePair.first, keyValuePair.second, parent));
+    parent->setRight(createNode<Node<Key, Value> >(keyValuePair.first, keyValuePair.second, parent));
 }
 }
 
@@ -491,11 +1056,23 @@ if (keyValuePair.first < parent->getKey()) {
 * Recall: The writeup specifies that if a node has 2 children you
 * should swap with the predecessor and then remove.
 */
-template<typename Key, typename Value>
-void BinarySearchTree<Key, Value>::remove(const Key& key)
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::remove(const Key& key)
 {
+    BST_STAT(counters_.begin(TREE_OP_REMOVE));
+    BST_TRACE_SCOPE(trace, TRACE_REMOVE, &key);
+    BST_RECORD_OP(TRACE_REMOVE, &key);
     Node<Key, Value>* toRemove = internalFind(key);
 if (toRemove == NULL) return;
+Node<Key, Value>* parent = detachNode(toRemove);
+BST_TRACE_AT(trace, parent, 1);
+BST_TRACE_END(trace);  // key may refer into toRemove
+destroyNode(toRemove);
+}
+
+template<typename Key, typename Value, typename Compare>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::detachNode(Node<Key, Value>* toRemove)
+{
 if (toRemove->getLeft() != NULL && toRemove->getRight() != NULL) {
 Node<Key, Value>* pred = predecessor(toRemove);
  nodeSwap(toRemove, pred);
@@ -513,14 +1090,73 @@ if (toRemove->getParent() == NULL) {
         toRemove->getParent()->setRight(child);
     }
 }
-delete toRemove;
+return toRemove->getParent();
 }
 
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::eraseNode(Node<Key, Value>* node)
+{
+    detachNode(node);
+    destroyNode(node);
+}
 
+template<typename Key, typename Value, typename Compare>
+size_t BinarySearchTree<Key, Value, Compare>::eraseSpan(Node<Key, Value>* first, Node<Key, Value>* last)
+{
+    size_t count = 0;
+    while (first != last) {
+        Node<Key, Value>* next = successor(first);
+        eraseNode(first);
+        first = next;
+        ++count;
+    }
+    return count;
+}
 
-template<class Key, class Value>
+/**
+* The successor is found before the node goes; it is still the successor
+* afterwards, whatever the tree does to rebalance.
+*/
+template<typename Key, typename Value, typename Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::erase(iterator pos)
+{
+    BST_STAT(counters_.begin(TREE_OP_REMOVE));
+    BST_TRACE_SCOPE(trace, TRACE_REMOVE, NULL);  // the key lives in the node that goes
+    BST_RECORD_OP(TRACE_REMOVE, &pos.current_->getKey());
+    Node<Key, Value>* next = successor(pos.current_);
+    eraseNode(pos.current_);
+    return iterator(next);
+}
+
+template<typename Key, typename Value, typename Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::erase(iterator first, iterator last)
+{
+    BST_STAT(counters_.begin(TREE_OP_REMOVE));
+    BST_TRACE_SCOPE(trace, TRACE_REMOVE, NULL);
+    BST_RECORD_SPAN(TRACE_REMOVE, first.current_, last.current_);
+    eraseSpan(first.current_, last.current_);
+    return last;
+}
+
+template<typename Key, typename Value, typename Compare>
+size_t BinarySearchTree<Key, Value, Compare>::eraseRange(const Key& lo, const Key& hi)
+{
+    BST_STAT(counters_.begin(TREE_OP_REMOVE));
+    BST_TRACE_SCOPE(trace, TRACE_REMOVE, NULL);  // lo and hi may refer into erased nodes
+    if (!comp_(lo, hi)) return 0;
+    Node<Key, Value>* first = lowerBoundNode(lo);
+    Node<Key, Value>* last = lowerBoundNode(hi);
+    BST_RECORD_SPAN(TRACE_REMOVE, first, last);
+    return eraseSpan(first, last);
+}
+
+
+
+template<class Key, class Value, class Compare>
 Node<Key, Value>*
-BinarySearchTree<Key, Value>::predecessor(Node<Key, Value>* current)
+BinarySearchTree<Key, Value, Compare>::predecessor(Node<Key, Value>* current)
 {
     if (current == NULL) return NULL;
 if (current->getLeft() != NULL) {
@@ -539,24 +1175,122 @@ return parent;
 }
 
 
+template<class Key, class Value, class Compare>
+Node<Key, Value>*
+BinarySearchTree<Key, Value, Compare>::successor(Node<Key, Value>* current)
+{
+    if (current == NULL) return NULL;
+    if (current->getRight() != NULL) {
+        current = current->getRight();
+        while (current->getLeft() != NULL) {
+            current = current->getLeft();
+        }
+        return current;
+    }
+    Node<Key, Value>* parent = current->getParent();
+    while (parent != NULL && current == parent->getRight()) {
+        current = parent;
+        parent = parent->getParent();
+    }
+    return parent;
+}
+
+
 /**
 * A method to remove all contents of the tree and
 * reset the values in the tree for use again.
 */
-template<typename Key, typename Value>
-void BinarySearchTree<Key, Value>::clear()
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::clear()
 {
-    // TODO
-    while(root_ != NULL){remove(root_ ->getKey());}
+    BST_TRACE_SCOPE(trace, TRACE_CLEAR, NULL);
+    BST_RECORD_OP(TRACE_CLEAR, NULL);
+    // O(n): no rebalancing, since nothing is left to balance
+    pauseFilter();
+    destroySubtree(root_);
+    root_ = NULL;
+    resumeFilter();
+    if (filter_ != NULL) filter_->bloom.clear();
+}
+
+/**
+* Sizes the filter for expectedKeys or twice the current size, whichever
+* is more, and fills it from the tree in O(n).
+*/
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::enableFilter(size_t expectedKeys,
+                                                         const std::function<uint64_t(const Key&)>& hash)
+{
+    delete filter_;
+    filter_ = new KeyFilter{ CountingBloomFilter(), hash, expectedKeys, 0 };
+    rebuildFilter();
+}
+
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::disableFilter()
+{
+    delete filter_;
+    filter_ = NULL;
+}
+
+template<typename Key, typename Value, typename Compare>
+bool BinarySearchTree<Key, Value, Compare>::hasFilter() const
+{
+    return filter_ != NULL;
+}
+
+template<typename Key, typename Value, typename Compare>
+bool BinarySearchTree<Key, Value, Compare>::filterRejects(const Key& key) const
+{
+    return filter_ != NULL && !filter_->bloom.mightContain(filter_->hashOf(key));
+}
+
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::filterAdd(const Key& key)
+{
+    if (filter_ != NULL) filter_->bloom.add(filter_->hashOf(key));
+}
+
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::pauseFilter()
+{
+    if (filter_ != NULL) ++filter_->paused;
+}
+
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::resumeFilter()
+{
+    if (filter_ != NULL) --filter_->paused;
+}
+
+/**
+* Regrowing doubles the size each time, so its O(n) is amortized O(1)
+* per insert. Stale entries (see CountingBloomFilter) count towards the
+* load too, so they get cleared out the same way.
+*/
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::maintainFilter()
+{
+    if (filter_ != NULL && filter_->paused == 0 && filter_->bloom.overloaded()) rebuildFilter();
+}
+
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::rebuildFilter()
+{
+    size_t count = countNodes(root_);
+    filter_->bloom = CountingBloomFilter(std::max(filter_->expectedKeys, 2 * count));
+    for (Node<Key, Value>* node = getSmallestNode(); node != NULL; node = successor(node)) {
+        filterAdd(node->getKey());
+    }
 }
 
 
 /**
 * A helper function to find the smallest node in the tree.
 */
-template<typename Key, typename Value>
+template<typename Key, typename Value, typename Compare>
 Node<Key, Value>*
-BinarySearchTree<Key, Value>::getSmallestNode() const
+BinarySearchTree<Key, Value, Compare>::getSmallestNode() const
 {
     if (root_ == NULL) return NULL;
 
@@ -572,54 +1306,509 @@ return current;
 * return a pointer to it or NULL if no item with that key
 * exists
 */
-template<typename Key, typename Value>
-Node<Key, Value>* BinarySearchTree<Key, Value>::internalFind(const Key& key) const
+template<typename Key, typename Value, typename Compare>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::internalFind(const Key& key) const
+{
+    if (filterRejects(key)) return NULL;
+    return findNode(key);
+}
+
+/**
+* Descends like lowerBoundNode() and then checks the one candidate for
+* equality, so a lookup costs height + 1 comparisons.
+*/
+template<typename Key, typename Value, typename Compare>
+template<typename K>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::findNode(const K& key) const
+{
+    Node<Key, Value>* found = lowerBoundNode(key);
+    BST_STAT(if (found != NULL) ++counters_.comparisons[counters_.current]);
+    if (found != NULL && !comp_(key, found->getKey())) return found;
+    return NULL;
+}
+
+/**
+* The smallest node whose key is not less than key, or NULL.
+*/
+template<typename Key, typename Value, typename Compare>
+template<typename K>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::lowerBoundNode(const K& key) const
 {
     Node<Key, Value>* current = root_;
+    Node<Key, Value>* best = NULL;
+    while (current != NULL) {
+        BST_STAT(++counters_.comparisons[counters_.current]);
+        if (comp_(current->getKey(), key)) {
+            current = current->getRight();
+        } else {
+            best = current;
+            current = current->getLeft();
+        }
+    }
+    return best;
+}
 
-while (current != NULL) {
-if (key == current->getKey()) {
-        return current;} 
-        else if (key < current->getKey()) {
-        current = current->getLeft();
-    } else {
-        current = current->getRight();}
+/**
+* lowerBoundNode() starting at finger rather than the root. The search
+* climbs only until it reaches an ancestor whose subtree must hold the
+* answer (a left-child link to a parent not less than key when the key is
+* ahead of the finger, a right-child link to a parent less than key when
+* it is not) and descends from there, so it stays below the lowest common
+* ancestor of the finger and the answer: O(log d) levels in a balanced
+* tree for an answer d items away, amortized over a sorted walk. A NULL
+* finger searches from the root.
+*/
+template<typename Key, typename Value, typename Compare>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::lowerBoundFrom(Node<Key, Value>* finger, const Key& key) const
+{
+    if (finger == NULL) return lowerBoundNode(key);
+    Node<Key, Value>* current = finger;
+    Node<Key, Value>* best = NULL;
+    BST_STAT(++counters_.comparisons[counters_.current]);
+    bool ahead = comp_(finger->getKey(), key);
+    if (!ahead) best = finger;
+    for (Node<Key, Value>* parent = current->getParent(); parent != NULL; parent = current->getParent()) {
+        bool fromLeft = (parent->getLeft() == current);
+        if (fromLeft == ahead) {
+            BST_STAT(++counters_.comparisons[counters_.current]);
+            bool parentLess = comp_(parent->getKey(), key);
+            if (ahead && !parentLess) {
+                best = parent;
+                break;
+            }
+            if (!ahead && parentLess) break;
+            if (!ahead) best = parent;
+        }
+        current = parent;
+    }
+    while (current != NULL) {
+        BST_STAT(++counters_.comparisons[counters_.current]);
+        if (comp_(current->getKey(), key)) {
+            current = current->getRight();
+        } else {
+            best = current;
+            current = current->getLeft();
+        }
+    }
+    return best;
 }
-return NULL;
+
+/**
+* The smallest node whose key is greater than key, or NULL.
+*/
+template<typename Key, typename Value, typename Compare>
+template<typename K>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::upperBoundNode(const K& key) const
+{
+    Node<Key, Value>* current = root_;
+    Node<Key, Value>* best = NULL;
+    while (current != NULL) {
+        BST_STAT(++counters_.comparisons[counters_.current]);
+        if (comp_(key, current->getKey())) {
+            best = current;
+            current = current->getLeft();
+        } else {
+            current = current->getRight();
+        }
+    }
+    return best;
 }
 
 /**
  * Return true iff the BST is balanced.
+ * Uses the same single O(n) iterative pass as validate().
  */
-template<typename Key, typename Value>
-bool BinarySearchTree<Key, Value>::isBalanced() const
+template<typename Key, typename Value, typename Compare>
+bool BinarySearchTree<Key, Value, Compare>::isBalanced() const
 {
-    class Helpers {
-    public:
-        static int height(const Node<Key, Value>* node) {
-            if (node == NULL) return -1;
-            return 1 + std::max(height(node->getLeft()), height(node->getRight()));}
-
-        static bool isBalancedHelper(const Node<Key, Value>* node) {
-            if (node == NULL) return true;
-            int leftHeight = height(node->getLeft());
-            int rightHeight = height(node->getRight());
-            if (abs(leftHeight - rightHeight) > 1) return false;
-            return isBalancedHelper(node->getLeft()) && 
-                   isBalancedHelper(node->getRight());
+    return checkSubtree(root_, NULL, NULL, 0, CHECK_HEIGHT, -1, NULL).report.ok();
+}
+
+template<typename Key, typename Value, typename Compare>
+bool BinarySearchTree<Key, Value, Compare>::ValidationReport::ok() const
+{
+    return violation == TREE_OK;
+}
+
+/**
+* Checks key ordering, parent/child links and the invariants of the tree
+* type (checkNode()) in one O(n) pass without recursion. With threads > 1
+* the subtrees a few levels below the root are checked in parallel and the
+* top of the tree is then finished using their results.
+*/
+template<typename Key, typename Value, typename Compare>
+typename BinarySearchTree<Key, Value, Compare>::ValidationReport
+BinarySearchTree<Key, Value, Compare>::validate(unsigned int threads) const
+{
+    const unsigned int checks = CHECK_ORDER | CHECK_LINKS | CHECK_NODE;
+    if (root_ != NULL && root_->getParent() != NULL) {
+        ValidationReport report = { TREE_BAD_LINK, root_, 0, -1, 0 };
+        return report;
+    }
+    if (threads <= 1 || root_ == NULL) {
+        return checkSubtree(root_, NULL, NULL, 0, checks, -1, NULL).report;
+    }
+
+    // Cut a few levels below the root so there are several subtrees per thread
+    int cutDepth = 3;
+    while ((1u << (cutDepth - 3)) < threads) ++cutDepth;
+
+    struct Pending {
+        Node<Key, Value>* node;
+        const Node<Key, Value>* low;
+        const Node<Key, Value>* high;
+        int depth;
+    };
+    std::vector<Pending> frontier;
+    std::vector<Pending> stack;
+    Pending top = { root_, NULL, NULL, 0 };
+    stack.push_back(top);
+    while (!stack.empty()) {
+        Pending p = stack.back();
+        stack.pop_back();
+        if (p.depth == cutDepth) {
+            frontier.push_back(p);
+            continue;
         }
+        // right first so that the left subtree is popped (and cut) first
+        if (p.node->getRight() != NULL) {
+            Pending r = { p.node->getRight(), p.node, p.high, p.depth + 1 };
+            stack.push_back(r);
+        }
+        if (p.node->getLeft() != NULL) {
+            Pending l = { p.node->getLeft(), p.low, p.node, p.depth + 1 };
+            stack.push_back(l);
+        }
+    }
+
+    std::vector<SubtreeResult> results(frontier.size());
+    {
+        ThreadPool pool(threads);
+        TaskGroup group(pool);
+        for (size_t i = 0; i < frontier.size(); ++i) {
+            group.run([this, &frontier, &results, checks, i]() {
+                const Pending& p = frontier[i];
+                results[i] = checkSubtree(p.node, p.low, p.high, p.depth, checks, -1, NULL);
+            });
+        }
+        group.wait();
+    }
+    return checkSubtree(root_, NULL, NULL, 0, checks, cutDepth, &results).report;
+}
+
+template<typename Key, typename Value, typename Compare>
+bool BinarySearchTree<Key, Value, Compare>::uniqueKeys() const
+{
+    return true;
+}
+
+template<typename Key, typename Value, typename Compare>
+bool BinarySearchTree<Key, Value, Compare>::hidden(const Node<Key, Value>* node) const
+{
+    return false;
+}
+
+template<typename Key, typename Value, typename Compare>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::skipHidden(Node<Key, Value>* node) const
+{
+    while (node != NULL && hidden(node)) node = successor(node);
+    return node;
+}
+
+template<typename Key, typename Value, typename Compare>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::settlePath(Node<Key, Value>* node) const
+{
+    return node;
+}
+
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::settleAll() const
+{
+}
+
+template<typename Key, typename Value, typename Compare>
+template<typename F>
+void BinarySearchTree<Key, Value, Compare>::parallel_for_each(F f, unsigned int threads, size_t grain) const
+{
+    auto map = [&f](std::pair<const Key, Value>& item) -> char { f(item); return 0; };
+    auto combine = [](char, char) -> char { return 0; };
+    char unused;
+    walkRange(NULL, NULL, unused, map, combine, threads, grain);
+}
+
+template<typename Key, typename Value, typename Compare>
+template<typename F>
+void BinarySearchTree<Key, Value, Compare>::parallel_for_each(const Key& low, const Key& high, F f,
+                                                             unsigned int threads, size_t grain) const
+{
+    auto map = [&f](std::pair<const Key, Value>& item) -> char { f(item); return 0; };
+    auto combine = [](char, char) -> char { return 0; };
+    char unused;
+    walkRange(&low, &high, unused, map, combine, threads, grain);
+}
+
+template<typename Key, typename Value, typename Compare>
+template<typename T, typename Map, typename Combine>
+T BinarySearchTree<Key, Value, Compare>::parallel_reduce(T init, Map map, Combine combine,
+                                                         unsigned int threads, size_t grain) const
+{
+    T result;
+    if (!walkRange(NULL, NULL, result, map, combine, threads, grain)) return init;
+    return combine(init, result);
+}
+
+template<typename Key, typename Value, typename Compare>
+template<typename T, typename Map, typename Combine>
+T BinarySearchTree<Key, Value, Compare>::parallel_reduce(const Key& low, const Key& high, T init,
+                                                         Map map, Combine combine,
+                                                         unsigned int threads, size_t grain) const
+{
+    T result;
+    if (!walkRange(&low, &high, result, map, combine, threads, grain)) return init;
+    return combine(init, result);
+}
+
+/**
+* Starts a single task on the whole range. A task walks its part in order
+* with an explicit stack of pending (node, right subtree) pairs; every
+* grain items, if the pool has run dry, it hands the bottom entry of the
+* stack (the biggest piece of remaining work) to a new task. Splitting is
+* therefore driven by idle threads, the way work stealing is, and needs no
+* subtree sizes. The pieces are combined in key order once all are done.
+*/
+template<typename Key, typename Value, typename Compare>
+template<typename T, typename Map, typename Combine>
+bool BinarySearchTree<Key, Value, Compare>::walkRange(const Key* low, const Key* high, T& result,
+                                                      Map& map, Combine& combine,
+                                                      unsigned int threads, size_t grain) const
+{
+    if (root_ == NULL) return false;
+    if (grain == 0) grain = 1;
+    settleAll();
+    WalkResult<T> top;
+    ThreadPool pool(threads);
+    if (pool.size() == 1) {
+        walkSpan(root_, true, low, high, &top, map, combine, NULL, NULL, grain);
+    } else {
+        TaskGroup group(pool);
+        group.run([&]() {
+            walkSpan(root_, true, low, high, &top, map, combine, &pool, &group, grain);
+        });
+        group.wait();
+    }
+    foldWalkResult(top, combine);
+    result = top.value;
+    return top.has;
+}
+
+template<typename Key, typename Value, typename Compare>
+template<typename T, typename Map, typename Combine>
+void BinarySearchTree<Key, Value, Compare>::walkSpan(Node<Key, Value>* node, bool whole,
+                                                     const Key* low, const Key* high,
+                                                     WalkResult<T>* out, Map& map, Combine& combine,
+                                                     ThreadPool* pool, TaskGroup* group, size_t grain) const
+{
+    // nodes whose left subtree is done or in progress; each one is still
+    // to be visited, followed by its right subtree
+    std::deque<Node<Key, Value>*> pending;
+    pending.push_back(node);
+    // whether the back of pending is a subtree still to be expanded
+    bool descend = whole;
+    size_t visited = 0;
+
+    while (!pending.empty()) {
+        Node<Key, Value>* n;
+        if (descend) {
+            // push the left spine, skipping subtrees entirely below low
+            n = pending.back();
+            pending.pop_back();
+            while (n != NULL) {
+                if (low != NULL && comp_(n->getKey(), *low)) {
+                    n = n->getRight();
+                } else {
+                    pending.push_back(n);
+                    n = n->getLeft();
+                }
+            }
+            descend = false;
+            continue;
+        }
+        n = pending.back();
+        pending.pop_back();
+        if (high != NULL && !comp_(n->getKey(), *high)) return;
+        if (!hidden(n)) {
+            if (out->has) {
+                out->value = combine(out->value, map(n->getItem()));
+            } else {
+                out->value = map(n->getItem());
+                out->has = true;
+            }
+        }
+        if (n->getRight() != NULL) {
+            pending.push_back(n->getRight());
+            descend = true;
+        }
+
+        if (pool != NULL && ++visited % grain == 0 && pool->idle() && pending.size() > 1) {
+            Node<Key, Value>* split = pending.front();
+            pending.pop_front();
+            WalkResult<T>* piece = new WalkResult<T>;
+            out->splits.push_back(piece);
+            group->run([=, &map, &combine]() {
+                walkSpan(split, false, NULL, high, piece, map, combine, pool, group, grain);
+            });
+        }
+    }
+}
+
+/**
+* Folds the split-off pieces (each after everything before it) into result.
+*/
+template<typename Key, typename Value, typename Compare>
+template<typename T, typename Combine>
+void BinarySearchTree<Key, Value, Compare>::foldWalkResult(WalkResult<T>& result, Combine& combine)
+{
+    for (size_t i = result.splits.size(); i-- > 0; ) {
+        WalkResult<T>& piece = *result.splits[i];
+        foldWalkResult(piece, combine);
+        if (!piece.has) continue;
+        if (result.has) {
+            result.value = combine(result.value, piece.value);
+        } else {
+            result.value = piece.value;
+            result.has = true;
+        }
+    }
+}
+
+/**
+* The base tree has no per-node invariants.
+*/
+template<typename Key, typename Value, typename Compare>
+TreeViolation BinarySearchTree<Key, Value, Compare>::checkNode(const Node<Key, Value>* node, SubtreeCheck& check) const
+{
+    check.aux = 0;
+    return TREE_OK;
+}
+
+template<typename Key, typename Value, typename Compare>
+typename BinarySearchTree<Key, Value, Compare>::SubtreeResult
+BinarySearchTree<Key, Value, Compare>::checkSubtree(Node<Key, Value>* root, const Node<Key, Value>* low,
+                                           const Node<Key, Value>* high, int depth, unsigned int checks,
+                                           int cutDepth, const std::vector<SubtreeResult>* cut) const
+{
+    SubtreeResult result = { { TREE_OK, NULL, 0, -1, 0 }, 0 };
+    if (root == NULL) return result;
+    const bool strict = uniqueKeys();
+
+    // Post-order walk; a frame is revisited after each child so the child's
+    // height and aux can be folded in.
+    struct Frame {
+        Node<Key, Value>* node;
+        const Node<Key, Value>* low;
+        const Node<Key, Value>* high;
+        int depth;
+        int state;
+        SubtreeCheck check;
     };
+    std::vector<Frame> stack;
+    Frame first = { root, low, high, depth, 0, { -1, -1, 0, 0, 0 } };
+    stack.push_back(first);
+    size_t nextCut = 0;
+    int childHeight = -1;
+    int childAux = 0;
+
+    while (!stack.empty()) {
+        Frame& f = stack.back();
+        if (f.state == 0) {
+            if (cut != NULL && f.depth == cutDepth) {
+                const SubtreeResult& done = (*cut)[nextCut++];
+                result.report.nodes += done.report.nodes;
+                if (!done.report.ok()) {
+                    result.report.violation = done.report.violation;
+                    result.report.node = done.report.node;
+                    result.report.depth = done.report.depth;
+                    return result;
+                }
+                childHeight = done.report.height;
+                childAux = done.aux;
+                stack.pop_back();
+                continue;
+            }
+            ++result.report.nodes;
+            TreeViolation found = TREE_OK;
+            // with duplicates allowed, a key may equal its bounds but not cross them
+            if ((checks & CHECK_ORDER) &&
+                ((f.low != NULL && (strict ? !comp_(f.low->getKey(), f.node->getKey())
+                                           : comp_(f.node->getKey(), f.low->getKey()))) ||
+                 (f.high != NULL && (strict ? !comp_(f.node->getKey(), f.high->getKey())
+                                            : comp_(f.high->getKey(), f.node->getKey()))))) {
+                found = TREE_BAD_ORDER;
+            } else if ((checks & CHECK_LINKS) &&
+                       ((f.node->getLeft() != NULL && f.node->getLeft()->getParent() != f.node) ||
+                        (f.node->getRight() != NULL && f.node->getRight()->getParent() != f.node))) {
+                found = TREE_BAD_LINK;
+            }
+            if (found != TREE_OK) {
+                result.report.violation = found;
+                result.report.node = f.node;
+                result.report.depth = f.depth;
+                return result;
+            }
+            f.state = 1;
+            if (f.node->getLeft() != NULL) {
+                Frame next = { f.node->getLeft(), f.low, f.node, f.depth + 1, 0, { -1, -1, 0, 0, 0 } };
+                stack.push_back(next);
+                continue;
+            }
+        }
+        if (f.state == 1) {
+            if (f.node->getLeft() != NULL) {
+                f.check.leftHeight = childHeight;
+                f.check.leftAux = childAux;
+            }
+            f.state = 2;
+            if (f.node->getRight() != NULL) {
+                Frame next = { f.node->getRight(), f.node, f.high, f.depth + 1, 0, { -1, -1, 0, 0, 0 } };
+                stack.push_back(next);
+                continue;
+            }
+        }
+        if (f.node->getRight() != NULL) {
+            f.check.rightHeight = childHeight;
+            f.check.rightAux = childAux;
+        }
+
+        TreeViolation found = TREE_OK;
+        if ((checks & CHECK_HEIGHT) && std::abs(f.check.rightHeight - f.check.leftHeight) > 1) {
+            found = TREE_UNBALANCED;
+        } else if (checks & CHECK_NODE) {
+            found = checkNode(f.node, f.check);
+        }
+        if (found != TREE_OK) {
+            result.report.violation = found;
+            result.report.node = f.node;
+            result.report.depth = f.depth;
+            return result;
+        }
+        childHeight = 1 + std::max(f.check.leftHeight, f.check.rightHeight);
+        childAux = f.check.aux;
+        stack.pop_back();
+    }
 
-    return Helpers::isBalancedHelper(root_);
+    result.report.height = childHeight;
+    result.aux = childAux;
+    return result;
 }
 
 
-template<typename Key, typename Value>
-void BinarySearchTree<Key, Value>::nodeSwap( Node<Key,Value>* n1, Node<Key,Value>* n2)
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::nodeSwap( Node<Key,Value>* n1, Node<Key,Value>* n2)
 {
     if((n1 == n2) || (n1 == NULL) || (n2 == NULL) ) {
         return;
     }
+    BST_STAT(++counters_.nodeSwaps);
     Node<Key, Value>* n1p = n1->getParent();
     Node<Key, Value>* n1r = n1->getRight();
     Node<Key, Value>* n1lt = n1->getLeft();
@@ -698,6 +1887,395 @@ void BinarySearchTree<Key, Value>::nodeSwap( Node<Key,Value>* n1, Node<Key,Value
 
 }
 
+/**
+* Allocates a node of the tree's node type.
+*/
+template<typename Key, typename Value, typename Compare>
+template<typename NodeType>
+NodeType* BinarySearchTree<Key, Value, Compare>::createNode(const Key& key, const Value& value, NodeType* parent)
+{
+    NodeType* node = new NodeType(key, value, parent);
+    BST_STAT(++counters_.nodes; counters_.bytes += sizeof(NodeType));
+    if (filter_ != NULL && filter_->paused == 0) filterAdd(key);
+    return node;
+}
+
+/**
+* Frees a node previously returned by createNode. The node must already
+* be unlinked from the tree.
+*/
+template<typename Key, typename Value, typename Compare>
+template<typename NodeType>
+void BinarySearchTree<Key, Value, Compare>::destroyNode(NodeType* node)
+{
+    BST_STAT(--counters_.nodes; counters_.bytes -= node->footprint());
+    if (filter_ != NULL && filter_->paused == 0) filter_->bloom.remove(filter_->hashOf(node->getKey()));
+    const char* at = reinterpret_cast<const char*>(node);
+    for (size_t i = 0; i < blocks_.size(); ++i) {
+        if (at >= blocks_[i].begin && at < blocks_[i].end) {
+            node->~NodeType();
+            if (--blocks_[i].live == 0) {
+                ::operator delete(blocks_[i].begin);
+                blocks_.erase(blocks_.begin() + i);
+            }
+            return;
+        }
+    }
+    delete node;
+}
+
+template<typename Key, typename Value, typename Compare>
+template<typename NodeType>
+NodeType* BinarySearchTree<Key, Value, Compare>::allocateNodeBlock(size_t count)
+{
+    char* storage = static_cast<char*>(::operator new(count * sizeof(NodeType)));
+    NodeBlock block = { storage, storage + count * sizeof(NodeType), count };
+    blocks_.push_back(block);
+    BST_STAT(counters_.nodes += count; counters_.bytes += count * sizeof(NodeType));
+    return reinterpret_cast<NodeType*>(storage);
+}
+
+template<typename Key, typename Value, typename Compare>
+template<typename NodeType>
+void BinarySearchTree<Key, Value, Compare>::releaseNodeSlots(NodeType* block, size_t unused)
+{
+    if (unused == 0) return;
+    BST_STAT(counters_.nodes -= unused; counters_.bytes -= unused * sizeof(NodeType));
+    const char* at = reinterpret_cast<const char*>(block);
+    for (size_t i = 0; i < blocks_.size(); ++i) {
+        if (blocks_[i].begin == at) {
+            blocks_[i].live -= unused;
+            if (blocks_[i].live == 0) {
+                ::operator delete(blocks_[i].begin);
+                blocks_.erase(blocks_.begin() + i);
+            }
+            return;
+        }
+    }
+}
+
+/**
+* Rotates each left child up until the top node has none, then frees it
+* and moves on to its right child.
+*/
+template<typename Key, typename Value, typename Compare>
+template<typename NodeType>
+size_t BinarySearchTree<Key, Value, Compare>::destroySubtree(NodeType* node)
+{
+    size_t count = 0;
+    while (node != NULL) {
+        NodeType* left = static_cast<NodeType*>(node->getLeft());
+        if (left != NULL) {
+            node->setLeft(left->getRight());
+            left->setRight(node);
+            node = left;
+            continue;
+        }
+        NodeType* right = static_cast<NodeType*>(node->getRight());
+        destroyNode(node);
+        ++count;
+        node = right;
+    }
+    return count;
+}
+
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::cloneNodes(const BinarySearchTree& other, unsigned int threads)
+{
+    cloneAs<Node<Key, Value> >(other, threads);
+}
+
+/**
+* The top few levels are copied here and the subtrees hanging below them
+* are first counted and then cloned as separate tasks, each into its own
+* slice of a single block, so no allocation is shared between threads.
+* With one thread the whole tree is the one subtree. Each node is copied
+* with NodeType's copy constructor (which brings along e.g. AVL balances)
+* and then relinked.
+*/
+template<typename Key, typename Value, typename Compare>
+template<typename NodeType>
+void BinarySearchTree<Key, Value, Compare>::cloneAs(const BinarySearchTree& other, unsigned int threads)
+{
+    delete filter_;
+    filter_ = (other.filter_ != NULL) ? new KeyFilter(*other.filter_) : NULL;
+    if (other.root_ == NULL) return;
+    ThreadPool pool(threads);
+    int cutDepth = 0;
+    if (pool.size() > 1) {
+        while ((1u << cutDepth) < 4 * pool.size()) ++cutDepth;
+    }
+
+    struct Pending {
+        const NodeType* src;
+        int depth;
+        size_t parent;  // index in top, or SIZE_MAX for the root
+        bool left;
+    };
+    struct Cut {
+        const NodeType* src;
+        size_t parent;
+        bool left;
+        size_t first;
+        size_t count;
+        NodeType* root;
+    };
+    std::vector<Pending> top;
+    std::vector<Cut> cuts;
+    std::vector<Pending> stack;
+    Pending start = { static_cast<const NodeType*>(other.root_), 0, SIZE_MAX, false };
+    stack.push_back(start);
+    while (!stack.empty()) {
+        Pending p = stack.back();
+        stack.pop_back();
+        if (p.depth == cutDepth) {
+            Cut cut = { p.src, p.parent, p.left, 0, 0, NULL };
+            cuts.push_back(cut);
+            continue;
+        }
+        size_t index = top.size();
+        top.push_back(p);
+        const NodeType* children[2] = { static_cast<const NodeType*>(p.src->getRight()),
+                                        static_cast<const NodeType*>(p.src->getLeft()) };
+        for (int i = 0; i < 2; ++i) {
+            if (children[i] == NULL) continue;
+            Pending child = { children[i], p.depth + 1, index, i == 1 };
+            stack.push_back(child);
+        }
+    }
+
+    if (cuts.size() > 1) {
+        TaskGroup group(pool);
+        for (size_t i = 0; i < cuts.size(); ++i) {
+            Cut* cut = &cuts[i];
+            group.run([cut]() { cut->count = countNodes(cut->src); });
+        }
+        group.wait();
+    } else if (!cuts.empty()) {
+        cuts[0].count = countNodes(cuts[0].src);
+    }
+    size_t total = top.size();
+    for (size_t i = 0; i < cuts.size(); ++i) {
+        cuts[i].first = total;
+        total += cuts[i].count;
+    }
+
+    NodeType* block = allocateNodeBlock<NodeType>(total);
+    for (size_t i = 0; i < top.size(); ++i) {
+        NodeType* copy = new (block + i) NodeType(*top[i].src);
+        copy->setLeft(NULL);
+        copy->setRight(NULL);
+        copy->setParent(NULL);
+        if (top[i].parent == SIZE_MAX) continue;
+        copy->setParent(block + top[i].parent);
+        if (top[i].left) block[top[i].parent].setLeft(copy);
+        else block[top[i].parent].setRight(copy);
+    }
+    if (cuts.size() > 1) {
+        TaskGroup group(pool);
+        for (size_t i = 0; i < cuts.size(); ++i) {
+            Cut* cut = &cuts[i];
+            group.run([cut, block]() { cut->root = cloneSubtree(cut->src, block + cut->first, static_cast<NodeType*>(NULL)); });
+        }
+        group.wait();
+    } else if (!cuts.empty()) {
+        cuts[0].root = cloneSubtree(cuts[0].src, block + cuts[0].first, static_cast<NodeType*>(NULL));
+    }
+    for (size_t i = 0; i < cuts.size(); ++i) {
+        if (cuts[i].parent == SIZE_MAX) continue;
+        NodeType* parent = block + cuts[i].parent;
+        cuts[i].root->setParent(parent);
+        if (cuts[i].left) parent->setLeft(cuts[i].root);
+        else parent->setRight(cuts[i].root);
+    }
+    root_ = top.empty() ? cuts[0].root : block;
+}
+
+/**
+* Iterative, so degenerate trees are fine.
+*/
+template<typename Key, typename Value, typename Compare>
+template<typename NodeType>
+NodeType* BinarySearchTree<Key, Value, Compare>::cloneSubtree(const NodeType* src, NodeType* slots, NodeType* parent)
+{
+    struct Pending {
+        const NodeType* src;
+        NodeType* parent;
+        bool left;
+    };
+    std::vector<Pending> stack;
+    Pending start = { src, parent, false };
+    stack.push_back(start);
+    NodeType* root = NULL;
+    size_t next = 0;
+    while (!stack.empty()) {
+        Pending p = stack.back();
+        stack.pop_back();
+        NodeType* copy = new (slots + next++) NodeType(*p.src);
+        copy->setParent(p.parent);
+        copy->setLeft(NULL);
+        copy->setRight(NULL);
+        if (root == NULL) root = copy;
+        else if (p.left) p.parent->setLeft(copy);
+        else p.parent->setRight(copy);
+
+        const NodeType* right = static_cast<const NodeType*>(p.src->getRight());
+        const NodeType* left = static_cast<const NodeType*>(p.src->getLeft());
+        if (right != NULL) {
+            Pending child = { right, copy, false };
+            stack.push_back(child);
+        }
+        if (left != NULL) {
+            Pending child = { left, copy, true };
+            stack.push_back(child);
+        }
+    }
+    return root;
+}
+
+template<typename Key, typename Value, typename Compare>
+size_t BinarySearchTree<Key, Value, Compare>::countNodes(const Node<Key, Value>* node)
+{
+    size_t count = 0;
+    std::vector<const Node<Key, Value>*> stack;
+    if (node != NULL) stack.push_back(node);
+    while (!stack.empty()) {
+        const Node<Key, Value>* n = stack.back();
+        stack.pop_back();
+        ++count;
+        if (n->getLeft() != NULL) stack.push_back(n->getLeft());
+        if (n->getRight() != NULL) stack.push_back(n->getRight());
+    }
+    return count;
+}
+
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::swapExtra(BinarySearchTree& other)
+{
+}
+
+/**
+* Wraps a node pointer in an iterator.
+*/
+template<typename Key, typename Value, typename Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::makeIterator(Node<Key, Value>* node)
+{
+    return iterator(node);
+}
+
+/**
+* Walks the whole tree once (iteratively, so degenerate trees are fine)
+* and reports its height, depth histogram, average search path length
+* and the distribution of height(right) - height(left).
+*/
+template<typename Key, typename Value, typename Compare>
+TreeShape BinarySearchTree<Key, Value, Compare>::stats() const
+{
+    TreeShape shape;
+    if (root_ == NULL) return shape;
+
+    // Post-order walk; a frame is revisited once both children are done
+    // so that its height can be computed from theirs.
+    struct Frame {
+        const Node<Key, Value>* node;
+        int depth;
+        int leftHeight;
+        int rightHeight;
+        int state;
+    };
+    std::vector<Frame> stack;
+    Frame top = { root_, 0, -1, -1, 0 };
+    stack.push_back(top);
+    size_t pathSum = 0;
+    int childHeight = -1;
+
+    while (!stack.empty()) {
+        Frame& f = stack.back();
+        if (f.state == 0) {
+            f.state = 1;
+            if ((size_t)f.depth >= shape.depthHistogram.size()) {
+                shape.depthHistogram.resize(f.depth + 1, 0);
+            }
+            ++shape.depthHistogram[f.depth];
+            ++shape.nodes;
+            pathSum += f.depth + 1;
+            if (f.node->getLeft() != NULL) {
+                Frame next = { f.node->getLeft(), f.depth + 1, -1, -1, 0 };
+                stack.push_back(next);
+                continue;
+            }
+        }
+        if (f.state == 1) {
+            f.state = 2;
+            if (f.node->getLeft() != NULL) f.leftHeight = childHeight;
+            if (f.node->getRight() != NULL) {
+                Frame next = { f.node->getRight(), f.depth + 1, -1, -1, 0 };
+                stack.push_back(next);
+                continue;
+            }
+        }
+        if (f.node->getRight() != NULL) f.rightHeight = childHeight;
+        ++shape.balanceHistogram[f.rightHeight - f.leftHeight];
+        childHeight = 1 + std::max(f.leftHeight, f.rightHeight);
+        stack.pop_back();
+    }
+
+    shape.height = childHeight;
+    shape.avgSearchPath = static_cast<double>(pathSum) / shape.nodes;
+    return shape;
+}
+
+#ifdef BST_TRACE
+/**
+* The latency tracer shared by every tree of this type.
+*/
+template<typename Key, typename Value, typename Compare>
+OpTracer<Key>& BinarySearchTree<Key, Value, Compare>::tracer()
+{
+    static OpTracer<Key> instance;
+    return instance;
+}
+#endif
+
+#ifdef BST_RECORD
+template<typename Key, typename Value, typename Compare>
+OpRecorder<Key>*& BinarySearchTree<Key, Value, Compare>::recorderSlot()
+{
+    static OpRecorder<Key>* instance = NULL;
+    return instance;
+}
+
+template<typename Key, typename Value, typename Compare>
+OpRecorder<Key>* BinarySearchTree<Key, Value, Compare>::recorder()
+{
+    return recorderSlot();
+}
+
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::setRecorder(OpRecorder<Key>* recorder)
+{
+    recorderSlot() = recorder;
+}
+#endif
+
+#ifdef BST_STATS
+/**
+* The event counters collected since construction or the last reset.
+*/
+template<typename Key, typename Value, typename Compare>
+const TreeCounters& BinarySearchTree<Key, Value, Compare>::counters() const
+{
+    return counters_;
+}
+
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::resetCounters()
+{
+    counters_.reset();
+}
+#endif
+
 /**
  * Lastly, we are providing you with a print function,
    BinarySearchTree::printRoot().
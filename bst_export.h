@@ -0,0 +1,293 @@
+#ifndef BST_EXPORT_H
+#define BST_EXPORT_H
+
+#include <iostream>
+#include <streambuf>
+#include <vector>
+#include <cstddef>
+#include "bst.h"
+
+/**
+ * Streaming tree dumps for trees of any size, unlike prettyPrintBST()
+ * (print_bst.h), which is meant for small trees on the terminal.
+ *
+ * Nodes are written in preorder, each once, with an explicit stack, so an
+ * export is O(n) time and O(height) memory and degenerate trees are fine.
+ * Every node gets an id (its preorder position) and names its parent and
+ * which side of it it hangs on; children are never referenced ahead, so
+ * nothing has to be held back. The formats:
+ *
+ *   EXPORT_DOT   Graphviz: one "nI [label=...]" line and one edge per node
+ *   EXPORT_JSON  {"nodes":[{"id":..,"parent":..,"side":"L","key":"..",
+ *                "value":".."}, ...], "truncated":false}
+ *   EXPORT_TEXT  one "depth side key: value" line per node
+ *
+ * Keys and values are written with operator<<, escaped as the format needs.
+ * Children left out because of maxDepth are marked in place ("cut" in
+ * JSON, an elided node in DOT, a "..." line in text); hitting maxNodes
+ * ends the export and marks the whole output truncated.
+ */
+enum ExportFormat { EXPORT_DOT, EXPORT_JSON, EXPORT_TEXT };
+
+struct ExportOptions
+{
+    ExportOptions();
+
+    ExportFormat format;
+    int maxDepth;       // the root is depth 0; -1 means no limit
+    size_t maxNodes;    // 0 means no limit
+    size_t bufferSize;  // bytes collected before each write to the stream
+};
+
+inline ExportOptions::ExportOptions() :
+    format(EXPORT_TEXT), maxDepth(-1), maxNodes(0), bufferSize(1 << 16)
+{
+}
+
+// Both return the number of nodes written; exportSubtree() writes nothing
+// and returns 0 if key is not in the tree.
+template<typename Key, typename Value, typename Compare>
+size_t exportTree(const BinarySearchTree<Key, Value, Compare>& tree, std::ostream& out,
+                  const ExportOptions& options = ExportOptions());
+template<typename Key, typename Value, typename Compare>
+size_t exportSubtree(const BinarySearchTree<Key, Value, Compare>& tree, const Key& key, std::ostream& out,
+                     const ExportOptions& options = ExportOptions());
+
+/**
+ * A stream buffer that collects output in memory and hands it to the
+ * target stream in bufferSize pieces. While escaping is on, characters
+ * that would break a quoted DOT or JSON string are escaped on the way in.
+ */
+class ExportBuffer : public std::streambuf
+{
+public:
+    ExportBuffer(std::ostream& target, size_t bufferSize);
+    ~ExportBuffer();
+
+    void setEscaping(bool escaping);
+    void flushToTarget();
+
+protected:
+    virtual int_type overflow(int_type c);
+    virtual std::streamsize xsputn(const char* s, std::streamsize n);
+    virtual int sync();
+
+private:
+    void put(char c);
+
+    std::ostream& target_;
+    std::vector<char> buffer_;
+    size_t limit_;
+    bool escaping_;
+};
+
+inline ExportBuffer::ExportBuffer(std::ostream& target, size_t bufferSize) :
+    target_(target), limit_(bufferSize == 0 ? 1 : bufferSize), escaping_(false)
+{
+    buffer_.reserve(limit_ + 8);
+}
+
+inline ExportBuffer::~ExportBuffer()
+{
+    flushToTarget();
+}
+
+inline void ExportBuffer::setEscaping(bool escaping)
+{
+    escaping_ = escaping;
+}
+
+inline void ExportBuffer::flushToTarget()
+{
+    if (!buffer_.empty()) target_.write(&buffer_[0], buffer_.size());
+    buffer_.clear();
+}
+
+inline void ExportBuffer::put(char c)
+{
+    if (escaping_) {
+        if (c == '"' || c == '\\') {
+            buffer_.push_back('\\');
+        } else if (c == '\n') {
+            buffer_.push_back('\\');
+            c = 'n';
+        } else if ((unsigned char)c < 0x20) {
+            static const char hex[] = "0123456789abcdef";
+            const char escape[] = { '\\', 'u', '0', '0', hex[(c >> 4) & 0xf], hex[c & 0xf] };
+            buffer_.insert(buffer_.end(), escape, escape + sizeof(escape));
+            return;
+        }
+    }
+    buffer_.push_back(c);
+}
+
+inline ExportBuffer::int_type ExportBuffer::overflow(int_type c)
+{
+    if (traits_type::eq_int_type(c, traits_type::eof())) return traits_type::not_eof(c);
+    put(traits_type::to_char_type(c));
+    if (buffer_.size() >= limit_) flushToTarget();
+    return c;
+}
+
+inline std::streamsize ExportBuffer::xsputn(const char* s, std::streamsize n)
+{
+    if (escaping_) {
+        for (std::streamsize i = 0; i < n; ++i) put(s[i]);
+    } else {
+        buffer_.insert(buffer_.end(), s, s + n);
+    }
+    if (buffer_.size() >= limit_) flushToTarget();
+    return n;
+}
+
+inline int ExportBuffer::sync()
+{
+    flushToTarget();
+    return target_.flush() ? 0 : -1;
+}
+
+/**
+ * Does the work for exportTree() and exportSubtree(); a friend of
+ * BinarySearchTree so it can start from the root or any node.
+ */
+template<typename Key, typename Value, typename Compare>
+class TreeExporter
+{
+public:
+    static size_t run(const BinarySearchTree<Key, Value, Compare>& tree, const Key* at,
+                      std::ostream& out, const ExportOptions& options);
+
+private:
+    struct Pending {
+        const Node<Key, Value>* node;
+        int depth;
+        size_t parent;  // id; unused for the first node
+        char side;      // 'L', 'R', or '-' for the first node
+    };
+
+    static void writeNode(std::ostream& os, ExportBuffer& buffer, ExportFormat format, size_t id,
+                          const Pending& p, bool first);
+    static void writeCut(std::ostream& os, ExportFormat format, size_t id, const Pending& p);
+};
+
+template<typename Key, typename Value, typename Compare>
+size_t TreeExporter<Key, Value, Compare>::run(const BinarySearchTree<Key, Value, Compare>& tree, const Key* at,
+                                              std::ostream& out, const ExportOptions& options)
+{
+    const Node<Key, Value>* start = (at == NULL) ? tree.root_ : tree.findNode(*at);
+    if (at != NULL && start == NULL) return 0;
+
+    ExportBuffer buffer(out, options.bufferSize);
+    std::ostream os(&buffer);
+    os.copyfmt(out);
+    ExportFormat format = options.format;
+    if (format == EXPORT_DOT) os << "digraph bst {\n    node [shape=box];\n";
+    if (format == EXPORT_JSON) os << "{\"nodes\":[";
+
+    size_t count = 0;
+    bool truncated = false;
+    std::vector<Pending> stack;
+    if (start != NULL) {
+        Pending root = { start, 0, 0, '-' };
+        stack.push_back(root);
+    }
+    while (!stack.empty()) {
+        if (options.maxNodes != 0 && count == options.maxNodes) {
+            truncated = true;
+            break;
+        }
+        Pending p = stack.back();
+        stack.pop_back();
+        size_t id = count++;
+        writeNode(os, buffer, format, id, p, id == 0);
+
+        bool deeper = options.maxDepth < 0 || p.depth < options.maxDepth;
+        const Node<Key, Value>* children[2] = { p.node->getRight(), p.node->getLeft() };
+        for (int i = 0; i < 2; ++i) {
+            if (children[i] == NULL) continue;
+            Pending child = { children[i], p.depth + 1, id, i == 0 ? 'R' : 'L' };
+            if (deeper) stack.push_back(child);
+            else writeCut(os, format, id, child);
+        }
+    }
+
+    if (format == EXPORT_DOT) os << (truncated ? "    // truncated\n" : "") << "}\n";
+    if (format == EXPORT_JSON) os << "\n],\"truncated\":" << (truncated ? "true" : "false") << "}\n";
+    if (format == EXPORT_TEXT && truncated) os << "... truncated\n";
+    os.flush();
+    return count;
+}
+
+template<typename Key, typename Value, typename Compare>
+void TreeExporter<Key, Value, Compare>::writeNode(std::ostream& os, ExportBuffer& buffer, ExportFormat format,
+                                                  size_t id, const Pending& p, bool first)
+{
+    const Node<Key, Value>* node = p.node;
+    switch (format) {
+    case EXPORT_DOT:
+        os << "    n" << id << " [label=\"";
+        buffer.setEscaping(true);
+        os << node->getKey() << ": " << node->getValue();
+        buffer.setEscaping(false);
+        os << "\"];\n";
+        if (!first) os << "    n" << p.parent << " -> n" << id << " [label=\"" << p.side << "\"];\n";
+        break;
+    case EXPORT_JSON:
+        os << (first ? "\n" : ",\n") << "{\"id\":" << id;
+        if (!first) os << ",\"parent\":" << p.parent << ",\"side\":\"" << p.side << '"';
+        os << ",\"key\":\"";
+        buffer.setEscaping(true);
+        os << node->getKey();
+        buffer.setEscaping(false);
+        os << "\",\"value\":\"";
+        buffer.setEscaping(true);
+        os << node->getValue();
+        buffer.setEscaping(false);
+        os << "\"}";
+        break;
+    case EXPORT_TEXT:
+        // escaped too, so that every node stays on one line
+        os << p.depth << ' ' << p.side << ' ';
+        buffer.setEscaping(true);
+        os << node->getKey() << ": " << node->getValue();
+        buffer.setEscaping(false);
+        os << '\n';
+        break;
+    }
+}
+
+/**
+ * Marks a child left out by maxDepth.
+ */
+template<typename Key, typename Value, typename Compare>
+void TreeExporter<Key, Value, Compare>::writeCut(std::ostream& os, ExportFormat format, size_t id, const Pending& p)
+{
+    switch (format) {
+    case EXPORT_DOT:
+        os << "    n" << id << "_" << p.side << " [shape=plaintext, label=\"...\"];\n"
+           << "    n" << id << " -> n" << id << "_" << p.side << " [style=dashed];\n";
+        break;
+    case EXPORT_JSON:
+        os << ",\n{\"cut\":true,\"parent\":" << id << ",\"side\":\"" << p.side << "\"}";
+        break;
+    case EXPORT_TEXT:
+        os << p.depth << ' ' << p.side << " ...\n";
+        break;
+    }
+}
+
+template<typename Key, typename Value, typename Compare>
+size_t exportTree(const BinarySearchTree<Key, Value, Compare>& tree, std::ostream& out,
+                  const ExportOptions& options)
+{
+    return TreeExporter<Key, Value, Compare>::run(tree, NULL, out, options);
+}
+
+template<typename Key, typename Value, typename Compare>
+size_t exportSubtree(const BinarySearchTree<Key, Value, Compare>& tree, const Key& key, std::ostream& out,
+                     const ExportOptions& options)
+{
+    return TreeExporter<Key, Value, Compare>::run(tree, &key, out, options);
+}
+
+#endif
@@ -0,0 +1,236 @@
+#ifndef BST_RECORD_H
+#define BST_RECORD_H
+
+#include <iostream>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <functional>
+#include <mutex>
+#include "bst_trace.h"
+#include "key_hash.h"
+
+/**
+ * Operation recording, compiled in only when BST_RECORD is defined and
+ * switched on per tree type with BinarySearchTree::setRecorder(). Every
+ * insert, remove (an erase of a range or remove_all records one remove
+ * per item it takes out), find (including operator[]), iterator step
+ * and clear on trees of that type is then appended to a
+ * binary trace that bst-replay can run against any tree engine.
+ *
+ * Keys are not stored: each one is turned into a 64-bit token, by default
+ * a salted keyHash() (see key_hash.h), so traces can leave the building. Hashing keeps equal
+ * keys equal but scrambles their order; where order matters (scans,
+ * sequential inserts) and the keys are not sensitive, setKeyMap() can
+ * supply an order-preserving map instead.
+ *
+ * File format: the 8-byte magic "BSTREC1\n", then one record per op: a
+ * byte holding the TraceOp, with the top bit set if a token follows, and
+ * the token as a zigzag varint of its difference from the previous token
+ * (so runs of nearby keys take a byte or two).
+ */
+
+struct TraceRecord
+{
+    TraceOp op;
+    bool hasKey;
+    uint64_t key;
+};
+
+/**
+ * Appends records to a stream, buffered.
+ */
+class TraceWriter
+{
+public:
+    explicit TraceWriter(std::ostream& out);
+    ~TraceWriter();
+
+    void write(TraceOp op, const uint64_t* key);
+    void flush();
+
+private:
+    static const size_t BUFFER_SIZE = 1 << 16;
+
+    std::ostream& out_;
+    std::vector<char> buffer_;
+    uint64_t previous_;
+};
+
+/**
+ * Reads back what a TraceWriter wrote.
+ */
+class TraceReader
+{
+public:
+    explicit TraceReader(std::istream& in);
+
+    // False if the stream does not start with a trace header
+    bool ok() const;
+    // False at the end of the trace or on a truncated record
+    bool next(TraceRecord& record);
+
+private:
+    std::istream& in_;
+    bool ok_;
+    uint64_t previous_;
+};
+
+static const char TRACE_MAGIC[8] = { 'B', 'S', 'T', 'R', 'E', 'C', '1', '\n' };
+
+inline TraceWriter::TraceWriter(std::ostream& out) :
+    out_(out), previous_(0)
+{
+    buffer_.reserve(BUFFER_SIZE + 16);
+    buffer_.insert(buffer_.end(), TRACE_MAGIC, TRACE_MAGIC + sizeof(TRACE_MAGIC));
+}
+
+inline TraceWriter::~TraceWriter()
+{
+    flush();
+}
+
+inline void TraceWriter::write(TraceOp op, const uint64_t* key)
+{
+    buffer_.push_back((char)(op | (key != NULL ? 0x80 : 0)));
+    if (key != NULL) {
+        int64_t delta = (int64_t)(*key - previous_);
+        uint64_t zigzag = ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63);
+        while (zigzag >= 0x80) {
+            buffer_.push_back((char)(zigzag | 0x80));
+            zigzag >>= 7;
+        }
+        buffer_.push_back((char)zigzag);
+        previous_ = *key;
+    }
+    if (buffer_.size() >= BUFFER_SIZE) flush();
+}
+
+inline void TraceWriter::flush()
+{
+    if (!buffer_.empty()) out_.write(&buffer_[0], buffer_.size());
+    buffer_.clear();
+    out_.flush();
+}
+
+inline TraceReader::TraceReader(std::istream& in) :
+    in_(in), ok_(false), previous_(0)
+{
+    char magic[sizeof(TRACE_MAGIC)];
+    ok_ = (bool)in_.read(magic, sizeof(magic)) && memcmp(magic, TRACE_MAGIC, sizeof(magic)) == 0;
+}
+
+inline bool TraceReader::ok() const
+{
+    return ok_;
+}
+
+inline bool TraceReader::next(TraceRecord& record)
+{
+    if (!ok_) return false;
+    int head = in_.get();
+    if (head == EOF || (head & 0x7f) >= TRACE_OP_COUNT) return false;
+    record.op = static_cast<TraceOp>(head & 0x7f);
+    record.hasKey = (head & 0x80) != 0;
+    record.key = 0;
+    if (record.hasKey) {
+        uint64_t zigzag = 0;
+        for (int shift = 0; ; shift += 7) {
+            int byte = in_.get();
+            if (byte == EOF || shift > 63) return false;
+            zigzag |= (uint64_t)(byte & 0x7f) << shift;
+            if ((byte & 0x80) == 0) break;
+        }
+        int64_t delta = (int64_t)(zigzag >> 1) ^ -(int64_t)(zigzag & 1);
+        record.key = previous_ + (uint64_t)delta;
+        previous_ = record.key;
+    }
+    return true;
+}
+
+/**
+ * Turns keys into tokens and writes them to a trace. record() takes a
+ * lock, so const lookups from several threads can be recorded together.
+ */
+template <typename Key>
+class OpRecorder
+{
+public:
+    explicit OpRecorder(std::ostream& out, uint64_t salt = 0);
+
+    // Replaces the salted hash with map (e.g. the identity for integer keys)
+    void setKeyMap(const std::function<uint64_t(const Key&)>& map);
+    void record(TraceOp op, const Key* key);
+    void flush();
+
+private:
+    std::mutex lock_;
+    TraceWriter writer_;
+    uint64_t salt_;
+    std::function<uint64_t(const Key&)> map_;
+};
+
+template <typename Key>
+OpRecorder<Key>::OpRecorder(std::ostream& out, uint64_t salt) :
+    writer_(out), salt_(salt)
+{
+}
+
+template <typename Key>
+void OpRecorder<Key>::setKeyMap(const std::function<uint64_t(const Key&)>& map)
+{
+    std::lock_guard<std::mutex> guard(lock_);
+    map_ = map;
+}
+
+/**
+ * The default token is the key's hash mixed with the salt through
+ * mixHash(), so that small hash values do not show through.
+ */
+template <typename Key>
+void OpRecorder<Key>::record(TraceOp op, const Key* key)
+{
+    std::lock_guard<std::mutex> guard(lock_);
+    if (key == NULL) {
+        writer_.write(op, NULL);
+        return;
+    }
+    uint64_t token;
+    if (map_) {
+        token = map_(*key);
+    } else {
+        token = mixHash(keyHash(*key) ^ salt_);
+    }
+    writer_.write(op, &token);
+}
+
+template <typename Key>
+void OpRecorder<Key>::flush()
+{
+    std::lock_guard<std::mutex> guard(lock_);
+    writer_.flush();
+}
+
+#ifdef BST_RECORD
+#define BST_RECORD_OP(op, key) \
+    do { \
+        OpRecorder<Key>* recorder_ = BinarySearchTree<Key, Value, Compare>::recorder(); \
+        if (recorder_ != NULL) recorder_->record(op, key); \
+    } while (0)
+// Records op once for each node of the in-order span [first, last)
+#define BST_RECORD_SPAN(op, first, last) \
+    do { \
+        OpRecorder<Key>* recorder_ = BinarySearchTree<Key, Value, Compare>::recorder(); \
+        if (recorder_ == NULL) break; \
+        Node<Key, Value>* end_ = (last); \
+        for (Node<Key, Value>* n_ = (first); n_ != end_; n_ = BinarySearchTree<Key, Value, Compare>::successor(n_)) { \
+            recorder_->record(op, &n_->getKey()); \
+        } \
+    } while (0)
+#else
+#define BST_RECORD_OP(op, key) do { } while (0)
+#define BST_RECORD_SPAN(op, first, last) do { } while (0)
+#endif
+
+#endif
@@ -0,0 +1,146 @@
+#ifndef BST_STATS_H
+#define BST_STATS_H
+
+#include <iostream>
+#include <cstddef>
+#include <map>
+#include <vector>
+
+/**
+ * Event counters are only compiled in when BST_STATS is defined
+ * (e.g. by uncommenting the DEFS line in the Makefile). Without it,
+ * BST_STAT expands to an empty statement and the trees carry no
+ * counter data members at all.
+ */
+#ifdef BST_STATS
+#define BST_STAT(stmt) do { stmt; } while (0)
+#else
+#define BST_STAT(stmt) do { } while (0)
+#endif
+
+/**
+ * The operations whose key comparisons are tallied separately.
+ */
+enum TreeOp
+{
+    TREE_OP_INSERT,
+    TREE_OP_FIND,
+    TREE_OP_REMOVE,
+    TREE_OP_COUNT
+};
+
+/**
+ * Running event counters for a single tree.
+ * nodes and bytes are gauges of what is currently allocated, the
+ * rest accumulate until reset().
+ */
+struct TreeCounters
+{
+    TreeCounters();
+
+    void reset();
+    void begin(TreeOp op);
+    double comparisonsPerOp(TreeOp op) const;
+
+    size_t calls[TREE_OP_COUNT];
+    size_t comparisons[TREE_OP_COUNT];
+    size_t rotations;
+    size_t nodeSwaps;
+    size_t nodes;
+    size_t bytes;
+    // The operation that comparisons are currently charged to
+    TreeOp current;
+};
+
+/**
+ * An O(n) snapshot of the shape of a tree, as returned by stats().
+ * depthHistogram[d] is the number of nodes at depth d (the root is
+ * at depth 0) and balanceHistogram maps height(right) - height(left)
+ * to the number of nodes with that difference.
+ */
+struct TreeShape
+{
+    TreeShape();
+
+    size_t nodes;
+    int height;
+    double avgSearchPath;
+    std::vector<size_t> depthHistogram;
+    std::map<int, size_t> balanceHistogram;
+};
+
+inline TreeCounters::TreeCounters() :
+    rotations(0), nodeSwaps(0), nodes(0), bytes(0), current(TREE_OP_FIND)
+{
+    for (int i = 0; i < TREE_OP_COUNT; ++i) {
+        calls[i] = 0;
+        comparisons[i] = 0;
+    }
+}
+
+/**
+ * Zeroes the event counters. The node and byte gauges are left alone
+ * since they describe what the tree currently holds.
+ */
+inline void TreeCounters::reset()
+{
+    for (int i = 0; i < TREE_OP_COUNT; ++i) {
+        calls[i] = 0;
+        comparisons[i] = 0;
+    }
+    rotations = 0;
+    nodeSwaps = 0;
+}
+
+/**
+ * Records the start of an operation; comparisons made until the next
+ * begin() are charged to it.
+ */
+inline void TreeCounters::begin(TreeOp op)
+{
+    ++calls[op];
+    current = op;
+}
+
+inline double TreeCounters::comparisonsPerOp(TreeOp op) const
+{
+    if (calls[op] == 0) return 0.0;
+    return static_cast<double>(comparisons[op]) / calls[op];
+}
+
+inline TreeShape::TreeShape() :
+    nodes(0), height(-1), avgSearchPath(0.0)
+{
+}
+
+inline std::ostream& operator<<(std::ostream& os, const TreeCounters& c)
+{
+    static const char* names[TREE_OP_COUNT] = { "insert", "find", "remove" };
+    for (int i = 0; i < TREE_OP_COUNT; ++i) {
+        os << names[i] << ": " << c.calls[i] << " calls, "
+           << c.comparisonsPerOp(static_cast<TreeOp>(i)) << " comparisons/op\n";
+    }
+    os << "rotations: " << c.rotations << "\n";
+    os << "nodeSwaps: " << c.nodeSwaps << "\n";
+    os << "nodes: " << c.nodes << " (" << c.bytes << " bytes)\n";
+    return os;
+}
+
+inline std::ostream& operator<<(std::ostream& os, const TreeShape& s)
+{
+    os << "nodes: " << s.nodes << ", height: " << s.height
+       << ", avg search path: " << s.avgSearchPath << "\n";
+    os << "depth histogram:";
+    for (size_t d = 0; d < s.depthHistogram.size(); ++d) {
+        os << " " << s.depthHistogram[d];
+    }
+    os << "\nbalance histogram:";
+    for (std::map<int, size_t>::const_iterator it = s.balanceHistogram.begin();
+         it != s.balanceHistogram.end(); ++it) {
+        os << " [" << it->first << "]=" << it->second;
+    }
+    os << "\n";
+    return os;
+}
+
+#endif
@@ -0,0 +1,423 @@
+#ifndef BST_TRACE_H
+#define BST_TRACE_H
+
+#include <iostream>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+
+/**
+ * Per-operation latency tracing, compiled in only when BST_TRACE is
+ * defined. Each tree instantiation owns one OpTracer (see
+ * BinarySearchTree::tracer()), so all trees of the same type share
+ * their histograms.
+ *
+ * Latencies are measured in cycles (rdtsc) on x86 and in nanoseconds
+ * elsewhere.
+ */
+
+enum TraceOp
+{
+    TRACE_INSERT,
+    TRACE_FIND,
+    TRACE_REMOVE,
+    TRACE_ITERATE,
+    TRACE_CLEAR,
+    TRACE_OP_COUNT
+};
+
+inline const char* traceOpName(TraceOp op)
+{
+    static const char* names[TRACE_OP_COUNT] = { "insert", "find", "remove", "iterate", "clear" };
+    return names[op];
+}
+
+inline uint64_t traceTicks()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+/**
+ * A lock-free HDR-style histogram. Values are bucketed log-linearly:
+ * 2^SUB_BITS sub-buckets per power of two, which keeps the relative
+ * error of a reported percentile under 1/2^SUB_BITS (about 6%).
+ */
+class LatencyHistogram
+{
+public:
+    static const int SUB_BITS = 4;
+    static const int SUB_BUCKETS = 1 << SUB_BITS;
+    static const int BUCKETS = (64 - SUB_BITS + 1) * SUB_BUCKETS;
+
+    LatencyHistogram();
+
+    void record(uint64_t value);
+    void reset();
+    // Adds this histogram's counts into counts (which must hold BUCKETS entries)
+    void addTo(std::vector<uint64_t>& counts) const;
+
+    static int bucketOf(uint64_t value);
+    static uint64_t bucketValue(int bucket);
+
+private:
+    std::atomic<uint64_t> counts_[BUCKETS];
+};
+
+inline LatencyHistogram::LatencyHistogram()
+{
+    reset();
+}
+
+inline int LatencyHistogram::bucketOf(uint64_t value)
+{
+    if (value < (uint64_t)SUB_BUCKETS) return (int)value;
+    int magnitude = 63 - __builtin_clzll(value);
+    int shift = magnitude - SUB_BITS;
+    return (shift + 1) * SUB_BUCKETS + (int)((value >> shift) & (SUB_BUCKETS - 1));
+}
+
+/**
+ * The largest value that falls into the given bucket.
+ */
+inline uint64_t LatencyHistogram::bucketValue(int bucket)
+{
+    if (bucket < SUB_BUCKETS) return (uint64_t)bucket;
+    int shift = bucket / SUB_BUCKETS - 1;
+    uint64_t low = ((uint64_t)SUB_BUCKETS | (uint64_t)(bucket % SUB_BUCKETS)) << shift;
+    return low + ((uint64_t)1 << shift) - 1;
+}
+
+inline void LatencyHistogram::record(uint64_t value)
+{
+    counts_[bucketOf(value)].fetch_add(1, std::memory_order_relaxed);
+}
+
+inline void LatencyHistogram::reset()
+{
+    for (int i = 0; i < BUCKETS; ++i) {
+        counts_[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+inline void LatencyHistogram::addTo(std::vector<uint64_t>& counts) const
+{
+    for (int i = 0; i < BUCKETS; ++i) {
+        counts[i] += counts_[i].load(std::memory_order_relaxed);
+    }
+}
+
+/**
+ * Percentiles computed from a merged histogram.
+ */
+struct LatencySummary
+{
+    LatencySummary();
+
+    uint64_t count;
+    uint64_t p50;
+    uint64_t p90;
+    uint64_t p99;
+    uint64_t p999;
+    uint64_t max;
+};
+
+inline LatencySummary::LatencySummary() :
+    count(0), p50(0), p90(0), p99(0), p999(0), max(0)
+{
+}
+
+/**
+ * Turns merged bucket counts into percentiles.
+ */
+inline LatencySummary summarizeLatencies(const std::vector<uint64_t>& counts)
+{
+    LatencySummary s;
+    for (size_t i = 0; i < counts.size(); ++i) s.count += counts[i];
+    if (s.count == 0) return s;
+
+    const double quantiles[4] = { 0.50, 0.90, 0.99, 0.999 };
+    uint64_t* outputs[4] = { &s.p50, &s.p90, &s.p99, &s.p999 };
+    uint64_t seen = 0;
+    int q = 0;
+    for (size_t i = 0; i < counts.size(); ++i) {
+        if (counts[i] == 0) continue;
+        seen += counts[i];
+        while (q < 4 && seen >= (uint64_t)(quantiles[q] * s.count + 0.5)) {
+            *outputs[q++] = LatencyHistogram::bucketValue((int)i);
+        }
+        s.max = LatencyHistogram::bucketValue((int)i);
+    }
+    while (q < 4) *outputs[q++] = s.max;
+    return s;
+}
+
+inline std::ostream& operator<<(std::ostream& os, const LatencySummary& s)
+{
+    os << s.count << " ops, p50 " << s.p50 << ", p90 " << s.p90 << ", p99 " << s.p99
+       << ", p99.9 " << s.p999 << ", max " << s.max;
+    return os;
+}
+
+/**
+ * One of the slowest operations seen by an OpTracer.
+ */
+template <typename Key>
+struct SlowOp
+{
+    TraceOp op;
+    uint64_t ticks;
+    bool hasKey;
+    Key key;
+    int depth;
+};
+
+/**
+ * Returns a small per-thread index used to pick a tracer slot.
+ */
+inline int traceThreadSlot(int slots)
+{
+    static std::atomic<int> nextThread(0);
+    static thread_local int thread = nextThread.fetch_add(1, std::memory_order_relaxed);
+    return thread % slots;
+}
+
+/**
+ * Collects latencies for every traced operation of one tree type.
+ * Each thread records into its own slot (threads beyond MAX_SLOTS share),
+ * so the hot path is a relaxed atomic increment plus, only for ops slower
+ * than the slot's current slowest-N floor, a short spin-locked insert.
+ * Slots are merged when a summary is requested.
+ */
+template <typename Key>
+class OpTracer
+{
+public:
+    static const int MAX_SLOTS = 64;
+
+    explicit OpTracer(size_t slowest = 16);
+    ~OpTracer();
+
+    // True if an op of this many ticks would make the calling thread's slowest list
+    bool isSlow(uint64_t ticks) const;
+    void record(TraceOp op, uint64_t ticks);
+    void recordSlow(TraceOp op, uint64_t ticks, const Key* key, int depth);
+
+    LatencySummary summary(TraceOp op) const;
+    std::vector<SlowOp<Key> > slowest() const;
+    void report(std::ostream& os) const;
+    void reset();
+
+private:
+    struct Slot {
+        Slot() : floor(0) { lock.clear(); }
+        LatencyHistogram hist[TRACE_OP_COUNT];
+        std::atomic_flag lock;
+        std::atomic<uint64_t> floor;
+        std::vector<SlowOp<Key> > slow;   // min-heap on ticks, guarded by lock
+    };
+
+    static bool slower(const SlowOp<Key>& a, const SlowOp<Key>& b);
+
+    Slot* slots_;
+    size_t slowestN_;
+};
+
+template <typename Key>
+OpTracer<Key>::OpTracer(size_t slowest) :
+    slots_(new Slot[MAX_SLOTS]), slowestN_(slowest)
+{
+}
+
+template <typename Key>
+OpTracer<Key>::~OpTracer()
+{
+    delete [] slots_;
+}
+
+template <typename Key>
+bool OpTracer<Key>::slower(const SlowOp<Key>& a, const SlowOp<Key>& b)
+{
+    return a.ticks > b.ticks;
+}
+
+template <typename Key>
+bool OpTracer<Key>::isSlow(uint64_t ticks) const
+{
+    if (slowestN_ == 0) return false;
+    return ticks > slots_[traceThreadSlot(MAX_SLOTS)].floor.load(std::memory_order_relaxed);
+}
+
+template <typename Key>
+void OpTracer<Key>::record(TraceOp op, uint64_t ticks)
+{
+    slots_[traceThreadSlot(MAX_SLOTS)].hist[op].record(ticks);
+}
+
+template <typename Key>
+void OpTracer<Key>::recordSlow(TraceOp op, uint64_t ticks, const Key* key, int depth)
+{
+    Slot& slot = slots_[traceThreadSlot(MAX_SLOTS)];
+    while (slot.lock.test_and_set(std::memory_order_acquire)) { }
+
+    SlowOp<Key> sample = { op, ticks, key != NULL, key != NULL ? *key : Key(), depth };
+    if (slot.slow.size() < slowestN_) {
+        slot.slow.push_back(sample);
+        std::push_heap(slot.slow.begin(), slot.slow.end(), slower);
+    } else if (ticks > slot.slow.front().ticks) {
+        std::pop_heap(slot.slow.begin(), slot.slow.end(), slower);
+        slot.slow.back() = sample;
+        std::push_heap(slot.slow.begin(), slot.slow.end(), slower);
+    }
+    if (slot.slow.size() == slowestN_) {
+        slot.floor.store(slot.slow.front().ticks, std::memory_order_relaxed);
+    }
+
+    slot.lock.clear(std::memory_order_release);
+}
+
+template <typename Key>
+LatencySummary OpTracer<Key>::summary(TraceOp op) const
+{
+    std::vector<uint64_t> counts(LatencyHistogram::BUCKETS, 0);
+    for (int i = 0; i < MAX_SLOTS; ++i) {
+        slots_[i].hist[op].addTo(counts);
+    }
+    return summarizeLatencies(counts);
+}
+
+/**
+ * The slowest operations across all threads, slowest first.
+ */
+template <typename Key>
+std::vector<SlowOp<Key> > OpTracer<Key>::slowest() const
+{
+    std::vector<SlowOp<Key> > all;
+    for (int i = 0; i < MAX_SLOTS; ++i) {
+        Slot& slot = slots_[i];
+        while (slot.lock.test_and_set(std::memory_order_acquire)) { }
+        all.insert(all.end(), slot.slow.begin(), slot.slow.end());
+        slot.lock.clear(std::memory_order_release);
+    }
+    std::sort(all.begin(), all.end(), slower);
+    if (all.size() > slowestN_) all.resize(slowestN_);
+    return all;
+}
+
+template <typename Key>
+void OpTracer<Key>::report(std::ostream& os) const
+{
+    for (int op = 0; op < TRACE_OP_COUNT; ++op) {
+        LatencySummary s = summary(static_cast<TraceOp>(op));
+        if (s.count == 0) continue;
+        os << traceOpName(static_cast<TraceOp>(op)) << ": " << s << "\n";
+    }
+    std::vector<SlowOp<Key> > slow = slowest();
+    for (size_t i = 0; i < slow.size(); ++i) {
+        os << "slow " << traceOpName(slow[i].op) << " " << slow[i].ticks << " ticks";
+        if (slow[i].hasKey) os << " key " << slow[i].key;
+        os << " depth " << slow[i].depth << "\n";
+    }
+}
+
+/**
+ * Clears all histograms and slow samples. Should not race with recording.
+ */
+template <typename Key>
+void OpTracer<Key>::reset()
+{
+    for (int i = 0; i < MAX_SLOTS; ++i) {
+        for (int op = 0; op < TRACE_OP_COUNT; ++op) slots_[i].hist[op].reset();
+        slots_[i].slow.clear();
+        slots_[i].floor.store(0, std::memory_order_relaxed);
+    }
+}
+
+/**
+ * Times the enclosing scope and records it on destruction. The node
+ * set with at() is used to report the depth of slow operations; the
+ * depth is only computed for ops that make the slowest list.
+ */
+template <typename Key, typename NodeType>
+class TraceScope
+{
+public:
+    TraceScope(OpTracer<Key>& tracer, TraceOp op, const Key* key);
+    ~TraceScope();
+
+    void at(const NodeType* node, int extraDepth = 0);
+    // Records now rather than at the end of the scope; for when the key
+    // may live in a node that is about to be freed
+    void finish();
+
+private:
+    OpTracer<Key>& tracer_;
+    TraceOp op_;
+    const Key* key_;
+    const NodeType* node_;
+    int extraDepth_;
+    uint64_t start_;
+    bool done_;
+};
+
+template <typename Key, typename NodeType>
+TraceScope<Key, NodeType>::TraceScope(OpTracer<Key>& tracer, TraceOp op, const Key* key) :
+    tracer_(tracer), op_(op), key_(key), node_(NULL), extraDepth_(0), start_(traceTicks()), done_(false)
+{
+}
+
+template <typename Key, typename NodeType>
+void TraceScope<Key, NodeType>::at(const NodeType* node, int extraDepth)
+{
+    node_ = node;
+    extraDepth_ = extraDepth;
+}
+
+template <typename Key, typename NodeType>
+TraceScope<Key, NodeType>::~TraceScope()
+{
+    finish();
+}
+
+template <typename Key, typename NodeType>
+void TraceScope<Key, NodeType>::finish()
+{
+    if (done_) return;
+    done_ = true;
+    uint64_t ticks = traceTicks() - start_;
+    tracer_.record(op_, ticks);
+    if (!tracer_.isSlow(ticks)) return;
+
+    // A null node with no extra depth means the key was not found (-1);
+    // a null parent with extra depth 1 is the root (0).
+    int depth = extraDepth_ - 1;
+    if (node_ != NULL) {
+        depth = extraDepth_;
+        for (const NodeType* n = node_->getParent(); n != NULL; n = n->getParent()) ++depth;
+    }
+    tracer_.recordSlow(op_, ticks, key_, depth);
+}
+
+#ifdef BST_TRACE
+#define BST_TRACE_SCOPE(name, op, key) \
+    TraceScope<Key, Node<Key, Value> > name(BinarySearchTree<Key, Value, Compare>::tracer(), op, key)
+#define BST_TRACE_AT(name, node, extra) name.at(node, extra)
+#define BST_TRACE_END(name) name.finish()
+#else
+#define BST_TRACE_SCOPE(name, op, key) do { } while (0)
+#define BST_TRACE_AT(name, node, extra) do { (void)sizeof(node); } while (0)
+#define BST_TRACE_END(name) do { } while (0)
+#endif
+
+#endif
@@ -0,0 +1,155 @@
+#ifndef COMPLEXITY_H
+#define COMPLEXITY_H
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <cstddef>
+#include <algorithm>
+
+/**
+ * Growth-rate checks for `make check`. An operation is timed at sizes
+ * n = 2^minLog .. 2^maxLog, keeping the fastest of a few trials at each
+ * size so that scheduler noise only ever adds, and the slope of log(time)
+ * against log(n) is fitted by least squares. That slope is about 0 for
+ * O(1) and O(log n) work, 1 for O(n) and O(n log n) and 2 for O(n^2);
+ * a check fails when it is half a class or more above what was expected.
+ *
+ * Timing cannot reliably tell O(1) from O(log n) (cache misses grow with
+ * n too) or O(n) from O(n log n), so the classes are only separated where
+ * the exponent changes. That is enough to catch the regressions that
+ * matter, such as an O(log n) update that quietly became O(n).
+ */
+enum Complexity
+{
+    COMPLEXITY_CONSTANT,
+    COMPLEXITY_LOGARITHMIC,
+    COMPLEXITY_LINEAR,
+    COMPLEXITY_LINEARITHMIC,
+    COMPLEXITY_QUADRATIC
+};
+
+inline const char* complexityName(Complexity c)
+{
+    static const char* names[] = { "O(1)", "O(log n)", "O(n)", "O(n log n)", "O(n^2)" };
+    return names[c];
+}
+
+/**
+ * The fitted slope at which a measurement stops counting as c.
+ */
+inline double complexitySlopeLimit(Complexity c)
+{
+    switch (c) {
+    case COMPLEXITY_CONSTANT:
+    case COMPLEXITY_LOGARITHMIC:
+        return 0.5;
+    case COMPLEXITY_LINEAR:
+    case COMPLEXITY_LINEARITHMIC:
+        return 1.5;
+    default:
+        return 2.5;
+    }
+}
+
+struct GrowthSample
+{
+    size_t n;
+    double seconds;
+};
+
+/**
+ * Least-squares slope of log(seconds) against log(n).
+ */
+inline double growthSlope(const std::vector<GrowthSample>& samples)
+{
+    double sx = 0.0, sy = 0.0, sxx = 0.0, sxy = 0.0;
+    double count = (double)samples.size();
+    for (size_t i = 0; i < samples.size(); ++i) {
+        double x = std::log((double)samples[i].n);
+        double y = std::log(std::max(samples[i].seconds, 1e-12));
+        sx += x;
+        sy += y;
+        sxx += x * x;
+        sxy += x * y;
+    }
+    double denom = count * sxx - sx * sx;
+    return denom == 0.0 ? 0.0 : (count * sxy - sx * sy) / denom;
+}
+
+/**
+ * Runs checks and reports each one on out; failures() is what the
+ * program's exit status should be based on.
+ */
+class ComplexityGate
+{
+public:
+    explicit ComplexityGate(std::ostream& out, int trials = 5);
+
+    // measure(n) returns the time in seconds of one run at size n
+    // (per operation for batched measurements, the caller's choice)
+    template<typename Measure>
+    bool check(const std::string& name, Complexity expected, int minLog, int maxLog, Measure measure);
+
+    int failures() const;
+    int checks() const;
+
+private:
+    std::ostream& out_;
+    int trials_;
+    int checks_;
+    int failures_;
+};
+
+inline ComplexityGate::ComplexityGate(std::ostream& out, int trials) :
+    out_(out), trials_(trials), checks_(0), failures_(0)
+{
+}
+
+template<typename Measure>
+bool ComplexityGate::check(const std::string& name, Complexity expected, int minLog, int maxLog, Measure measure)
+{
+    std::vector<GrowthSample> samples;
+    for (int lg = minLog; lg <= maxLog; ++lg) {
+        size_t n = (size_t)1 << lg;
+        double best = 0.0;
+        for (int t = 0; t < trials_; ++t) {
+            double seconds = measure(n);
+            if (t == 0 || seconds < best) best = seconds;
+        }
+        GrowthSample sample = { n, best };
+        samples.push_back(sample);
+    }
+
+    double slope = growthSlope(samples);
+    bool ok = slope < complexitySlopeLimit(expected);
+    ++checks_;
+    if (!ok) ++failures_;
+
+    std::ios::fmtflags flags = out_.flags();
+    out_ << (ok ? "PASS  " : "FAIL  ") << std::left << std::setw(44) << name << std::right
+         << " slope " << std::fixed << std::setprecision(2) << std::setw(5) << slope
+         << "  expected " << complexityName(expected) << "\n";
+    if (!ok) {
+        for (size_t i = 0; i < samples.size(); ++i) {
+            out_ << "        n=" << samples[i].n << "  " << std::setprecision(1)
+                 << samples[i].seconds * 1e9 << " ns\n";
+        }
+    }
+    out_.flags(flags);
+    return ok;
+}
+
+inline int ComplexityGate::failures() const
+{
+    return failures_;
+}
+
+inline int ComplexityGate::checks() const
+{
+    return checks_;
+}
+
+#endif
@@ -0,0 +1,103 @@
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cstdlib>
+#include "equal-paths.h"
+#include "equal-paths-parallel.h"
+
+using namespace std;
+
+// Benchmarks for equalPaths.
+// Usage: equal-paths-bench [n=10000000] [chain=1000000] [forest=256]
+
+typedef chrono::steady_clock Clock;
+
+static double secondsSince(Clock::time_point start)
+{
+    return chrono::duration<double>(Clock::now() - start).count();
+}
+
+static void report(const string& name, size_t nodes, double secs)
+{
+    ostringstream rate;
+    rate << fixed << setprecision(2) << nodes / secs / 1e6;
+    cout << "  " << left << setw(24) << name << right << setw(10) << rate.str() << " Mnodes/s" << endl;
+}
+
+/**
+ * Links nodes[first, first + count) into a complete binary tree (heap
+ * layout) and returns its root. Every leaf is at the same depth when
+ * count is 2^k - 1.
+ */
+static Node* buildComplete(vector<Node>& nodes, size_t first, size_t count)
+{
+    for (size_t i = 0; i < count; ++i) {
+        Node& n = nodes[first + i];
+        n.key = (int)i;
+        n.left = (2 * i + 1 < count) ? &nodes[first + 2 * i + 1] : nullptr;
+        n.right = (2 * i + 2 < count) ? &nodes[first + 2 * i + 2] : nullptr;
+    }
+    return count ? &nodes[first] : nullptr;
+}
+
+static void benchComplete(size_t n)
+{
+    // round down to a perfect tree so the whole tree has to be walked
+    size_t count = 1;
+    while (2 * count + 1 <= n) count = 2 * count + 1;
+    vector<Node> nodes(count, Node(0));
+    Node* root = buildComplete(nodes, 0, count);
+
+    cout << "Perfect tree, n = " << count << endl;
+    Clock::time_point start = Clock::now();
+    bool result = equalPaths(root);
+    report(string("equalPaths -> ") + (result ? "true" : "false"), count, secondsSince(start));
+}
+
+static void benchChain(size_t depth)
+{
+    vector<Node> nodes(depth, Node(0));
+    for (size_t i = 0; i + 1 < depth; ++i) nodes[i].left = &nodes[i + 1];
+
+    cout << "Left chain, depth = " << depth << endl;
+    Clock::time_point start = Clock::now();
+    bool result = equalPaths(depth ? &nodes[0] : nullptr);
+    report(string("equalPaths -> ") + (result ? "true" : "false"), depth, secondsSince(start));
+}
+
+static void benchForest(size_t n, size_t trees)
+{
+    // perfect trees, so every tree is walked to the end
+    size_t each = 1;
+    while (2 * each + 1 <= n / trees) each = 2 * each + 1;
+    vector<Node> nodes(each * trees, Node(0));
+    vector<Node*> roots(trees);
+    for (size_t t = 0; t < trees; ++t) roots[t] = buildComplete(nodes, t * each, each);
+
+    cout << "Forest of " << trees << " trees, " << each << " nodes each" << endl;
+    const unsigned threads[] = { 1, 2, 4, 8 };
+    for (size_t i = 0; i < sizeof(threads) / sizeof(threads[0]); ++i) {
+        Clock::time_point start = Clock::now();
+        vector<bool> results = equalPathsBatch(roots, threads[i]);
+        double secs = secondsSince(start);
+        size_t equal = 0;
+        for (size_t t = 0; t < results.size(); ++t) equal += results[t];
+        report("batch, " + to_string(threads[i]) + " threads (" + to_string(equal) + " equal)",
+               each * trees, secs);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    size_t n = (argc > 1) ? strtoul(argv[1], NULL, 10) : 10000000;
+    size_t chain = (argc > 2) ? strtoul(argv[2], NULL, 10) : 1000000;
+    size_t forest = (argc > 3) ? strtoul(argv[3], NULL, 10) : 256;
+
+    benchComplete(n);
+    benchChain(chain);
+    benchForest(n, forest ? forest : 1);
+    return 0;
+}
@@ -0,0 +1,79 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include "equal-paths.h"
+#include "complexity.h"
+
+using namespace std;
+
+// Checks that equalPaths stays linear on every tree shape (see
+// complexity.h). Run by `make check`; exits non-zero on a regression.
+
+typedef chrono::steady_clock Clock;
+
+enum Shape { SHAPE_PERFECT, SHAPE_LAST_LEAF_DEEPER, SHAPE_LEFT_CHAIN, SHAPE_RIGHT_CHAIN, SHAPE_ZIGZAG };
+
+static const char* shapeName(Shape shape)
+{
+    static const char* names[] = { "perfect", "last leaf deeper", "left chain", "right chain", "zig-zag chain" };
+    return names[shape];
+}
+
+/**
+ * Links nodes into the shape (heap layout for the perfect trees) and
+ * returns the root. The perfect tree with one extra node under its last
+ * leaf is the worst false case: the mismatch is the last thing found.
+ */
+static Node* buildShape(vector<Node>& nodes, Shape shape)
+{
+    size_t n = nodes.size();
+    for (size_t i = 0; i < n; ++i) nodes[i].key = (int)i;
+    switch (shape) {
+    case SHAPE_PERFECT:
+    case SHAPE_LAST_LEAF_DEEPER: {
+        size_t count = (shape == SHAPE_PERFECT) ? n : n - 1;
+        for (size_t i = 0; i < count; ++i) {
+            nodes[i].left = (2 * i + 1 < count) ? &nodes[2 * i + 1] : nullptr;
+            nodes[i].right = (2 * i + 2 < count) ? &nodes[2 * i + 2] : nullptr;
+        }
+        if (shape == SHAPE_LAST_LEAF_DEEPER) {
+            nodes[count - 1].left = &nodes[n - 1];
+            nodes[n - 1].left = nodes[n - 1].right = nullptr;
+        }
+        break;
+    }
+    default:
+        for (size_t i = 0; i < n; ++i) {
+            Node* next = (i + 1 < n) ? &nodes[i + 1] : nullptr;
+            bool left = (shape == SHAPE_LEFT_CHAIN) || (shape == SHAPE_ZIGZAG && i % 2 == 0);
+            nodes[i].left = left ? next : nullptr;
+            nodes[i].right = left ? nullptr : next;
+        }
+        break;
+    }
+    return &nodes[0];
+}
+
+int main()
+{
+    static const Shape shapes[] = {
+        SHAPE_PERFECT, SHAPE_LAST_LEAF_DEEPER, SHAPE_LEFT_CHAIN, SHAPE_RIGHT_CHAIN, SHAPE_ZIGZAG
+    };
+    ComplexityGate gate(cout);
+    for (size_t s = 0; s < sizeof(shapes) / sizeof(shapes[0]); ++s) {
+        Shape shape = shapes[s];
+        gate.check(string("equalPaths (") + shapeName(shape) + ")", COMPLEXITY_LINEAR, 10, 18,
+                   [shape](size_t n) {
+                       // 2^k - 1 nodes make a perfect tree, plus one for the deeper leaf
+                       vector<Node> nodes(shape == SHAPE_LAST_LEAF_DEEPER ? n : n - 1, Node(0));
+                       Node* root = buildShape(nodes, shape);
+                       Clock::time_point start = Clock::now();
+                       volatile bool result = equalPaths(root);
+                       (void)result;
+                       return chrono::duration<double>(Clock::now() - start).count();
+                   });
+    }
+    cout << gate.checks() - gate.failures() << "/" << gate.checks() << " complexity checks passed" << endl;
+    return gate.failures() == 0 ? 0 : 1;
+}
@@ -0,0 +1,26 @@
+#include <algorithm>
+#include "equal-paths-parallel.h"
+#include "thread_pool.h"
+using namespace std;
+
+vector<bool> equalPathsBatch(const vector<Node*>& roots, unsigned threads)
+{
+  // one byte per tree so that workers never share a written word
+  vector<char> results(roots.size(), 0);
+  {
+    ThreadPool pool(threads);
+    TaskGroup group(pool);
+    // a few chunks per thread keeps the pool balanced when tree sizes vary
+    size_t chunk = max<size_t>(1, roots.size() / (pool.size() * 8));
+    for (size_t begin = 0; begin < roots.size(); begin += chunk) {
+      size_t end = min(roots.size(), begin + chunk);
+      group.run([&roots, &results, begin, end]() {
+        for (size_t i = begin; i < end; ++i) {
+          results[i] = equalPaths(roots[i]);
+        }
+      });
+    }
+    group.wait();
+  }
+  return vector<bool>(results.begin(), results.end());
+}
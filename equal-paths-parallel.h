@@ -0,0 +1,17 @@
+#ifndef EQUAL_PATHS_PARALLEL_H
+#define EQUAL_PATHS_PARALLEL_H
+
+#include <vector>
+#include "equal-paths.h"
+
+/**
+ * @brief Runs equalPaths() on many independent trees at once, spreading
+ *        them over a pool of worker threads.
+ *
+ * @param roots The roots of the trees to check (nullptr is an empty tree)
+ * @param threads Number of threads to use; 0 means one per hardware thread
+ * @return result[i] == equalPaths(roots[i])
+ */
+std::vector<bool> equalPathsBatch(const std::vector<Node*>& roots, unsigned threads = 0);
+
+#endif
@@ -1,6 +1,7 @@
 #ifndef RECCHECK
 //if you want to add any #includes like <iostream> you must do them here (before the next endif)
-
+#include <vector>
+#include <utility>
 #endif
 
 #include "equal-paths.h"
@@ -8,52 +9,35 @@ using namespace std;
 
 
 // You may add any prototypes of helper functions here
-int getlength( Node* root){
-  if (root == nullptr){
-    return 0; }
-  // how long it is
-  if (getlength(root->left) > getlength(root->right) ){
-    return 1 + getlength(root->left);}
-  else { return 1 + getlength(root->right); }
-  }
-
-  // return 1 + max(getlength(root->left),  getlength(root->right) );}
 
 
 bool equalPaths(Node * root)
 {
-
-  //recursive routine to see length of traversal
-// compare max length of subtree of left and right 
-    //work -post order to calc lenght = counter +1?
-    //counter if length are equal 
-
-
-// empty tree
-if ( root == nullptr){return true;}
-
-  //base - leaf node - end of tree
-if (!root->left   && !root->right){return true;}
-
-  
-    //workk
-
-    int leftlength = getlength(root->left);
-    int rightlength = getlength(root->right); 
-
-  if (root->left && root->right)
-  //boolean answer
-  //if both left and right give answer
-        return (leftlength == rightlength);
-
-        // only left - continue down the left path
-        // to check entire tree correctly
-    if (root->left) {
-    return equalPaths(root->left);
-    } else {
-    return equalPaths(root->right);
+  // empty tree
+  if (root == nullptr) { return true; }
+
+  // Single pass over the tree with an explicit stack (so very deep
+  // chains cannot overflow the call stack). Every leaf's depth is
+  // compared against the first leaf's, stopping at the first mismatch.
+  vector<pair<Node*, int> > stack;
+  stack.push_back(make_pair(root, 0));
+  int leafDepth = -1;
+
+  while (!stack.empty()) {
+    Node* node = stack.back().first;
+    int depth = stack.back().second;
+    stack.pop_back();
+
+    //base - leaf node - end of a path
+    if (!node->left && !node->right) {
+      if (leafDepth == -1) { leafDepth = depth; }
+      else if (depth != leafDepth) { return false; }
+      continue;
     }
-
-
+    // a path that is already longer than a known leaf can never match
+    if (leafDepth != -1 && depth >= leafDepth) { return false; }
+    if (node->right) { stack.push_back(make_pair(node->right, depth + 1)); }
+    if (node->left) { stack.push_back(make_pair(node->left, depth + 1)); }
+  }
+  return true;
 }
-
@@ -0,0 +1,174 @@
+#ifndef HASH_INDEX_H
+#define HASH_INDEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "key_hash.h"
+
+/**
+ * An open-addressing hash table of pointers to objects that carry their
+ * own keys (tree nodes), probed linearly. Each slot holds the mixed hash
+ * beside the pointer, so a lookup reads one run of slots, usually within
+ * a cache line, and dereferences only pointers whose hash matches: about
+ * one miss for the table and one for the object it finds.
+ *
+ * Removal shifts the rest of the run back instead of leaving tombstones,
+ * so probe runs never degrade. The table grows at 5/8 full.
+ */
+template <typename T>
+class HashIndex
+{
+public:
+    HashIndex();
+
+    // The item with this hash that match(item) accepts, or nullptr
+    template <typename Match>
+    T* find(uint64_t hash, const Match& match) const;
+    // item must not be in the table yet
+    void insert(uint64_t hash, T* item);
+    // Each returns false if item (compared by address) is not there
+    bool erase(uint64_t hash, const T* item);
+    bool replace(uint64_t hash, const T* from, T* to);
+    void clear();
+    // Room for count items without growing
+    void reserve(size_t count);
+    void swap(HashIndex& other);
+
+    size_t size() const;
+    size_t bytes() const;
+
+private:
+    struct Slot
+    {
+        uint64_t hash;  // mixed
+        T* item;        // nullptr if the slot is free
+    };
+
+    size_t slotOf(uint64_t mixed, const T* item) const;  // slots_.size() if absent
+    void rehash(size_t slotCount);
+
+    std::vector<Slot> slots_;
+    size_t mask_;
+    size_t size_;
+};
+
+template <typename T>
+HashIndex<T>::HashIndex() :
+    slots_(16, Slot()), mask_(15), size_(0)
+{
+}
+
+template <typename T>
+template <typename Match>
+T* HashIndex<T>::find(uint64_t hash, const Match& match) const
+{
+    uint64_t mixed = mixHash(hash);
+    for (size_t i = mixed & mask_; slots_[i].item != nullptr; i = (i + 1) & mask_) {
+        if (slots_[i].hash == mixed && match(slots_[i].item)) return slots_[i].item;
+    }
+    return nullptr;
+}
+
+template <typename T>
+void HashIndex<T>::insert(uint64_t hash, T* item)
+{
+    if (8 * (size_ + 1) > 5 * slots_.size()) rehash(2 * slots_.size());
+    uint64_t mixed = mixHash(hash);
+    size_t i = mixed & mask_;
+    while (slots_[i].item != nullptr) i = (i + 1) & mask_;
+    slots_[i].hash = mixed;
+    slots_[i].item = item;
+    ++size_;
+}
+
+/**
+ * Backward-shift deletion: every later entry of the run whose home slot
+ * is not between the hole and itself moves into the hole.
+ */
+template <typename T>
+bool HashIndex<T>::erase(uint64_t hash, const T* item)
+{
+    size_t hole = slotOf(mixHash(hash), item);
+    if (hole == slots_.size()) return false;
+    for (size_t j = (hole + 1) & mask_; slots_[j].item != nullptr; j = (j + 1) & mask_) {
+        size_t home = slots_[j].hash & mask_;
+        bool stays = (hole <= j) ? (hole < home && home <= j) : (hole < home || home <= j);
+        if (stays) continue;
+        slots_[hole] = slots_[j];
+        hole = j;
+    }
+    slots_[hole] = Slot();
+    --size_;
+    return true;
+}
+
+template <typename T>
+bool HashIndex<T>::replace(uint64_t hash, const T* from, T* to)
+{
+    size_t i = slotOf(mixHash(hash), from);
+    if (i == slots_.size()) return false;
+    slots_[i].item = to;
+    return true;
+}
+
+template <typename T>
+void HashIndex<T>::clear()
+{
+    std::vector<Slot>(16, Slot()).swap(slots_);
+    mask_ = 15;
+    size_ = 0;
+}
+
+template <typename T>
+void HashIndex<T>::reserve(size_t count)
+{
+    size_t slotCount = slots_.size();
+    while (5 * slotCount < 8 * count) slotCount *= 2;
+    if (slotCount != slots_.size()) rehash(slotCount);
+}
+
+template <typename T>
+void HashIndex<T>::swap(HashIndex& other)
+{
+    slots_.swap(other.slots_);
+    std::swap(mask_, other.mask_);
+    std::swap(size_, other.size_);
+}
+
+template <typename T>
+size_t HashIndex<T>::size() const
+{
+    return size_;
+}
+
+template <typename T>
+size_t HashIndex<T>::bytes() const
+{
+    return slots_.size() * sizeof(Slot);
+}
+
+template <typename T>
+size_t HashIndex<T>::slotOf(uint64_t mixed, const T* item) const
+{
+    for (size_t i = mixed & mask_; slots_[i].item != nullptr; i = (i + 1) & mask_) {
+        if (slots_[i].item == item) return i;
+    }
+    return slots_.size();
+}
+
+template <typename T>
+void HashIndex<T>::rehash(size_t slotCount)
+{
+    std::vector<Slot> old(slotCount, Slot());
+    old.swap(slots_);
+    mask_ = slotCount - 1;
+    for (size_t k = 0; k < old.size(); ++k) {
+        if (old[k].item == nullptr) continue;
+        size_t i = old[k].hash & mask_;
+        while (slots_[i].item != nullptr) i = (i + 1) & mask_;
+        slots_[i] = old[k];
+    }
+}
+
+#endif
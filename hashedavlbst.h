@@ -0,0 +1,308 @@
+#ifndef HASHEDAVLBST_H
+#define HASHEDAVLBST_H
+
+#include <iostream>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include <stdexcept>
+#include "avlbst.h"
+#include "hash_index.h"
+
+/**
+* An AVLTree with a hash index from keys to nodes beside it, for work
+* that is mostly exact-key lookups with the odd ordered scan. find(),
+* operator[], remove() and overwriting inserts go through the index:
+* about two cache misses (the slot run, then the node) instead of one per
+* level. Everything ordered (iterators, bounds, range erase, the
+* parallel walks) is AVLTree's.
+*
+* The index holds node pointers, which stay valid because the tree only
+* ever relinks nodes (nodeSwap included) and never moves items between
+* them. The one exception, compaction, updates the index as it moves
+* nodes. Hash must agree with Compare: keys Compare finds equivalent must
+* hash the same. The default hashes with keyHash().
+*/
+template <class Key, class Value, class Compare = std::less<Key>, class Hash = KeyHash<Key> >
+class HashedAVLTree : public AVLTree<Key, Value, Compare>
+{
+public:
+    explicit HashedAVLTree(const Compare& comp = Compare(), const Hash& hash = Hash());
+    HashedAVLTree(const HashedAVLTree& other);
+    HashedAVLTree(HashedAVLTree&& other);
+    HashedAVLTree& operator=(const HashedAVLTree& other);
+    HashedAVLTree& operator=(HashedAVLTree&& other);
+
+    virtual void insert(const std::pair<const Key, Value>& new_item);
+    virtual void remove(const Key& key);
+    virtual void clear();
+    // As AVLTree's, with the index patched for the keys in the batch only
+    virtual void applyBatch(const std::vector<BatchOp<Key, Value> >& sortedOps, unsigned int threads = 1);
+
+    // Items in the tree, in O(1)
+    size_t size() const;
+    // Memory taken by the index
+    size_t indexBytes() const;
+
+protected:
+    virtual Node<Key, Value>* internalFind(const Key& key) const;
+    virtual void eraseNode(Node<Key, Value>* node);
+    virtual size_t eraseSpan(Node<Key, Value>* first, Node<Key, Value>* last);
+    virtual void cloneNodes(const BinarySearchTree<Key, Value, Compare>& other, unsigned int threads);
+    virtual void swapExtra(BinarySearchTree<Key, Value, Compare>& other);
+    virtual void relocateNode(AVLNode<Key, Value>* node, AVLNode<Key, Value>* slot);
+    // buildFrom() indexes the tree it built
+    virtual void linkSorted(std::vector<std::pair<Key, Value> >& items, ThreadPool* pool, int forkDepth);
+
+    AVLNode<Key, Value>* indexFind(const Key& key) const;
+    void indexNode(AVLNode<Key, Value>* node);
+    void unindexNode(Node<Key, Value>* node);
+    // Refills the index from the tree in O(n)
+    void rebuildIndex();
+
+    Hash hash_;
+    HashIndex<AVLNode<Key, Value> > index_;
+};
+
+/*
+--------------------------------------------------
+Begin implementations for the HashedAVLTree class.
+--------------------------------------------------
+*/
+
+template<class Key, class Value, class Compare, class Hash>
+HashedAVLTree<Key, Value, Compare, Hash>::HashedAVLTree(const Compare& comp, const Hash& hash) :
+    AVLTree<Key, Value, Compare>(comp), hash_(hash)
+{
+}
+
+template<class Key, class Value, class Compare, class Hash>
+HashedAVLTree<Key, Value, Compare, Hash>::HashedAVLTree(const HashedAVLTree& other) :
+    AVLTree<Key, Value, Compare>(other), hash_(other.hash_)
+{
+    rebuildIndex();
+}
+
+template<class Key, class Value, class Compare, class Hash>
+HashedAVLTree<Key, Value, Compare, Hash>::HashedAVLTree(HashedAVLTree&& other) :
+    AVLTree<Key, Value, Compare>(std::move(other)), hash_(other.hash_)
+{
+    index_.swap(other.index_);
+}
+
+template<class Key, class Value, class Compare, class Hash>
+HashedAVLTree<Key, Value, Compare, Hash>&
+HashedAVLTree<Key, Value, Compare, Hash>::operator=(const HashedAVLTree& other)
+{
+    AVLTree<Key, Value, Compare>::operator=(other);
+    return *this;
+}
+
+template<class Key, class Value, class Compare, class Hash>
+HashedAVLTree<Key, Value, Compare, Hash>&
+HashedAVLTree<Key, Value, Compare, Hash>::operator=(HashedAVLTree&& other)
+{
+    AVLTree<Key, Value, Compare>::operator=(std::move(other));
+    return *this;
+}
+
+/**
+* Overwrites are settled by the index alone; new keys take AVLTree's
+* insert path and are indexed once their node exists.
+*/
+template<class Key, class Value, class Compare, class Hash>
+void HashedAVLTree<Key, Value, Compare, Hash>::insert(const std::pair<const Key, Value>& new_item)
+{
+    BST_STAT(this->counters_.begin(TREE_OP_INSERT));
+    BST_TRACE_SCOPE(trace, TRACE_INSERT, &new_item.first);
+    BST_RECORD_OP(TRACE_INSERT, &new_item.first);
+    AVLNode<Key, Value>* existing = indexFind(new_item.first);
+    if (existing != nullptr) {
+        BST_TRACE_AT(trace, existing, 0);
+        existing->setValue(new_item.second);
+        return;
+    }
+    this->maintainFilter();
+
+    AVLNode<Key, Value>* current = static_cast<AVLNode<Key, Value>*>(this->root_);
+    AVLNode<Key, Value>* parent = nullptr;
+    bool left = false;
+    while (current != nullptr) {
+        parent = current;
+        BST_STAT(++this->counters_.comparisons[TREE_OP_INSERT]);
+        left = this->comp_(new_item.first, current->getKey());
+        current = left ? current->getLeft() : current->getRight();
+    }
+    AVLNode<Key, Value>* newNode =
+        this->template createNode<AVLNode<Key, Value> >(new_item.first, new_item.second, parent);
+    BST_TRACE_AT(trace, newNode, 0);
+    indexNode(newNode);
+    if (parent == nullptr) {
+        this->root_ = newNode;
+        return;
+    }
+    if (left) {
+        parent->setLeft(newNode);
+    } else {
+        parent->setRight(newNode);
+    }
+    this->adjustAfterInsert(newNode);
+}
+
+template<class Key, class Value, class Compare, class Hash>
+void HashedAVLTree<Key, Value, Compare, Hash>::remove(const Key& key)
+{
+    BST_STAT(this->counters_.begin(TREE_OP_REMOVE));
+    BST_TRACE_SCOPE(trace, TRACE_REMOVE, &key);
+    BST_RECORD_OP(TRACE_REMOVE, &key);
+    AVLNode<Key, Value>* node = indexFind(key);
+    BST_TRACE_AT(trace, node, 0);
+    if (node == nullptr) return;
+    BST_TRACE_END(trace);  // key may refer into node
+    eraseNode(node);
+}
+
+template<class Key, class Value, class Compare, class Hash>
+void HashedAVLTree<Key, Value, Compare, Hash>::clear()
+{
+    BinarySearchTree<Key, Value, Compare>::clear();
+    index_.clear();
+}
+
+/**
+* Removed keys leave the index before AVLTree frees their nodes, and
+* upserted ones are looked up after. Nodes the batch keeps are relinked,
+* not reallocated, so their entries stay valid: O(k log n) in all.
+*/
+template<class Key, class Value, class Compare, class Hash>
+void HashedAVLTree<Key, Value, Compare, Hash>::applyBatch(const std::vector<BatchOp<Key, Value> >& sortedOps,
+                                                          unsigned int threads)
+{
+    for (size_t i = 1; i < sortedOps.size(); ++i) {
+        if (this->comp_(sortedOps[i].key, sortedOps[i - 1].key)) {
+            throw std::invalid_argument("applyBatch: ops are not sorted by key");
+        }
+    }
+    for (size_t i = 0; i < sortedOps.size(); ++i) {
+        if (sortedOps[i].kind != BATCH_REMOVE) continue;
+        AVLNode<Key, Value>* node = indexFind(sortedOps[i].key);
+        if (node != nullptr) unindexNode(node);
+    }
+    AVLTree<Key, Value, Compare>::applyBatch(sortedOps, threads);
+    for (size_t i = 0; i < sortedOps.size(); ++i) {
+        // the last op on each key decides
+        if (i + 1 < sortedOps.size() && !this->comp_(sortedOps[i].key, sortedOps[i + 1].key)) continue;
+        if (sortedOps[i].kind != BATCH_UPSERT || indexFind(sortedOps[i].key) != nullptr) continue;
+        indexNode(static_cast<AVLNode<Key, Value>*>(this->findNode(sortedOps[i].key)));
+    }
+}
+
+template<class Key, class Value, class Compare, class Hash>
+size_t HashedAVLTree<Key, Value, Compare, Hash>::size() const
+{
+    return index_.size();
+}
+
+template<class Key, class Value, class Compare, class Hash>
+size_t HashedAVLTree<Key, Value, Compare, Hash>::indexBytes() const
+{
+    return index_.bytes();
+}
+
+template<class Key, class Value, class Compare, class Hash>
+Node<Key, Value>* HashedAVLTree<Key, Value, Compare, Hash>::internalFind(const Key& key) const
+{
+    return indexFind(key);
+}
+
+template<class Key, class Value, class Compare, class Hash>
+void HashedAVLTree<Key, Value, Compare, Hash>::eraseNode(Node<Key, Value>* node)
+{
+    unindexNode(node);
+    AVLTree<Key, Value, Compare>::eraseNode(node);
+}
+
+template<class Key, class Value, class Compare, class Hash>
+size_t HashedAVLTree<Key, Value, Compare, Hash>::eraseSpan(Node<Key, Value>* first, Node<Key, Value>* last)
+{
+    for (Node<Key, Value>* n = first; n != last; n = this->successor(n)) unindexNode(n);
+    return AVLTree<Key, Value, Compare>::eraseSpan(first, last);
+}
+
+template<class Key, class Value, class Compare, class Hash>
+void HashedAVLTree<Key, Value, Compare, Hash>::cloneNodes(const BinarySearchTree<Key, Value, Compare>& other,
+                                                          unsigned int threads)
+{
+    AVLTree<Key, Value, Compare>::cloneNodes(other, threads);
+    hash_ = static_cast<const HashedAVLTree&>(other).hash_;
+    rebuildIndex();
+}
+
+template<class Key, class Value, class Compare, class Hash>
+void HashedAVLTree<Key, Value, Compare, Hash>::swapExtra(BinarySearchTree<Key, Value, Compare>& other)
+{
+    AVLTree<Key, Value, Compare>::swapExtra(other);
+    HashedAVLTree& rhs = static_cast<HashedAVLTree&>(other);
+    std::swap(hash_, rhs.hash_);
+    index_.swap(rhs.index_);
+}
+
+/**
+* The key is hashed before AVLTree frees node; the copy in slot has the
+* same key, so its entry is repointed in place.
+*/
+template<class Key, class Value, class Compare, class Hash>
+void HashedAVLTree<Key, Value, Compare, Hash>::relocateNode(AVLNode<Key, Value>* node, AVLNode<Key, Value>* slot)
+{
+    uint64_t hash = hash_(node->getKey());
+    AVLTree<Key, Value, Compare>::relocateNode(node, slot);
+    index_.replace(hash, node, slot);
+}
+
+template<class Key, class Value, class Compare, class Hash>
+void HashedAVLTree<Key, Value, Compare, Hash>::linkSorted(std::vector<std::pair<Key, Value> >& items,
+                                                          ThreadPool* pool, int forkDepth)
+{
+    AVLTree<Key, Value, Compare>::linkSorted(items, pool, forkDepth);
+    rebuildIndex();
+}
+
+template<class Key, class Value, class Compare, class Hash>
+AVLNode<Key, Value>* HashedAVLTree<Key, Value, Compare, Hash>::indexFind(const Key& key) const
+{
+    const Compare& comp = this->comp_;
+    return index_.find(hash_(key), [&key, &comp](const AVLNode<Key, Value>* node) {
+        return !comp(key, node->getKey()) && !comp(node->getKey(), key);
+    });
+}
+
+template<class Key, class Value, class Compare, class Hash>
+void HashedAVLTree<Key, Value, Compare, Hash>::indexNode(AVLNode<Key, Value>* node)
+{
+    index_.insert(hash_(node->getKey()), node);
+}
+
+template<class Key, class Value, class Compare, class Hash>
+void HashedAVLTree<Key, Value, Compare, Hash>::unindexNode(Node<Key, Value>* node)
+{
+    index_.erase(hash_(node->getKey()), static_cast<AVLNode<Key, Value>*>(node));
+}
+
+template<class Key, class Value, class Compare, class Hash>
+void HashedAVLTree<Key, Value, Compare, Hash>::rebuildIndex()
+{
+    index_.clear();
+    index_.reserve(this->countNodes(this->root_));
+    for (Node<Key, Value>* n = this->getSmallestNode(); n != nullptr; n = this->successor(n)) {
+        indexNode(static_cast<AVLNode<Key, Value>*>(n));
+    }
+}
+
+/*
+------------------------------------------------
+End implementations for the HashedAVLTree class.
+------------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,87 @@
+#ifndef KEY_HASH_H
+#define KEY_HASH_H
+
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <streambuf>
+
+/**
+ * keyHash(key) is a 64-bit hash of any tree key: std::hash where the key
+ * type has one, else FNV-1a of its operator<< text (which every key type
+ * here has, for print()). Used by operation recording and key filters.
+ */
+
+namespace key_hash_detail {
+
+template <typename Key>
+auto hashOf(const Key& key, int) -> decltype((uint64_t)std::hash<Key>()(key))
+{
+    return (uint64_t)std::hash<Key>()(key);
+}
+
+/**
+ * A sink that folds whatever is written to it into an FNV-1a hash.
+ * (Streaming into it rather than into an ostringstream keeps <sstream>
+ * out of bst.h's includes.)
+ */
+class HashingBuf : public std::streambuf
+{
+public:
+    HashingBuf() : hash_(0xcbf29ce484222325ULL) {}
+
+    uint64_t hash() const { return hash_; }
+
+protected:
+    int_type overflow(int_type c)
+    {
+        if (!traits_type::eq_int_type(c, traits_type::eof())) {
+            hash_ = (hash_ ^ (unsigned char)traits_type::to_char_type(c)) * 0x100000001b3ULL;
+        }
+        return traits_type::not_eof(c);
+    }
+
+private:
+    uint64_t hash_;
+};
+
+// for key types std::hash does not cover
+template <typename Key>
+uint64_t hashOf(const Key& key, long)
+{
+    HashingBuf buf;
+    std::ostream os(&buf);
+    os << key;
+    return buf.hash();
+}
+
+} // namespace key_hash_detail
+
+template <typename Key>
+uint64_t keyHash(const Key& key)
+{
+    return key_hash_detail::hashOf(key, 0);
+}
+
+/**
+ * keyHash() as a function object, for templates that take a hasher.
+ */
+template <typename Key>
+struct KeyHash
+{
+    uint64_t operator()(const Key& key) const { return keyHash(key); }
+};
+
+/**
+ * The splitmix64 finalizer, for spreading hashes whose low bits or small
+ * values carry all the information (std::hash of an int is the int).
+ */
+inline uint64_t mixHash(uint64_t h)
+{
+    h += 0x9e3779b97f4a7c15ULL;
+    h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+    return h ^ (h >> 31);
+}
+
+#endif
@@ -0,0 +1,661 @@
+#ifndef LAZYAVLBST_H
+#define LAZYAVLBST_H
+
+#include <iostream>
+#include <cstddef>
+#include <utility>
+#include <vector>
+#include <stdexcept>
+#include "avlbst.h"
+
+/**
+* A range update for LazyAVLTree that adds delta to every value. Any Tag
+* type works if it is default-constructible and has
+*   void apply(Value& value) const;       // value = f(value)
+*   void compose(const Tag& later);       // *this = later after *this
+*/
+template <typename T>
+struct AddUpdate
+{
+    AddUpdate() : delta() {}
+    explicit AddUpdate(const T& d) : delta(d) {}
+
+    void apply(T& value) const { value += delta; }
+    void compose(const AddUpdate& later) { delta += later.delta; }
+
+    T delta;
+};
+
+/**
+* An AVLNode with an update pending for its children's subtrees. The
+* node's own value already has it applied.
+*/
+template <typename Key, typename Value, typename Tag>
+class LazyAVLNode : public AVLNode<Key, Value>
+{
+public:
+    LazyAVLNode(const Key& key, const Value& value, LazyAVLNode<Key, Value, Tag>* parent);
+    virtual ~LazyAVLNode();
+    virtual size_t footprint() const override;
+
+    // Applies update to the value and queues it for the children
+    void addTag(const Tag& update);
+    // Hands the queued update on to the children
+    void pushDown();
+    bool hasTag() const;
+
+    virtual LazyAVLNode<Key, Value, Tag>* getParent() const override;
+    virtual LazyAVLNode<Key, Value, Tag>* getLeft() const override;
+    virtual LazyAVLNode<Key, Value, Tag>* getRight() const override;
+
+protected:
+    Tag tag_;
+    bool tagged_;
+};
+
+/*
+  ----------------------------------------------------
+  Begin implementations for the LazyAVLNode class.
+  ----------------------------------------------------
+*/
+
+template<class Key, class Value, class Tag>
+LazyAVLNode<Key, Value, Tag>::LazyAVLNode(const Key& key, const Value& value,
+                                          LazyAVLNode<Key, Value, Tag>* parent) :
+    AVLNode<Key, Value>(key, value, parent), tag_(), tagged_(false)
+{
+}
+
+template<class Key, class Value, class Tag>
+LazyAVLNode<Key, Value, Tag>::~LazyAVLNode()
+{
+}
+
+template<class Key, class Value, class Tag>
+size_t LazyAVLNode<Key, Value, Tag>::footprint() const
+{
+    return sizeof(*this);
+}
+
+template<class Key, class Value, class Tag>
+void LazyAVLNode<Key, Value, Tag>::addTag(const Tag& update)
+{
+    update.apply(this->getValue());
+    if (tagged_) {
+        tag_.compose(update);
+    } else {
+        tag_ = update;
+        tagged_ = true;
+    }
+}
+
+template<class Key, class Value, class Tag>
+void LazyAVLNode<Key, Value, Tag>::pushDown()
+{
+    if (!tagged_) return;
+    if (getLeft() != nullptr) getLeft()->addTag(tag_);
+    if (getRight() != nullptr) getRight()->addTag(tag_);
+    tag_ = Tag();
+    tagged_ = false;
+}
+
+template<class Key, class Value, class Tag>
+bool LazyAVLNode<Key, Value, Tag>::hasTag() const
+{
+    return tagged_;
+}
+
+template<class Key, class Value, class Tag>
+LazyAVLNode<Key, Value, Tag>* LazyAVLNode<Key, Value, Tag>::getParent() const
+{
+    return static_cast<LazyAVLNode<Key, Value, Tag>*>(this->parent_);
+}
+
+template<class Key, class Value, class Tag>
+LazyAVLNode<Key, Value, Tag>* LazyAVLNode<Key, Value, Tag>::getLeft() const
+{
+    return static_cast<LazyAVLNode<Key, Value, Tag>*>(this->left_);
+}
+
+template<class Key, class Value, class Tag>
+LazyAVLNode<Key, Value, Tag>* LazyAVLNode<Key, Value, Tag>::getRight() const
+{
+    return static_cast<LazyAVLNode<Key, Value, Tag>*>(this->right_);
+}
+
+/*
+  --------------------------------------------------
+  End implementations for the LazyAVLNode class.
+  --------------------------------------------------
+*/
+
+/**
+* An AVL tree that applies an update to every value in a key range in
+* O(log n): updateRange() applies it to the O(log n) nodes on the two
+* boundary paths and leaves it as a tag on the O(log n) subtrees between
+* them. Tags are pushed one level down whenever something passes through
+* a node (a descent, a rotation, a nodeSwap), so every node the tree
+* hands out has its value up to date. That includes const lookups, which
+* therefore write to the nodes and must not run concurrently.
+*
+* Iterators stay correct while the tree is only read; after an update,
+* take new ones. Cursor and the lookups inherited from BinarySearchTree
+* push down the path to the node they return, and the parallel walks
+* flush() first, as they are O(n) anyway. applyBatch() and range erases
+* push down each node their splits and joins open, so they keep their
+* AVLTree costs. What reads the nodes directly (print(), exports) sees
+* stored values, so call flush() before it. Compaction would copy nodes
+* into AVLNode slots; compact() and beginCompact() throw
+* std::logic_error.
+*/
+template <class Key, class Value, class Tag = AddUpdate<Value>, class Compare = std::less<Key> >
+class LazyAVLTree : public AVLTree<Key, Value, Compare>
+{
+public:
+    /**
+    * Pushes tags down ahead of itself, so each item it reaches is current.
+    */
+    class iterator : public BinarySearchTree<Key, Value, Compare>::iterator
+    {
+    public:
+        iterator();
+        iterator& operator++();
+
+    private:
+        friend class LazyAVLTree;
+        explicit iterator(Node<Key, Value>* node);
+    };
+
+    explicit LazyAVLTree(const Compare& comp = Compare());
+    LazyAVLTree(const LazyAVLTree& other);
+    LazyAVLTree(LazyAVLTree&& other);
+    LazyAVLTree& operator=(const LazyAVLTree& other);
+    LazyAVLTree& operator=(LazyAVLTree&& other);
+
+    virtual void insert(const std::pair<const Key, Value>& new_item);
+    virtual void remove(const Key& key);
+    // Applies update to the value of every item with lo <= key < hi
+    void updateRange(const Key& lo, const Key& hi, const Tag& update);
+    // Pushes every tag down to the leaves, in O(n)
+    void flush();
+
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const Key& key) const;
+    iterator find_from(iterator finger, const Key& key) const;
+    iterator lower_bound(const Key& key) const;
+    iterator upper_bound(const Key& key) const;
+    iterator erase(iterator pos);
+    iterator erase(iterator first, iterator last);
+
+protected:
+    typedef LazyAVLNode<Key, Value, Tag> LazyNode;
+
+    virtual Node<Key, Value>* internalFind(const Key& key) const;
+    virtual void nodeSwap(AVLNode<Key, Value>* n1, AVLNode<Key, Value>* n2);
+    virtual void rotateLeft(AVLNode<Key, Value>* node);
+    virtual void rotateRight(AVLNode<Key, Value>* node);
+    virtual void eraseNode(Node<Key, Value>* node);
+    virtual Node<Key, Value>* settlePath(Node<Key, Value>* node) const;
+    virtual void settleAll() const;
+    virtual void settleNode(AVLNode<Key, Value>* node);
+    virtual void cloneNodes(const BinarySearchTree<Key, Value, Compare>& other, unsigned int threads);
+    virtual AVLNode<Key, Value>* createBatchNode(const Key& key, const Value& value);
+    virtual void linkSorted(std::vector<std::pair<Key, Value> >& items, ThreadPool* pool, int forkDepth);
+
+    // Pushes down every tag from the root to node, node's own included,
+    // and returns node
+    static Node<Key, Value>* pushPath(Node<Key, Value>* node);
+    static void flushSubtree(LazyNode* node);
+
+private:
+    virtual void compact(NodeLayout layout = LAYOUT_IN_ORDER);
+    virtual void beginCompact(NodeLayout layout = LAYOUT_IN_ORDER);
+    using AVLTree<Key, Value, Compare>::compactStep;
+};
+
+/*
+----------------------------------------------------------
+Begin implementations for the LazyAVLTree::iterator class.
+----------------------------------------------------------
+*/
+
+template<class Key, class Value, class Tag, class Compare>
+LazyAVLTree<Key, Value, Tag, Compare>::iterator::iterator() :
+    BinarySearchTree<Key, Value, Compare>::iterator()
+{
+}
+
+template<class Key, class Value, class Tag, class Compare>
+LazyAVLTree<Key, Value, Tag, Compare>::iterator::iterator(Node<Key, Value>* node) :
+    BinarySearchTree<Key, Value, Compare>::iterator(node)
+{
+}
+
+/**
+* The base iterator's step, pushing down at every node it leaves
+* downwards. Going up needs nothing: the nodes above were pushed on the
+* way down to this one.
+*/
+template<class Key, class Value, class Tag, class Compare>
+typename LazyAVLTree<Key, Value, Tag, Compare>::iterator&
+LazyAVLTree<Key, Value, Tag, Compare>::iterator::operator++()
+{
+    LazyNode* current = static_cast<LazyNode*>(this->current_);
+    if (current == nullptr) return *this;
+    if (current->getRight() != nullptr) {
+        current->pushDown();
+        current = current->getRight();
+        while (current->getLeft() != nullptr) {
+            current->pushDown();
+            current = current->getLeft();
+        }
+    } else {
+        LazyNode* parent = current->getParent();
+        while (parent != nullptr && current == parent->getRight()) {
+            current = parent;
+            parent = parent->getParent();
+        }
+        current = parent;
+    }
+    this->current_ = current;
+    return *this;
+}
+
+/*
+--------------------------------------------------------
+End implementations for the LazyAVLTree::iterator class.
+--------------------------------------------------------
+*/
+
+/*
+------------------------------------------------
+Begin implementations for the LazyAVLTree class.
+------------------------------------------------
+*/
+
+template<class Key, class Value, class Tag, class Compare>
+LazyAVLTree<Key, Value, Tag, Compare>::LazyAVLTree(const Compare& comp) :
+    AVLTree<Key, Value, Compare>(comp)
+{
+}
+
+/**
+* Not AVLTree's copy constructor, which would clone the nodes as plain
+* AVLNodes.
+*/
+template<class Key, class Value, class Tag, class Compare>
+LazyAVLTree<Key, Value, Tag, Compare>::LazyAVLTree(const LazyAVLTree& other) :
+    AVLTree<Key, Value, Compare>(other.comp_)
+{
+    this->template cloneAs<LazyNode>(other, 1);
+}
+
+template<class Key, class Value, class Tag, class Compare>
+LazyAVLTree<Key, Value, Tag, Compare>::LazyAVLTree(LazyAVLTree&& other) :
+    AVLTree<Key, Value, Compare>(std::move(other))
+{
+}
+
+template<class Key, class Value, class Tag, class Compare>
+LazyAVLTree<Key, Value, Tag, Compare>&
+LazyAVLTree<Key, Value, Tag, Compare>::operator=(const LazyAVLTree& other)
+{
+    AVLTree<Key, Value, Compare>::operator=(other);
+    return *this;
+}
+
+template<class Key, class Value, class Tag, class Compare>
+LazyAVLTree<Key, Value, Tag, Compare>&
+LazyAVLTree<Key, Value, Tag, Compare>::operator=(LazyAVLTree&& other)
+{
+    AVLTree<Key, Value, Compare>::operator=(std::move(other));
+    return *this;
+}
+
+/**
+* AVLTree::insert with a LazyAVLNode and the path pushed down, so that
+* the rotations after it start from current nodes.
+*/
+template<class Key, class Value, class Tag, class Compare>
+void LazyAVLTree<Key, Value, Tag, Compare>::insert(const std::pair<const Key, Value>& new_item)
+{
+    BST_STAT(this->counters_.begin(TREE_OP_INSERT));
+    BST_TRACE_SCOPE(trace, TRACE_INSERT, &new_item.first);
+    BST_RECORD_OP(TRACE_INSERT, &new_item.first);
+    this->maintainFilter();
+    LazyNode* current = static_cast<LazyNode*>(this->root_);
+    LazyNode* parent = nullptr;
+    LazyNode* candidate = nullptr;  // last node we went right at
+    bool left = false;
+    while (current != nullptr) {
+        current->pushDown();
+        parent = current;
+        BST_STAT(++this->counters_.comparisons[TREE_OP_INSERT]);
+        left = this->comp_(new_item.first, current->getKey());
+        if (left) {
+            current = current->getLeft();
+        } else {
+            candidate = current;
+            current = current->getRight();
+        }
+    }
+
+    BST_STAT(if (candidate != nullptr) ++this->counters_.comparisons[TREE_OP_INSERT]);
+    if (candidate != nullptr && !this->comp_(candidate->getKey(), new_item.first)) {
+        candidate->setValue(new_item.second);
+        return;
+    }
+
+    LazyNode* newNode = this->template createNode<LazyNode>(new_item.first, new_item.second, parent);
+    BST_TRACE_AT(trace, newNode, 0);
+    if (parent == nullptr) {
+        this->root_ = newNode;
+        return;
+    }
+    if (left) {
+        parent->setLeft(newNode);
+    } else {
+        parent->setRight(newNode);
+    }
+    this->adjustAfterInsert(newNode);
+}
+
+/**
+* The lookup pushes the path down; the node's own tag goes to whichever
+* child takes its place.
+*/
+template<class Key, class Value, class Tag, class Compare>
+void LazyAVLTree<Key, Value, Tag, Compare>::remove(const Key& key)
+{
+    BST_STAT(this->counters_.begin(TREE_OP_REMOVE));
+    BST_TRACE_SCOPE(trace, TRACE_REMOVE, &key);
+    BST_RECORD_OP(TRACE_REMOVE, &key);
+    LazyNode* node = static_cast<LazyNode*>(internalFind(key));
+    BST_TRACE_AT(trace, node, 0);
+    if (node == nullptr) return;
+    BST_TRACE_END(trace);  // key may refer into node
+    node->pushDown();
+    AVLTree<Key, Value, Compare>::eraseNode(node);
+}
+
+/**
+* Descends to the first node inside [lo, hi), where the paths to lo and
+* hi part. From there, every node on the path to lo that is not below lo
+* is in the range along with its whole right subtree, and likewise on
+* the path to hi for the left subtrees; those subtrees get a tag.
+*/
+template<class Key, class Value, class Tag, class Compare>
+void LazyAVLTree<Key, Value, Tag, Compare>::updateRange(const Key& lo, const Key& hi, const Tag& update)
+{
+    if (!this->comp_(lo, hi)) return;
+    LazyNode* split = static_cast<LazyNode*>(this->root_);
+    while (split != nullptr) {
+        split->pushDown();
+        if (this->comp_(split->getKey(), lo)) {
+            split = split->getRight();
+        } else if (!this->comp_(split->getKey(), hi)) {
+            split = split->getLeft();
+        } else {
+            break;
+        }
+    }
+    if (split == nullptr) return;
+    update.apply(split->getValue());
+
+    for (LazyNode* node = split->getLeft(); node != nullptr; ) {
+        node->pushDown();
+        if (this->comp_(node->getKey(), lo)) {
+            node = node->getRight();
+        } else {
+            update.apply(node->getValue());
+            if (node->getRight() != nullptr) node->getRight()->addTag(update);
+            node = node->getLeft();
+        }
+    }
+    for (LazyNode* node = split->getRight(); node != nullptr; ) {
+        node->pushDown();
+        if (!this->comp_(node->getKey(), hi)) {
+            node = node->getLeft();
+        } else {
+            update.apply(node->getValue());
+            if (node->getLeft() != nullptr) node->getLeft()->addTag(update);
+            node = node->getRight();
+        }
+    }
+}
+
+template<class Key, class Value, class Tag, class Compare>
+void LazyAVLTree<Key, Value, Tag, Compare>::flush()
+{
+    flushSubtree(static_cast<LazyNode*>(this->root_));
+}
+
+template<class Key, class Value, class Tag, class Compare>
+typename LazyAVLTree<Key, Value, Tag, Compare>::iterator
+LazyAVLTree<Key, Value, Tag, Compare>::begin() const
+{
+    return iterator(pushPath(this->getSmallestNode()));
+}
+
+template<class Key, class Value, class Tag, class Compare>
+typename LazyAVLTree<Key, Value, Tag, Compare>::iterator
+LazyAVLTree<Key, Value, Tag, Compare>::end() const
+{
+    return iterator();
+}
+
+template<class Key, class Value, class Tag, class Compare>
+typename LazyAVLTree<Key, Value, Tag, Compare>::iterator
+LazyAVLTree<Key, Value, Tag, Compare>::find(const Key& key) const
+{
+    BST_STAT(this->counters_.begin(TREE_OP_FIND));
+    BST_TRACE_SCOPE(trace, TRACE_FIND, &key);
+    BST_RECORD_OP(TRACE_FIND, &key);
+    Node<Key, Value>* found = internalFind(key);
+    BST_TRACE_AT(trace, found, 0);
+    return iterator(found);
+}
+
+/**
+* The finger only shortens the search; the path above the result still
+* has to be pushed down, so this is O(log n) whatever the distance.
+*/
+template<class Key, class Value, class Tag, class Compare>
+typename LazyAVLTree<Key, Value, Tag, Compare>::iterator
+LazyAVLTree<Key, Value, Tag, Compare>::find_from(iterator finger, const Key& key) const
+{
+    BST_STAT(this->counters_.begin(TREE_OP_FIND));
+    Node<Key, Value>* found = this->filterRejects(key) ? nullptr : this->lowerBoundFrom(finger.current_, key);
+    if (found != nullptr && this->comp_(key, found->getKey())) found = nullptr;
+    return iterator(pushPath(found));
+}
+
+template<class Key, class Value, class Tag, class Compare>
+typename LazyAVLTree<Key, Value, Tag, Compare>::iterator
+LazyAVLTree<Key, Value, Tag, Compare>::lower_bound(const Key& key) const
+{
+    BST_STAT(this->counters_.begin(TREE_OP_FIND));
+    return iterator(pushPath(this->lowerBoundNode(key)));
+}
+
+template<class Key, class Value, class Tag, class Compare>
+typename LazyAVLTree<Key, Value, Tag, Compare>::iterator
+LazyAVLTree<Key, Value, Tag, Compare>::upper_bound(const Key& key) const
+{
+    BST_STAT(this->counters_.begin(TREE_OP_FIND));
+    return iterator(pushPath(this->upperBoundNode(key)));
+}
+
+/**
+* The successor is found before the node goes, and pushed down to after,
+* since the removal may have rotated new nodes above it.
+*/
+template<class Key, class Value, class Tag, class Compare>
+typename LazyAVLTree<Key, Value, Tag, Compare>::iterator
+LazyAVLTree<Key, Value, Tag, Compare>::erase(iterator pos)
+{
+    BST_STAT(this->counters_.begin(TREE_OP_REMOVE));
+    BST_TRACE_SCOPE(trace, TRACE_REMOVE, NULL);  // the key lives in the node that goes
+    BST_RECORD_OP(TRACE_REMOVE, &pos->first);
+    Node<Key, Value>* next = this->successor(pos.current_);
+    eraseNode(pos.current_);
+    return iterator(pushPath(next));
+}
+
+template<class Key, class Value, class Tag, class Compare>
+typename LazyAVLTree<Key, Value, Tag, Compare>::iterator
+LazyAVLTree<Key, Value, Tag, Compare>::erase(iterator first, iterator last)
+{
+    BST_STAT(this->counters_.begin(TREE_OP_REMOVE));
+    BST_TRACE_SCOPE(trace, TRACE_REMOVE, NULL);
+    BST_RECORD_SPAN(TRACE_REMOVE, first.current_, last.current_);
+    this->eraseSpan(first.current_, last.current_);
+    return iterator(pushPath(last.current_));
+}
+
+/**
+* BinarySearchTree::internalFind with every node on the way pushed down.
+*/
+template<class Key, class Value, class Tag, class Compare>
+Node<Key, Value>* LazyAVLTree<Key, Value, Tag, Compare>::internalFind(const Key& key) const
+{
+    if (this->filterRejects(key)) return nullptr;
+    LazyNode* current = static_cast<LazyNode*>(this->root_);
+    LazyNode* candidate = nullptr;  // last node we went right at
+    while (current != nullptr) {
+        current->pushDown();
+        BST_STAT(++this->counters_.comparisons[this->counters_.current]);
+        if (this->comp_(key, current->getKey())) {
+            current = current->getLeft();
+        } else {
+            candidate = current;
+            current = current->getRight();
+        }
+    }
+    BST_STAT(if (candidate != nullptr) ++this->counters_.comparisons[this->counters_.current]);
+    if (candidate != nullptr && this->comp_(candidate->getKey(), key)) return nullptr;
+    return candidate;
+}
+
+/**
+* Both nodes are pushed down first, so that neither carries a tag meant
+* for the other's subtrees.
+*/
+template<class Key, class Value, class Tag, class Compare>
+void LazyAVLTree<Key, Value, Tag, Compare>::nodeSwap(AVLNode<Key, Value>* n1, AVLNode<Key, Value>* n2)
+{
+    pushPath(n1);
+    pushPath(n2);
+    AVLTree<Key, Value, Compare>::nodeSwap(n1, n2);
+}
+
+/**
+* The node and the child rising over it are pushed down, as the subtrees
+* below them change hands.
+*/
+template<class Key, class Value, class Tag, class Compare>
+void LazyAVLTree<Key, Value, Tag, Compare>::rotateLeft(AVLNode<Key, Value>* node)
+{
+    static_cast<LazyNode*>(node)->pushDown();
+    static_cast<LazyNode*>(node->getRight())->pushDown();
+    AVLTree<Key, Value, Compare>::rotateLeft(node);
+}
+
+template<class Key, class Value, class Tag, class Compare>
+void LazyAVLTree<Key, Value, Tag, Compare>::rotateRight(AVLNode<Key, Value>* node)
+{
+    static_cast<LazyNode*>(node)->pushDown();
+    static_cast<LazyNode*>(node->getLeft())->pushDown();
+    AVLTree<Key, Value, Compare>::rotateRight(node);
+}
+
+template<class Key, class Value, class Tag, class Compare>
+void LazyAVLTree<Key, Value, Tag, Compare>::eraseNode(Node<Key, Value>* node)
+{
+    pushPath(node);
+    AVLTree<Key, Value, Compare>::eraseNode(node);
+}
+
+template<class Key, class Value, class Tag, class Compare>
+Node<Key, Value>* LazyAVLTree<Key, Value, Tag, Compare>::settlePath(Node<Key, Value>* node) const
+{
+    return pushPath(node);
+}
+
+template<class Key, class Value, class Tag, class Compare>
+void LazyAVLTree<Key, Value, Tag, Compare>::settleAll() const
+{
+    flushSubtree(static_cast<LazyNode*>(this->root_));
+}
+
+/**
+* Split and join open nodes from the top down, so pushing each one as it
+* is opened keeps every tag above the subtrees it was meant for.
+*/
+template<class Key, class Value, class Tag, class Compare>
+void LazyAVLTree<Key, Value, Tag, Compare>::settleNode(AVLNode<Key, Value>* node)
+{
+    static_cast<LazyNode*>(node)->pushDown();
+}
+
+template<class Key, class Value, class Tag, class Compare>
+void LazyAVLTree<Key, Value, Tag, Compare>::cloneNodes(const BinarySearchTree<Key, Value, Compare>& other,
+                                                       unsigned int threads)
+{
+    this->template cloneAs<LazyNode>(other, threads);
+}
+
+template<class Key, class Value, class Tag, class Compare>
+AVLNode<Key, Value>* LazyAVLTree<Key, Value, Tag, Compare>::createBatchNode(const Key& key, const Value& value)
+{
+    return this->template createNode<LazyNode>(key, value, nullptr);
+}
+
+template<class Key, class Value, class Tag, class Compare>
+void LazyAVLTree<Key, Value, Tag, Compare>::linkSorted(std::vector<std::pair<Key, Value> >& items,
+                                                       ThreadPool* pool, int forkDepth)
+{
+    this->template linkSortedAs<LazyNode>(items, pool, forkDepth);
+}
+
+template<class Key, class Value, class Tag, class Compare>
+void LazyAVLTree<Key, Value, Tag, Compare>::compact(NodeLayout)
+{
+    throw std::logic_error("compact: LazyAVLTree nodes cannot be moved into AVLNode slots");
+}
+
+template<class Key, class Value, class Tag, class Compare>
+void LazyAVLTree<Key, Value, Tag, Compare>::beginCompact(NodeLayout)
+{
+    throw std::logic_error("beginCompact: LazyAVLTree nodes cannot be moved into AVLNode slots");
+}
+
+template<class Key, class Value, class Tag, class Compare>
+Node<Key, Value>* LazyAVLTree<Key, Value, Tag, Compare>::pushPath(Node<Key, Value>* node)
+{
+    if (node == nullptr) return nullptr;
+    pushPath(node->getParent());
+    static_cast<LazyNode*>(node)->pushDown();
+    return node;
+}
+
+/**
+* Recursive, but only as deep as the tree is tall.
+*/
+template<class Key, class Value, class Tag, class Compare>
+void LazyAVLTree<Key, Value, Tag, Compare>::flushSubtree(LazyNode* node)
+{
+    if (node == nullptr) return;
+    node->pushDown();
+    flushSubtree(node->getLeft());
+    flushSubtree(node->getRight());
+}
+
+/*
+----------------------------------------------
+End implementations for the LazyAVLTree class.
+----------------------------------------------
+*/
+
+#endif
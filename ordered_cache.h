@@ -0,0 +1,357 @@
+#ifndef ORDERED_CACHE_H
+#define ORDERED_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <chrono>
+#include <iostream>
+#include <utility>
+#include "avlbst.h"
+
+/**
+* Which entry a full OrderedCache evicts: the least recently used one
+* (inserted, updated or found) or the one inserted or updated longest ago.
+*/
+enum EvictionPolicy { EVICT_LRU, EVICT_FIFO };
+
+/**
+* Event counts of an OrderedCache since it was created.
+*/
+struct CacheStats
+{
+    size_t hits;
+    size_t misses;
+    size_t evictions;    // removed to make room
+    size_t expirations;  // removed because their TTL ran out
+};
+
+/**
+* A key-ordered cache with a cap on entries and/or bytes and a TTL per
+* entry. Entries live in an AVLTree by key, so they can be scanned in key
+* order; two secondary AVLTrees order them by age (insertion or last use,
+* see EvictionPolicy) and by expiry time, so the entry to evict and the
+* next one to expire are both found in O(log n).
+*
+* Expired entries are pruned a few at a time by every insert, and
+* whenever a lookup runs into one; expire() prunes the rest on demand.
+* Clock is anything with a steady_clock-like now(), so tests can use a
+* fake one.
+*/
+template <class Key, class Value, class Compare = std::less<Key>, class Clock = std::chrono::steady_clock>
+class OrderedCache
+{
+public:
+    typedef typename Clock::duration Duration;
+    typedef typename Clock::time_point TimePoint;
+
+    struct Entry
+    {
+        Value value;
+        TimePoint expiry;   // TimePoint::max() if it never expires
+        uint64_t stamp;     // position in the eviction order
+        uint64_t id;        // the stamp it was inserted with, for the expiry index
+        size_t charge;      // bytes counted against maxBytes
+
+        // for print()
+        friend std::ostream& operator<<(std::ostream& os, const Entry& entry)
+        {
+            return os << entry.value;
+        }
+    };
+    typedef typename AVLTree<Key, Entry, Compare>::iterator iterator;
+
+    // 0 means no limit. ttl is the default for insert(); Duration::max()
+    // means entries do not expire.
+    explicit OrderedCache(size_t maxEntries, size_t maxBytes = 0, EvictionPolicy policy = EVICT_LRU,
+                          Duration ttl = Duration::max(), const Compare& comp = Compare());
+
+    // Adds or replaces key's entry, evicting others if the cache is then
+    // over a limit. extraBytes is memory the value owns outside the entry.
+    void insert(const Key& key, const Value& value);
+    void insert(const Key& key, const Value& value, Duration ttl, size_t extraBytes = 0);
+    // The live value for key, or nullptr; a hit counts as a use for LRU
+    Value* find(const Key& key);
+    bool remove(const Key& key);
+    // Removes up to limit expired entries, oldest expiry first; returns how many
+    size_t expire(size_t limit = SIZE_MAX);
+    void clear();
+
+    size_t size() const;
+    bool empty() const;
+    // Bytes counted against maxBytes: a fixed overhead per entry plus extraBytes
+    size_t bytes() const;
+    const CacheStats& stats() const;
+
+    // Key-ordered access to the entries. Expired entries stay visible until
+    // they are pruned; check Entry::expiry or call expire() first.
+    iterator begin() const;
+    iterator end() const;
+    iterator lower_bound(const Key& key) const;
+
+    // Bytes counted for each entry on top of its extraBytes
+    static size_t entryOverhead();
+
+protected:
+    // Expired entries pruned by each insert
+    static const size_t EXPIRE_PER_INSERT = 2;
+
+    // Expiry order; the entry id keeps the keys unique
+    struct ExpiryKey
+    {
+        TimePoint at;
+        uint64_t id;
+
+        bool operator<(const ExpiryKey& rhs) const
+        {
+            return at < rhs.at || (at == rhs.at && id < rhs.id);
+        }
+        friend std::ostream& operator<<(std::ostream& os, const ExpiryKey& key)
+        {
+            return os << key.at.time_since_epoch().count() << '/' << key.id;
+        }
+    };
+
+    void unindex(const Entry& entry);
+    void index(const Key& key, Entry& entry);
+    void eraseEntry(iterator it);
+    void evictIfFull();
+    size_t expireBefore(TimePoint now, size_t limit);
+
+    AVLTree<Key, Entry, Compare> entries_;
+    AVLTree<uint64_t, Key> byAge_;
+    AVLTree<ExpiryKey, Key> byExpiry_;
+    size_t maxEntries_;
+    size_t maxBytes_;
+    EvictionPolicy policy_;
+    Duration ttl_;
+    size_t size_;
+    size_t bytes_;
+    uint64_t nextStamp_;
+    CacheStats stats_;
+};
+
+/*
+--------------------------------------------------
+Begin implementations for the OrderedCache class.
+--------------------------------------------------
+*/
+
+template<class Key, class Value, class Compare, class Clock>
+OrderedCache<Key, Value, Compare, Clock>::OrderedCache(size_t maxEntries, size_t maxBytes, EvictionPolicy policy,
+                                                       Duration ttl, const Compare& comp) :
+    entries_(comp), maxEntries_(maxEntries), maxBytes_(maxBytes), policy_(policy), ttl_(ttl),
+    size_(0), bytes_(0), nextStamp_(0)
+{
+    CacheStats zero = { 0, 0, 0, 0 };
+    stats_ = zero;
+}
+
+template<class Key, class Value, class Compare, class Clock>
+void OrderedCache<Key, Value, Compare, Clock>::insert(const Key& key, const Value& value)
+{
+    insert(key, value, ttl_);
+}
+
+/**
+* Prunes a bounded number of expired entries first, so the work of
+* expiring is spread over the inserts instead of piling up.
+*/
+template<class Key, class Value, class Compare, class Clock>
+void OrderedCache<Key, Value, Compare, Clock>::insert(const Key& key, const Value& value, Duration ttl,
+                                                      size_t extraBytes)
+{
+    TimePoint now = Clock::now();
+    expireBefore(now, EXPIRE_PER_INSERT);
+
+    TimePoint expiry = (ttl == Duration::max() || now > TimePoint::max() - ttl) ? TimePoint::max() : now + ttl;
+    Entry entry = { value, expiry, 0, 0, entryOverhead() + extraBytes };
+
+    iterator it = entries_.find(key);
+    if (it != entries_.end()) {
+        unindex(it->second);
+        bytes_ -= it->second.charge;
+        it->second = entry;
+    } else {
+        entries_.insert(std::make_pair(key, entry));
+        it = entries_.find(key);
+        ++size_;
+    }
+    bytes_ += entry.charge;
+    index(key, it->second);
+    evictIfFull();
+}
+
+template<class Key, class Value, class Compare, class Clock>
+Value* OrderedCache<Key, Value, Compare, Clock>::find(const Key& key)
+{
+    iterator it = entries_.find(key);
+    if (it == entries_.end()) {
+        ++stats_.misses;
+        return nullptr;
+    }
+    if (it->second.expiry <= Clock::now()) {
+        eraseEntry(it);
+        ++stats_.expirations;
+        ++stats_.misses;
+        return nullptr;
+    }
+    ++stats_.hits;
+    if (policy_ == EVICT_LRU) {
+        // move to the young end of the age order
+        byAge_.remove(it->second.stamp);
+        it->second.stamp = nextStamp_++;
+        byAge_.insert(std::make_pair(it->second.stamp, key));
+    }
+    return &it->second.value;
+}
+
+template<class Key, class Value, class Compare, class Clock>
+bool OrderedCache<Key, Value, Compare, Clock>::remove(const Key& key)
+{
+    iterator it = entries_.find(key);
+    if (it == entries_.end()) return false;
+    eraseEntry(it);
+    return true;
+}
+
+template<class Key, class Value, class Compare, class Clock>
+size_t OrderedCache<Key, Value, Compare, Clock>::expire(size_t limit)
+{
+    return expireBefore(Clock::now(), limit);
+}
+
+template<class Key, class Value, class Compare, class Clock>
+void OrderedCache<Key, Value, Compare, Clock>::clear()
+{
+    entries_.clear();
+    byAge_.clear();
+    byExpiry_.clear();
+    size_ = 0;
+    bytes_ = 0;
+}
+
+template<class Key, class Value, class Compare, class Clock>
+size_t OrderedCache<Key, Value, Compare, Clock>::size() const
+{
+    return size_;
+}
+
+template<class Key, class Value, class Compare, class Clock>
+bool OrderedCache<Key, Value, Compare, Clock>::empty() const
+{
+    return size_ == 0;
+}
+
+template<class Key, class Value, class Compare, class Clock>
+size_t OrderedCache<Key, Value, Compare, Clock>::bytes() const
+{
+    return bytes_;
+}
+
+template<class Key, class Value, class Compare, class Clock>
+const CacheStats& OrderedCache<Key, Value, Compare, Clock>::stats() const
+{
+    return stats_;
+}
+
+template<class Key, class Value, class Compare, class Clock>
+typename OrderedCache<Key, Value, Compare, Clock>::iterator
+OrderedCache<Key, Value, Compare, Clock>::begin() const
+{
+    return entries_.begin();
+}
+
+template<class Key, class Value, class Compare, class Clock>
+typename OrderedCache<Key, Value, Compare, Clock>::iterator
+OrderedCache<Key, Value, Compare, Clock>::end() const
+{
+    return entries_.end();
+}
+
+template<class Key, class Value, class Compare, class Clock>
+typename OrderedCache<Key, Value, Compare, Clock>::iterator
+OrderedCache<Key, Value, Compare, Clock>::lower_bound(const Key& key) const
+{
+    return entries_.lower_bound(key);
+}
+
+/**
+* One node in each index (an entry that never expires leaves its expiry
+* node unused, but is charged the same).
+*/
+template<class Key, class Value, class Compare, class Clock>
+size_t OrderedCache<Key, Value, Compare, Clock>::entryOverhead()
+{
+    return sizeof(AVLNode<Key, Entry>) + sizeof(AVLNode<uint64_t, Key>) + sizeof(AVLNode<ExpiryKey, Key>);
+}
+
+/**
+* Takes entry out of the secondary indexes.
+*/
+template<class Key, class Value, class Compare, class Clock>
+void OrderedCache<Key, Value, Compare, Clock>::unindex(const Entry& entry)
+{
+    byAge_.remove(entry.stamp);
+    if (entry.expiry != TimePoint::max()) {
+        ExpiryKey key = { entry.expiry, entry.id };
+        byExpiry_.remove(key);
+    }
+}
+
+/**
+* Gives entry a fresh stamp and id and adds it to the secondary indexes.
+*/
+template<class Key, class Value, class Compare, class Clock>
+void OrderedCache<Key, Value, Compare, Clock>::index(const Key& key, Entry& entry)
+{
+    entry.stamp = nextStamp_++;
+    entry.id = entry.stamp;
+    byAge_.insert(std::make_pair(entry.stamp, key));
+    if (entry.expiry != TimePoint::max()) {
+        ExpiryKey at = { entry.expiry, entry.id };
+        byExpiry_.insert(std::make_pair(at, key));
+    }
+}
+
+template<class Key, class Value, class Compare, class Clock>
+void OrderedCache<Key, Value, Compare, Clock>::eraseEntry(iterator it)
+{
+    unindex(it->second);
+    bytes_ -= it->second.charge;
+    --size_;
+    entries_.erase(it);
+}
+
+/**
+* The oldest entry is the first one in byAge_.
+*/
+template<class Key, class Value, class Compare, class Clock>
+void OrderedCache<Key, Value, Compare, Clock>::evictIfFull()
+{
+    while ((maxEntries_ != 0 && size_ > maxEntries_) || (maxBytes_ != 0 && bytes_ > maxBytes_ && size_ > 1)) {
+        eraseEntry(entries_.find(byAge_.begin()->second));
+        ++stats_.evictions;
+    }
+}
+
+template<class Key, class Value, class Compare, class Clock>
+size_t OrderedCache<Key, Value, Compare, Clock>::expireBefore(TimePoint now, size_t limit)
+{
+    size_t n = 0;
+    while (n < limit && !byExpiry_.empty()) {
+        typename AVLTree<ExpiryKey, Key>::iterator first = byExpiry_.begin();
+        if (first->first.at > now) break;
+        eraseEntry(entries_.find(first->second));
+        ++n;
+    }
+    stats_.expirations += n;
+    return n;
+}
+
+/*
+------------------------------------------------
+End implementations for the OrderedCache class.
+------------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,98 @@
+#ifndef PARALLEL_SORT_H
+#define PARALLEL_SORT_H
+
+#include <cstddef>
+#include <vector>
+#include <algorithm>
+#include <iterator>
+#include "thread_pool.h"
+
+/**
+ * Stable merge sort of v on a ThreadPool. Both halves of each split are
+ * sorted as separate tasks and merged back with a divide-and-conquer
+ * merge, so the merges are parallel too. Uses a scratch buffer of the
+ * same size as v.
+ */
+template <typename T, typename Compare>
+void parallelStableSort(std::vector<T>& v, Compare comp, ThreadPool& pool);
+
+namespace parallel_sort_detail {
+
+// below this many elements a task just calls the standard algorithm
+const size_t SEQUENTIAL_CUTOFF = 8192;
+
+/**
+ * Merges a[0, na) and b[0, nb) into out. Ties go to a first. The larger
+ * input is split at its middle element and the other one at the matching
+ * bound, so that the two halves of the output can be merged independently.
+ */
+template <typename T, typename Compare>
+void merge(T* a, size_t na, T* b, size_t nb, T* out, Compare& comp, ThreadPool& pool, int forkDepth)
+{
+    if (forkDepth <= 0 || na + nb <= SEQUENTIAL_CUTOFF) {
+        std::merge(std::make_move_iterator(a), std::make_move_iterator(a + na),
+                   std::make_move_iterator(b), std::make_move_iterator(b + nb), out, comp);
+        return;
+    }
+    size_t ma, mb;
+    if (na >= nb) {
+        ma = na / 2;
+        // b's elements equal to a[ma] must come after it
+        mb = std::lower_bound(b, b + nb, a[ma], comp) - b;
+    } else {
+        mb = nb / 2;
+        // a's elements equal to b[mb] must come before it
+        ma = std::upper_bound(a, a + na, b[mb], comp) - a;
+    }
+    TaskGroup group(pool);
+    group.run([=, &comp, &pool]() {
+        parallel_sort_detail::merge(a, ma, b, mb, out, comp, pool, forkDepth - 1);
+    });
+    parallel_sort_detail::merge(a + ma, na - ma, b + mb, nb - mb, out + ma + mb, comp, pool, forkDepth - 1);
+    group.wait();
+}
+
+/**
+ * Sorts a[0, n), leaving the result in a, or in b if intoB. b is scratch
+ * space of the same size.
+ */
+template <typename T, typename Compare>
+void sort(T* a, T* b, size_t n, bool intoB, Compare& comp, ThreadPool& pool, int forkDepth)
+{
+    if (forkDepth <= 0 || n <= SEQUENTIAL_CUTOFF) {
+        std::stable_sort(a, a + n, comp);
+        if (intoB) std::move(a, a + n, b);
+        return;
+    }
+    size_t half = n / 2;
+    {
+        TaskGroup group(pool);
+        group.run([=, &comp, &pool]() {
+            parallel_sort_detail::sort(a, b, half, !intoB, comp, pool, forkDepth - 1);
+        });
+        parallel_sort_detail::sort(a + half, b + half, n - half, !intoB, comp, pool, forkDepth - 1);
+        group.wait();
+    }
+    // the sorted halves are in the other buffer
+    T* from = intoB ? a : b;
+    T* to = intoB ? b : a;
+    parallel_sort_detail::merge(from, half, from + half, n - half, to, comp, pool, forkDepth);
+}
+
+} // namespace parallel_sort_detail
+
+template <typename T, typename Compare>
+void parallelStableSort(std::vector<T>& v, Compare comp, ThreadPool& pool)
+{
+    if (v.size() <= parallel_sort_detail::SEQUENTIAL_CUTOFF || pool.size() == 1) {
+        std::stable_sort(v.begin(), v.end(), comp);
+        return;
+    }
+    // a few tasks per thread at every level
+    int forkDepth = 0;
+    while ((1u << forkDepth) < 4 * pool.size()) ++forkDepth;
+    std::vector<T> scratch(v.size());
+    parallel_sort_detail::sort(&v[0], &scratch[0], v.size(), false, comp, pool, forkDepth);
+}
+
+#endif
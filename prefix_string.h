@@ -0,0 +1,269 @@
+#ifndef PREFIX_STRING_H
+#define PREFIX_STRING_H
+
+#include <iostream>
+#include <string>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <algorithm>
+#include <utility>
+
+/**
+ * A byte string laid out for use as a tree key. Its first PREFIX_BYTES
+ * bytes are kept in a big-endian integer, so most comparisons are decided
+ * by one integer compare without touching any other memory.
+ * Keys of up to INLINE_BYTES bytes are stored entirely inside the 24-byte
+ * object; longer ones keep only the bytes after the prefix on the heap.
+ * (A std::string is 32 bytes and goes to the heap past 15.)
+ *
+ * Ordering is that of std::string: bytewise as unsigned char, and a
+ * proper prefix sorts first. compareFrom() also reports how long the
+ * common prefix is, which StringAVLTree uses to skip bytes it already
+ * knows match.
+ */
+class PrefixString
+{
+public:
+    static const size_t PREFIX_BYTES = 8;
+    static const size_t INLINE_BYTES = 20;
+
+    PrefixString();
+    PrefixString(const char* s);
+    PrefixString(const std::string& s);
+    PrefixString(const char* data, size_t size);
+    PrefixString(const PrefixString& other);
+    PrefixString(PrefixString&& other);
+    PrefixString& operator=(const PrefixString& other);
+    PrefixString& operator=(PrefixString&& other);
+    ~PrefixString();
+
+    size_t size() const;
+    bool empty() const;
+    char operator[](size_t i) const;
+    std::string str() const;
+    // Bytes held on the heap (0 for inline keys)
+    size_t heapBytes() const;
+    void swap(PrefixString& other);
+
+    // Negative, zero or positive as *this sorts before, equal to or after other
+    int compare(const PrefixString& other) const;
+    // The same, for strings already known to agree on their first from
+    // bytes; common receives the length of their common prefix
+    int compareFrom(const PrefixString& other, size_t from, size_t& common) const;
+
+private:
+    bool isInline() const;
+    const char* tail() const;  // the bytes after the prefix
+
+    uint64_t prefix_;   // first PREFIX_BYTES bytes, big-endian, zero-padded
+    uint32_t size_;
+    // the rest of an inline key, or a pointer to the heap copy of it
+    char tail_[INLINE_BYTES - PREFIX_BYTES];
+};
+
+inline PrefixString::PrefixString() :
+    prefix_(0), size_(0)
+{
+}
+
+inline PrefixString::PrefixString(const char* s) :
+    PrefixString(s, strlen(s))
+{
+}
+
+inline PrefixString::PrefixString(const std::string& s) :
+    PrefixString(s.data(), s.size())
+{
+}
+
+inline PrefixString::PrefixString(const char* data, size_t size) :
+    prefix_(0), size_((uint32_t)size)
+{
+    if (size > UINT32_MAX) throw std::length_error("PrefixString: key too long");
+    size_t head = std::min(size, (size_t)PREFIX_BYTES);
+    for (size_t i = 0; i < head; ++i) {
+        prefix_ |= (uint64_t)(unsigned char)data[i] << (8 * (PREFIX_BYTES - 1 - i));
+    }
+    if (size <= PREFIX_BYTES) return;
+    if (size <= INLINE_BYTES) {
+        memcpy(tail_, data + PREFIX_BYTES, size - PREFIX_BYTES);
+    } else {
+        char* rest = new char[size - PREFIX_BYTES];
+        memcpy(rest, data + PREFIX_BYTES, size - PREFIX_BYTES);
+        memcpy(tail_, &rest, sizeof(rest));
+    }
+}
+
+inline PrefixString::PrefixString(const PrefixString& other) :
+    prefix_(other.prefix_), size_(other.size_)
+{
+    if (other.isInline()) {
+        memcpy(tail_, other.tail_, sizeof(tail_));
+    } else {
+        char* rest = new char[size_ - PREFIX_BYTES];
+        memcpy(rest, other.tail(), size_ - PREFIX_BYTES);
+        memcpy(tail_, &rest, sizeof(rest));
+    }
+}
+
+inline PrefixString::PrefixString(PrefixString&& other) :
+    prefix_(other.prefix_), size_(other.size_)
+{
+    memcpy(tail_, other.tail_, sizeof(tail_));
+    other.prefix_ = 0;
+    other.size_ = 0;
+}
+
+inline PrefixString& PrefixString::operator=(const PrefixString& other)
+{
+    if (this != &other) {
+        PrefixString copy(other);
+        swap(copy);
+    }
+    return *this;
+}
+
+inline PrefixString& PrefixString::operator=(PrefixString&& other)
+{
+    swap(other);
+    return *this;
+}
+
+inline PrefixString::~PrefixString()
+{
+    if (!isInline()) delete[] tail();
+}
+
+inline size_t PrefixString::size() const
+{
+    return size_;
+}
+
+inline bool PrefixString::empty() const
+{
+    return size_ == 0;
+}
+
+inline char PrefixString::operator[](size_t i) const
+{
+    if (i < PREFIX_BYTES) return (char)(prefix_ >> (8 * (PREFIX_BYTES - 1 - i)));
+    return tail()[i - PREFIX_BYTES];
+}
+
+inline std::string PrefixString::str() const
+{
+    std::string s(size_, '\0');
+    size_t head = std::min((size_t)size_, (size_t)PREFIX_BYTES);
+    for (size_t i = 0; i < head; ++i) s[i] = (*this)[i];
+    if (size_ > PREFIX_BYTES) memcpy(&s[PREFIX_BYTES], tail(), size_ - PREFIX_BYTES);
+    return s;
+}
+
+inline size_t PrefixString::heapBytes() const
+{
+    return isInline() ? 0 : size_ - PREFIX_BYTES;
+}
+
+inline void PrefixString::swap(PrefixString& other)
+{
+    std::swap(prefix_, other.prefix_);
+    std::swap(size_, other.size_);
+    char tail[sizeof(tail_)];
+    memcpy(tail, tail_, sizeof(tail_));
+    memcpy(tail_, other.tail_, sizeof(tail_));
+    memcpy(other.tail_, tail, sizeof(tail_));
+}
+
+inline int PrefixString::compare(const PrefixString& other) const
+{
+    if (prefix_ != other.prefix_) return prefix_ < other.prefix_ ? -1 : 1;
+    size_t common;
+    return compareFrom(other, PREFIX_BYTES, common);
+}
+
+/**
+ * Zero padding cannot make two different strings look equal: if the
+ * prefixes match, any byte where one string is padded is a zero the
+ * other one really has, and the shorter string sorts first either way.
+ */
+inline int PrefixString::compareFrom(const PrefixString& other, size_t from, size_t& common) const
+{
+    size_t n = std::min(size_, other.size_);
+    size_t i = std::min(from, n);
+    if (i < PREFIX_BYTES) {
+        uint64_t diff = prefix_ ^ other.prefix_;
+        if (diff != 0) {
+            size_t first = 0;
+            while ((diff >> (8 * (PREFIX_BYTES - 1 - first))) == 0) ++first;
+            common = std::min(first, n);
+            return prefix_ < other.prefix_ ? -1 : 1;
+        }
+        i = std::min((size_t)PREFIX_BYTES, n);
+    }
+    if (i < n) {
+        const unsigned char* a = (const unsigned char*)tail();
+        const unsigned char* b = (const unsigned char*)other.tail();
+        for (; i < n; ++i) {
+            unsigned char x = a[i - PREFIX_BYTES], y = b[i - PREFIX_BYTES];
+            if (x != y) {
+                common = i;
+                return x < y ? -1 : 1;
+            }
+        }
+    }
+    common = n;
+    if (size_ == other.size_) return 0;
+    return size_ < other.size_ ? -1 : 1;
+}
+
+inline bool PrefixString::isInline() const
+{
+    return size_ <= INLINE_BYTES;
+}
+
+inline const char* PrefixString::tail() const
+{
+    if (isInline()) return tail_;
+    const char* rest;
+    memcpy(&rest, tail_, sizeof(rest));
+    return rest;
+}
+
+inline bool operator==(const PrefixString& a, const PrefixString& b)
+{
+    return a.size() == b.size() && a.compare(b) == 0;
+}
+
+inline bool operator!=(const PrefixString& a, const PrefixString& b)
+{
+    return !(a == b);
+}
+
+inline bool operator<(const PrefixString& a, const PrefixString& b)
+{
+    return a.compare(b) < 0;
+}
+
+inline bool operator>(const PrefixString& a, const PrefixString& b)
+{
+    return b < a;
+}
+
+inline bool operator<=(const PrefixString& a, const PrefixString& b)
+{
+    return !(b < a);
+}
+
+inline bool operator>=(const PrefixString& a, const PrefixString& b)
+{
+    return !(a < b);
+}
+
+inline std::ostream& operator<<(std::ostream& os, const PrefixString& s)
+{
+    return os << s.str();
+}
+
+#endif
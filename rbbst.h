@@ -0,0 +1,496 @@
+#ifndef RBBST_H
+#define RBBST_H
+
+#include <iostream>
+#include <exception>
+#include <cstdlib>
+#include <cstdint>
+#include <algorithm>
+#include "bst.h"
+
+/**
+* A special kind of node for a Red-Black tree, which adds the color as a data member.
+* The color byte sits in the same spot AVLNode keeps its balance (the padding after
+* the links), so an RBNode is no bigger than an AVLNode.
+*/
+template <typename Key, typename Value>
+class RBNode : public Node<Key, Value>
+{
+public:
+    enum Color { RED = 0, BLACK = 1 };
+
+    // Constructor/destructor. New nodes are red.
+    RBNode(const Key& key, const Value& value, RBNode<Key, Value>* parent);
+    virtual ~RBNode();
+    virtual size_t footprint() const override;
+
+    // Getter/setter for the node's color.
+    Color getColor() const;
+    void setColor(Color color);
+    bool isRed() const;
+
+    // Getters for parent, left, and right. These need to be redefined since they
+    // return pointers to RBNodes - not plain Nodes. See the Node class in bst.h
+    // for more information.
+    virtual RBNode<Key, Value>* getParent() const override;
+    virtual RBNode<Key, Value>* getLeft() const override;
+    virtual RBNode<Key, Value>* getRight() const override;
+
+protected:
+    int8_t color_;
+};
+
+/*
+  -------------------------------------------------
+  Begin implementations for the RBNode class.
+  -------------------------------------------------
+*/
+
+/**
+* An explicit constructor to initialize the elements by calling the base class constructor
+*/
+template<class Key, class Value>
+RBNode<Key, Value>::RBNode(const Key& key, const Value& value, RBNode<Key, Value> *parent) :
+    Node<Key, Value>(key, value, parent), color_(RED)
+{
+}
+
+/**
+* A destructor which does nothing.
+*/
+template<class Key, class Value>
+RBNode<Key, Value>::~RBNode()
+{
+}
+
+template<class Key, class Value>
+size_t RBNode<Key, Value>::footprint() const
+{
+    return sizeof(*this);
+}
+
+template<class Key, class Value>
+typename RBNode<Key, Value>::Color RBNode<Key, Value>::getColor() const
+{
+    return static_cast<Color>(color_);
+}
+
+template<class Key, class Value>
+void RBNode<Key, Value>::setColor(Color color)
+{
+    color_ = color;
+}
+
+template<class Key, class Value>
+bool RBNode<Key, Value>::isRed() const
+{
+    return color_ == RED;
+}
+
+/**
+* An overridden function for getting the parent since a static_cast is necessary to make sure
+* that our node is a RBNode.
+*/
+template<class Key, class Value>
+RBNode<Key, Value> *RBNode<Key, Value>::getParent() const
+{
+    return static_cast<RBNode<Key, Value>*>(this->parent_);
+}
+
+/**
+* Overridden for the same reasons as above.
+*/
+template<class Key, class Value>
+RBNode<Key, Value> *RBNode<Key, Value>::getLeft() const
+{
+    return static_cast<RBNode<Key, Value>*>(this->left_);
+}
+
+/**
+* Overridden for the same reasons as above.
+*/
+template<class Key, class Value>
+RBNode<Key, Value> *RBNode<Key, Value>::getRight() const
+{
+    return static_cast<RBNode<Key, Value>*>(this->right_);
+}
+
+/*
+  -----------------------------------------------
+  End implementations for the RBNode class.
+  -----------------------------------------------
+*/
+
+/**
+* A Red-Black tree. Every update does at most a constant number of rotations
+* (two for insert, three for remove); the rest of the fix-up is recoloring.
+*/
+template <class Key, class Value, class Compare = std::less<Key> >
+class RedBlackTree : public BinarySearchTree<Key, Value, Compare>
+{
+public:
+    explicit RedBlackTree(const Compare& comp = Compare());
+    // See BinarySearchTree; copies keep the colors
+    RedBlackTree(const RedBlackTree& other);
+    RedBlackTree(RedBlackTree&& other);
+    RedBlackTree& operator=(const RedBlackTree& other);
+    RedBlackTree& operator=(RedBlackTree&& other);
+    virtual void insert(const std::pair<const Key, Value> &new_item);
+    virtual void remove(const Key& key);
+
+protected:
+    // Swaps two nodes and their colors, so colors stay with tree positions
+    virtual void nodeSwap( RBNode<Key,Value>* n1, RBNode<Key,Value>* n2);
+
+    virtual void cloneNodes(const BinarySearchTree<Key, Value, Compare>& other, unsigned int threads);
+
+    // Helper functions:
+    // Unlinks node and repairs the colors; returns the node's final parent
+    RBNode<Key, Value>* unlinkNode(RBNode<Key, Value>* node);
+    virtual void eraseNode(Node<Key, Value>* node);
+    void rotateLeft(RBNode<Key, Value>* node);
+    void rotateRight(RBNode<Key, Value>* node);
+    void fixAfterInsert(RBNode<Key, Value>* node);
+    // node is the (possibly null) child that took a removed black node's place
+    void fixAfterRemove(RBNode<Key, Value>* node, RBNode<Key, Value>* parent);
+    static bool isRed(const RBNode<Key, Value>* node);
+    // validate() hook: no red node has a red child, the root is black and
+    // both subtrees have the same black height (passed up in check.aux)
+    virtual TreeViolation checkNode(const Node<Key, Value>* node, SubtreeCheck& check) const;
+};
+
+template<class Key, class Value, class Compare>
+RedBlackTree<Key, Value, Compare>::RedBlackTree(const Compare& comp) :
+    BinarySearchTree<Key, Value, Compare>(comp)
+{
+}
+
+template<class Key, class Value, class Compare>
+RedBlackTree<Key, Value, Compare>::RedBlackTree(const RedBlackTree& other) :
+    BinarySearchTree<Key, Value, Compare>(other.comp_)
+{
+    this->template cloneAs<RBNode<Key, Value> >(other, 1);
+}
+
+template<class Key, class Value, class Compare>
+RedBlackTree<Key, Value, Compare>::RedBlackTree(RedBlackTree&& other) :
+    BinarySearchTree<Key, Value, Compare>(std::move(other))
+{
+}
+
+template<class Key, class Value, class Compare>
+RedBlackTree<Key, Value, Compare>& RedBlackTree<Key, Value, Compare>::operator=(const RedBlackTree& other)
+{
+    BinarySearchTree<Key, Value, Compare>::operator=(other);
+    return *this;
+}
+
+template<class Key, class Value, class Compare>
+RedBlackTree<Key, Value, Compare>& RedBlackTree<Key, Value, Compare>::operator=(RedBlackTree&& other)
+{
+    BinarySearchTree<Key, Value, Compare>::operator=(std::move(other));
+    return *this;
+}
+
+template<class Key, class Value, class Compare>
+void RedBlackTree<Key, Value, Compare>::cloneNodes(const BinarySearchTree<Key, Value, Compare>& other,
+                                                   unsigned int threads)
+{
+    this->template cloneAs<RBNode<Key, Value> >(other, threads);
+}
+
+/*
+ * Recall: If key is already in the tree, you should
+ * overwrite the current value with the updated value.
+ */
+template<class Key, class Value, class Compare>
+void RedBlackTree<Key, Value, Compare>::insert(const std::pair<const Key, Value> &new_item)
+{
+    BST_STAT(this->counters_.begin(TREE_OP_INSERT));
+    BST_TRACE_SCOPE(trace, TRACE_INSERT, &new_item.first);
+    BST_RECORD_OP(TRACE_INSERT, &new_item.first);
+    this->maintainFilter();
+    RBNode<Key, Value>* current = static_cast<RBNode<Key, Value>*>(this->root_);
+    RBNode<Key, Value>* parent = nullptr;
+    RBNode<Key, Value>* candidate = nullptr;  // last node we went right at
+    bool left = false;
+
+    while (current != nullptr) {
+        parent = current;
+        BST_STAT(++this->counters_.comparisons[TREE_OP_INSERT]);
+        left = this->comp_(new_item.first, current->getKey());
+        if (left) {
+            current = current->getLeft();
+        } else {
+            candidate = current;
+            current = current->getRight();
+        }
+    }
+
+    BST_STAT(if (candidate != nullptr) ++this->counters_.comparisons[TREE_OP_INSERT]);
+    if (candidate != nullptr && !this->comp_(candidate->getKey(), new_item.first)) {
+        // if key already exists - update value
+        candidate->setValue(new_item.second);
+        BST_TRACE_AT(trace, candidate, 0);
+        return;
+    }
+
+    RBNode<Key, Value>* newNode = this->createNode(new_item.first, new_item.second, parent);
+    BST_TRACE_AT(trace, newNode, 0);
+    if (parent == nullptr) {
+        this->root_ = newNode;
+    } else if (left) {
+        parent->setLeft(newNode);
+    } else {
+        parent->setRight(newNode);
+    }
+    fixAfterInsert(newNode);
+}
+
+/*
+ * Recall: The writeup specifies that if a node has 2 children you
+ * should swap with the predecessor and then remove.
+ */
+template<class Key, class Value, class Compare>
+void RedBlackTree<Key, Value, Compare>::remove(const Key& key)
+{
+    BST_STAT(this->counters_.begin(TREE_OP_REMOVE));
+    BST_TRACE_SCOPE(trace, TRACE_REMOVE, &key);
+    BST_RECORD_OP(TRACE_REMOVE, &key);
+    RBNode<Key, Value>* node = static_cast<RBNode<Key, Value>*>(this->internalFind(key));
+    if (node == nullptr) return;
+
+    RBNode<Key, Value>* parent = unlinkNode(node);
+    BST_TRACE_AT(trace, parent, 1);
+    BST_TRACE_END(trace);  // key may refer into node
+    this->destroyNode(node);
+}
+
+template<class Key, class Value, class Compare>
+RBNode<Key, Value>* RedBlackTree<Key, Value, Compare>::unlinkNode(RBNode<Key, Value>* node)
+{
+    if (node->getLeft() != nullptr && node->getRight() != nullptr) {
+        nodeSwap(node, static_cast<RBNode<Key, Value>*>(this->predecessor(node)));
+    }
+
+    RBNode<Key, Value>* child = (node->getLeft() != nullptr) ? node->getLeft() : node->getRight();
+    RBNode<Key, Value>* parent = node->getParent();
+    if (child != nullptr) child->setParent(parent);
+    if (parent == nullptr) {
+        this->root_ = child;
+    } else if (parent->getLeft() == node) {
+        parent->setLeft(child);
+    } else {
+        parent->setRight(child);
+    }
+
+    // Removing a red node never changes black heights; a black one leaves
+    // its replacement "doubly black" unless that replacement is red.
+    if (!node->isRed()) {
+        fixAfterRemove(child, parent);
+    }
+    return parent;
+}
+
+template<class Key, class Value, class Compare>
+void RedBlackTree<Key, Value, Compare>::eraseNode(Node<Key, Value>* node)
+{
+    RBNode<Key, Value>* rbNode = static_cast<RBNode<Key, Value>*>(node);
+    unlinkNode(rbNode);
+    this->destroyNode(rbNode);
+}
+
+template<class Key, class Value, class Compare>
+void RedBlackTree<Key, Value, Compare>::nodeSwap(RBNode<Key,Value>* n1, RBNode<Key,Value>* n2)
+{
+    BinarySearchTree<Key, Value, Compare>::nodeSwap(n1, n2);
+    typename RBNode<Key, Value>::Color tmp = n1->getColor();
+    n1->setColor(n2->getColor());
+    n2->setColor(tmp);
+}
+
+/**
+* Null leaves count as black.
+*/
+template<class Key, class Value, class Compare>
+bool RedBlackTree<Key, Value, Compare>::isRed(const RBNode<Key, Value>* node)
+{
+    return node != nullptr && node->isRed();
+}
+
+/**
+* Restores "no red node has a red child" going up from a new red node.
+* Red uncles are handled by recoloring and moving up; a black uncle ends
+* the loop after at most two rotations.
+*/
+template<class Key, class Value, class Compare>
+void RedBlackTree<Key, Value, Compare>::fixAfterInsert(RBNode<Key, Value>* node)
+{
+    while (isRed(node->getParent())) {
+        RBNode<Key, Value>* parent = node->getParent();
+        RBNode<Key, Value>* grand = parent->getParent();
+        if (parent == grand->getLeft()) {
+            RBNode<Key, Value>* uncle = grand->getRight();
+            if (isRed(uncle)) {
+                parent->setColor(RBNode<Key, Value>::BLACK);
+                uncle->setColor(RBNode<Key, Value>::BLACK);
+                grand->setColor(RBNode<Key, Value>::RED);
+                node = grand;
+                continue;
+            }
+            if (node == parent->getRight()) {
+                rotateLeft(parent);
+                node = parent;
+                parent = node->getParent();
+            }
+            parent->setColor(RBNode<Key, Value>::BLACK);
+            grand->setColor(RBNode<Key, Value>::RED);
+            rotateRight(grand);
+        } else {
+            RBNode<Key, Value>* uncle = grand->getLeft();
+            if (isRed(uncle)) {
+                parent->setColor(RBNode<Key, Value>::BLACK);
+                uncle->setColor(RBNode<Key, Value>::BLACK);
+                grand->setColor(RBNode<Key, Value>::RED);
+                node = grand;
+                continue;
+            }
+            if (node == parent->getLeft()) {
+                rotateRight(parent);
+                node = parent;
+                parent = node->getParent();
+            }
+            parent->setColor(RBNode<Key, Value>::BLACK);
+            grand->setColor(RBNode<Key, Value>::RED);
+            rotateLeft(grand);
+        }
+    }
+    static_cast<RBNode<Key, Value>*>(this->root_)->setColor(RBNode<Key, Value>::BLACK);
+}
+
+/**
+* Fixes the missing black on the path through node (which may be null, so
+* its parent is passed separately). A red sibling is rotated up first;
+* after that, either the sibling's children are both black and the
+* problem moves up by recoloring, or one or two rotations finish it.
+*/
+template<class Key, class Value, class Compare>
+void RedBlackTree<Key, Value, Compare>::fixAfterRemove(RBNode<Key, Value>* node, RBNode<Key, Value>* parent)
+{
+    while (node != this->root_ && !isRed(node)) {
+        if (node == parent->getLeft()) {
+            RBNode<Key, Value>* sibling = parent->getRight();
+            if (isRed(sibling)) {
+                sibling->setColor(RBNode<Key, Value>::BLACK);
+                parent->setColor(RBNode<Key, Value>::RED);
+                rotateLeft(parent);
+                sibling = parent->getRight();
+            }
+            if (!isRed(sibling->getLeft()) && !isRed(sibling->getRight())) {
+                sibling->setColor(RBNode<Key, Value>::RED);
+                node = parent;
+                parent = node->getParent();
+                continue;
+            }
+            if (!isRed(sibling->getRight())) {
+                sibling->getLeft()->setColor(RBNode<Key, Value>::BLACK);
+                sibling->setColor(RBNode<Key, Value>::RED);
+                rotateRight(sibling);
+                sibling = parent->getRight();
+            }
+            sibling->setColor(parent->getColor());
+            parent->setColor(RBNode<Key, Value>::BLACK);
+            sibling->getRight()->setColor(RBNode<Key, Value>::BLACK);
+            rotateLeft(parent);
+            node = static_cast<RBNode<Key, Value>*>(this->root_);
+        } else {
+            RBNode<Key, Value>* sibling = parent->getLeft();
+            if (isRed(sibling)) {
+                sibling->setColor(RBNode<Key, Value>::BLACK);
+                parent->setColor(RBNode<Key, Value>::RED);
+                rotateRight(parent);
+                sibling = parent->getLeft();
+            }
+            if (!isRed(sibling->getLeft()) && !isRed(sibling->getRight())) {
+                sibling->setColor(RBNode<Key, Value>::RED);
+                node = parent;
+                parent = node->getParent();
+                continue;
+            }
+            if (!isRed(sibling->getLeft())) {
+                sibling->getRight()->setColor(RBNode<Key, Value>::BLACK);
+                sibling->setColor(RBNode<Key, Value>::RED);
+                rotateLeft(sibling);
+                sibling = parent->getLeft();
+            }
+            sibling->setColor(parent->getColor());
+            parent->setColor(RBNode<Key, Value>::BLACK);
+            sibling->getLeft()->setColor(RBNode<Key, Value>::BLACK);
+            rotateRight(parent);
+            node = static_cast<RBNode<Key, Value>*>(this->root_);
+        }
+    }
+    if (node != nullptr) node->setColor(RBNode<Key, Value>::BLACK);
+}
+
+template<class Key, class Value, class Compare>
+TreeViolation RedBlackTree<Key, Value, Compare>::checkNode(const Node<Key, Value>* node, SubtreeCheck& check) const
+{
+    const RBNode<Key, Value>* n = static_cast<const RBNode<Key, Value>*>(node);
+    if (n->isRed() && (n->getParent() == nullptr || isRed(n->getLeft()) || isRed(n->getRight()))) {
+        return TREE_BAD_METADATA;
+    }
+    if (check.leftAux != check.rightAux) return TREE_BAD_METADATA;
+    check.aux = check.leftAux + (n->isRed() ? 0 : 1);
+    return TREE_OK;
+}
+
+template<class Key, class Value, class Compare>
+void RedBlackTree<Key, Value, Compare>::rotateLeft(RBNode<Key, Value>* node)
+{
+    BST_STAT(++this->counters_.rotations);
+    RBNode<Key, Value>* newRoot = node->getRight();
+    RBNode<Key, Value>* parent = node->getParent();
+
+    node->setRight(newRoot->getLeft());
+    if (newRoot->getLeft() != nullptr) {
+        newRoot->getLeft()->setParent(node);
+    }
+    newRoot->setLeft(node);
+    node->setParent(newRoot);
+
+    newRoot->setParent(parent);
+    if (parent == nullptr) {
+        this->root_ = newRoot;
+    } else if (parent->getLeft() == node) {
+        parent->setLeft(newRoot);
+    } else {
+        parent->setRight(newRoot);
+    }
+}
+
+template<class Key, class Value, class Compare>
+void RedBlackTree<Key, Value, Compare>::rotateRight(RBNode<Key, Value>* node)
+{
+    BST_STAT(++this->counters_.rotations);
+    RBNode<Key, Value>* newRoot = node->getLeft();
+    RBNode<Key, Value>* parent = node->getParent();
+
+    node->setLeft(newRoot->getRight());
+    if (newRoot->getRight() != nullptr) {
+        newRoot->getRight()->setParent(node);
+    }
+    newRoot->setRight(node);
+    node->setParent(newRoot);
+
+    newRoot->setParent(parent);
+    if (parent == nullptr) {
+        this->root_ = newRoot;
+    } else if (parent->getLeft() == node) {
+        parent->setLeft(newRoot);
+    } else {
+        parent->setRight(newRoot);
+    }
+}
+
+#endif
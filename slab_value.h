@@ -0,0 +1,238 @@
+#ifndef SLAB_VALUE_H
+#define SLAB_VALUE_H
+
+#include <iostream>
+#include <cstddef>
+#include <new>
+#include <mutex>
+#include <vector>
+#include <utility>
+#include <type_traits>
+
+/**
+ * Fixed-size slots for values of type T, carved out of chunks that are
+ * kept apart from the tree's nodes and handed back through a free list.
+ * There is one slab per type, shared by every tree and thread (allocation
+ * takes a lock), and it is never destroyed, so values in static trees can
+ * outlive it safely at exit.
+ */
+template <typename T>
+class ValueSlab
+{
+public:
+    static ValueSlab& instance();
+
+    void* allocate();
+    void release(void* slot);
+
+private:
+    static const size_t SLOTS_PER_CHUNK = 256;
+
+    union Slot
+    {
+        Slot* next;
+        typename std::aligned_storage<sizeof(T), std::alignment_of<T>::value>::type storage;
+    };
+
+    ValueSlab();
+
+    std::mutex lock_;
+    std::vector<Slot*> chunks_;
+    Slot* free_;
+};
+
+template <typename T>
+ValueSlab<T>& ValueSlab<T>::instance()
+{
+    static ValueSlab* slab = new ValueSlab();
+    return *slab;
+}
+
+template <typename T>
+ValueSlab<T>::ValueSlab() :
+    free_(nullptr)
+{
+}
+
+template <typename T>
+void* ValueSlab<T>::allocate()
+{
+    std::lock_guard<std::mutex> guard(lock_);
+    if (free_ == nullptr) {
+        Slot* chunk = static_cast<Slot*>(::operator new(SLOTS_PER_CHUNK * sizeof(Slot)));
+        chunks_.push_back(chunk);
+        for (size_t i = 0; i < SLOTS_PER_CHUNK; ++i) {
+            chunk[i].next = (i + 1 < SLOTS_PER_CHUNK) ? &chunk[i + 1] : nullptr;
+        }
+        free_ = chunk;
+    }
+    Slot* slot = free_;
+    free_ = slot->next;
+    return slot;
+}
+
+template <typename T>
+void ValueSlab<T>::release(void* slot)
+{
+    std::lock_guard<std::mutex> guard(lock_);
+    Slot* s = static_cast<Slot*>(slot);
+    s->next = free_;
+    free_ = s;
+}
+
+/**
+ * A value stored out of line, for trees with large values: used as the
+ * Value type (AVLTree<Key, SlabValue<Payload> >), it leaves each node
+ * holding only the key, the links, the balance and one pointer, so a
+ * search brings no value bytes into cache until the item it ends at is
+ * read. The values themselves sit densely in a ValueSlab.
+ *
+ * it->second is then a SlabValue<T>&. It converts to T& and assigns from
+ * T, so loops that read, print or overwrite values keep compiling; member
+ * access goes through -> or get().
+ */
+template <typename T>
+class SlabValue
+{
+public:
+    SlabValue();
+    SlabValue(const T& value);
+    SlabValue(T&& value);
+    SlabValue(const SlabValue& other);
+    SlabValue(SlabValue&& other);
+    SlabValue& operator=(const SlabValue& other);
+    SlabValue& operator=(SlabValue&& other);
+    SlabValue& operator=(const T& value);
+    ~SlabValue();
+
+    T& get();
+    const T& get() const;
+    operator T&();
+    operator const T&() const;
+    T* operator->();
+    const T* operator->() const;
+
+private:
+    template <typename Arg>
+    void construct(Arg&& arg);
+
+    T* value_;  // null only after being moved from
+};
+
+template <typename T>
+template <typename Arg>
+void SlabValue<T>::construct(Arg&& arg)
+{
+    void* slot = ValueSlab<T>::instance().allocate();
+    try {
+        value_ = new (slot) T(std::forward<Arg>(arg));
+    } catch (...) {
+        ValueSlab<T>::instance().release(slot);
+        throw;
+    }
+}
+
+template <typename T>
+SlabValue<T>::SlabValue()
+{
+    construct(T());
+}
+
+template <typename T>
+SlabValue<T>::SlabValue(const T& value)
+{
+    construct(value);
+}
+
+template <typename T>
+SlabValue<T>::SlabValue(T&& value)
+{
+    construct(std::move(value));
+}
+
+template <typename T>
+SlabValue<T>::SlabValue(const SlabValue& other)
+{
+    construct(other.get());
+}
+
+template <typename T>
+SlabValue<T>::SlabValue(SlabValue&& other) :
+    value_(other.value_)
+{
+    other.value_ = nullptr;
+}
+
+template <typename T>
+SlabValue<T>& SlabValue<T>::operator=(const SlabValue& other)
+{
+    if (this != &other) *this = other.get();
+    return *this;
+}
+
+template <typename T>
+SlabValue<T>& SlabValue<T>::operator=(SlabValue&& other)
+{
+    std::swap(value_, other.value_);
+    return *this;
+}
+
+template <typename T>
+SlabValue<T>& SlabValue<T>::operator=(const T& value)
+{
+    if (value_ == nullptr) construct(value);
+    else *value_ = value;
+    return *this;
+}
+
+template <typename T>
+SlabValue<T>::~SlabValue()
+{
+    if (value_ == nullptr) return;
+    value_->~T();
+    ValueSlab<T>::instance().release(value_);
+}
+
+template <typename T>
+T& SlabValue<T>::get()
+{
+    return *value_;
+}
+
+template <typename T>
+const T& SlabValue<T>::get() const
+{
+    return *value_;
+}
+
+template <typename T>
+SlabValue<T>::operator T&()
+{
+    return *value_;
+}
+
+template <typename T>
+SlabValue<T>::operator const T&() const
+{
+    return *value_;
+}
+
+template <typename T>
+T* SlabValue<T>::operator->()
+{
+    return value_;
+}
+
+template <typename T>
+const T* SlabValue<T>::operator->() const
+{
+    return value_;
+}
+
+template <typename T>
+std::ostream& operator<<(std::ostream& os, const SlabValue<T>& value)
+{
+    return os << value.get();
+}
+
+#endif
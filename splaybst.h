@@ -0,0 +1,375 @@
+#ifndef SPLAYBST_H
+#define SPLAYBST_H
+
+#include <iostream>
+#include <exception>
+#include <cstdlib>
+#include "bst.h"
+
+/**
+* A self-adjusting binary search tree. insert and remove always splay the
+* key to the root; find and operator[] splay on every splayPeriod-th call
+* and otherwise do a read-only descent, so hot keys drift towards the root
+* without every read writing to the tree.
+*
+* Splaying is top-down (no recursion, no parent-pointer walk back up), so
+* the tree uses plain Nodes.
+*/
+template <class Key, class Value, class Compare = std::less<Key> >
+class SplayTree : public BinarySearchTree<Key, Value, Compare>
+{
+public:
+    explicit SplayTree(unsigned int splayPeriod = 1, const Compare& comp = Compare());
+
+    virtual void insert(const std::pair<const Key, Value>& keyValuePair);
+    virtual void remove(const Key& key);
+
+    // Splaying versions of the lookups. The const versions inherited from
+    // BinarySearchTree never splay.
+    using BinarySearchTree<Key, Value, Compare>::find;
+    using BinarySearchTree<Key, Value, Compare>::operator[];
+    typename BinarySearchTree<Key, Value, Compare>::iterator find(const Key& key);
+    Value& operator[](const Key& key);
+
+    unsigned int getSplayPeriod() const;
+    void setSplayPeriod(unsigned int splayPeriod);
+
+protected:
+    // Splays key (or the last node on its search path) to the top of the
+    // subtree rooted at t and returns the new subtree root; found, if
+    // given, is set to whether that root holds key.
+    Node<Key, Value>* splay(Node<Key, Value>* t, const Key& key, bool* found = NULL);
+    // Finds key for a read, splaying if this is a splay access
+    Node<Key, Value>* accessFind(const Key& key);
+    // Replaces the root by the join of its subtrees and returns the new root;
+    // the old root is left for the caller to free
+    Node<Key, Value>* detachRoot();
+    virtual void eraseNode(Node<Key, Value>* node);
+    virtual void swapExtra(BinarySearchTree<Key, Value, Compare>& other);
+
+    unsigned int splayPeriod_;
+    unsigned int accesses_;
+};
+
+/*
+-----------------------------------------------
+Begin implementations for the SplayTree class.
+-----------------------------------------------
+*/
+
+/**
+* A splay period of 1 splays on every access; k splays every k-th read.
+*/
+template<class Key, class Value, class Compare>
+SplayTree<Key, Value, Compare>::SplayTree(unsigned int splayPeriod, const Compare& comp) :
+    BinarySearchTree<Key, Value, Compare>(comp),
+    splayPeriod_(splayPeriod == 0 ? 1 : splayPeriod),
+    accesses_(0)
+{
+}
+
+template<class Key, class Value, class Compare>
+void SplayTree<Key, Value, Compare>::swapExtra(BinarySearchTree<Key, Value, Compare>& other)
+{
+    SplayTree<Key, Value, Compare>& rhs = static_cast<SplayTree<Key, Value, Compare>&>(other);
+    std::swap(splayPeriod_, rhs.splayPeriod_);
+    std::swap(accesses_, rhs.accesses_);
+}
+
+template<class Key, class Value, class Compare>
+unsigned int SplayTree<Key, Value, Compare>::getSplayPeriod() const
+{
+    return splayPeriod_;
+}
+
+template<class Key, class Value, class Compare>
+void SplayTree<Key, Value, Compare>::setSplayPeriod(unsigned int splayPeriod)
+{
+    splayPeriod_ = (splayPeriod == 0) ? 1 : splayPeriod;
+    accesses_ = 0;
+}
+
+/**
+* Top-down splay. Nodes bigger than key are hung off the left spine of a
+* right tree, the rest off the right spine of a left tree, and the three
+* pieces are reassembled under the final node at the end. Like
+* lowerBoundNode, each level costs a single comp_(key, node) call, and a
+* zig-zag step reuses its probe for the next level: an equal key just
+* goes right and is remembered as the candidate. The candidate is then
+* either the final node or the last one linked into the left tree, so
+* one equality check at the end decides which becomes the root.
+*/
+template<class Key, class Value, class Compare>
+Node<Key, Value>* SplayTree<Key, Value, Compare>::splay(Node<Key, Value>* t, const Key& key, bool* found)
+{
+    if (found != NULL) *found = false;
+    if (t == NULL) return NULL;
+
+    Node<Key, Value>* leftRoot = NULL;   // nodes not bigger than key
+    Node<Key, Value>* leftMax = NULL;
+    Node<Key, Value>* rightRoot = NULL;  // nodes bigger than key
+    Node<Key, Value>* rightMin = NULL;
+    Node<Key, Value>* candidate = NULL;  // last node key was not less than
+
+    BST_STAT(++this->counters_.comparisons[this->counters_.current]);
+    bool less = this->comp_(key, t->getKey());
+    while (true) {
+        if (less) {
+            Node<Key, Value>* y = t->getLeft();
+            if (y == NULL) break;
+            BST_STAT(++this->counters_.comparisons[this->counters_.current]);
+            bool probe = this->comp_(key, y->getKey());
+            if (probe) {
+                // zig-zig: rotate right before linking
+                BST_STAT(++this->counters_.rotations);
+                t->setLeft(y->getRight());
+                if (y->getRight() != NULL) y->getRight()->setParent(t);
+                y->setRight(t);
+                t->setParent(y);
+                t = y;
+                if (t->getLeft() == NULL) break;
+            }
+            // link t into the right tree
+            if (rightRoot == NULL) {
+                rightRoot = t;
+            } else {
+                rightMin->setLeft(t);
+                t->setParent(rightMin);
+            }
+            rightMin = t;
+            t = t->getLeft();
+            if (!probe) {
+                less = false;  // t is y
+                continue;
+            }
+        } else {
+            candidate = t;
+            Node<Key, Value>* y = t->getRight();
+            if (y == NULL) break;
+            BST_STAT(++this->counters_.comparisons[this->counters_.current]);
+            bool probe = this->comp_(key, y->getKey());
+            if (!probe) {
+                // zag-zag: rotate left before linking
+                BST_STAT(++this->counters_.rotations);
+                t->setRight(y->getLeft());
+                if (y->getLeft() != NULL) y->getLeft()->setParent(t);
+                y->setLeft(t);
+                t->setParent(y);
+                t = y;
+                candidate = t;
+                if (t->getRight() == NULL) break;
+            }
+            // link t into the left tree
+            if (leftRoot == NULL) {
+                leftRoot = t;
+            } else {
+                leftMax->setRight(t);
+                t->setParent(leftMax);
+            }
+            leftMax = t;
+            t = t->getRight();
+            if (probe) {
+                less = true;  // t is y
+                continue;
+            }
+        }
+        BST_STAT(++this->counters_.comparisons[this->counters_.current]);
+        less = this->comp_(key, t->getKey());
+    }
+
+    bool hit = false;
+    if (candidate != NULL) {
+        BST_STAT(++this->counters_.comparisons[this->counters_.current]);
+        hit = !this->comp_(candidate->getKey(), key);
+    }
+    if (found != NULL) *found = hit;
+
+    if (hit && candidate != t) {
+        // Everything visited after the candidate was bigger than key, so
+        // it is leftMax: lift it out of the left tree and hang t, with
+        // the right tree, off its right.
+        if (candidate != leftRoot) {
+            Node<Key, Value>* parent = candidate->getParent();
+            parent->setRight(candidate->getLeft());
+            if (candidate->getLeft() != NULL) candidate->getLeft()->setParent(parent);
+            candidate->setLeft(leftRoot);
+            leftRoot->setParent(candidate);
+        }
+        if (rightRoot != NULL) {
+            rightMin->setLeft(t->getRight());
+            if (t->getRight() != NULL) t->getRight()->setParent(rightMin);
+            t->setRight(rightRoot);
+            rightRoot->setParent(t);
+        }
+        candidate->setRight(t);
+        t->setParent(candidate);
+        candidate->setParent(NULL);
+        return candidate;
+    }
+
+    // reassemble
+    if (leftRoot != NULL) {
+        leftMax->setRight(t->getLeft());
+        if (t->getLeft() != NULL) t->getLeft()->setParent(leftMax);
+        t->setLeft(leftRoot);
+        leftRoot->setParent(t);
+    }
+    if (rightRoot != NULL) {
+        rightMin->setLeft(t->getRight());
+        if (t->getRight() != NULL) t->getRight()->setParent(rightMin);
+        t->setRight(rightRoot);
+        rightRoot->setParent(t);
+    }
+    t->setParent(NULL);
+    return t;
+}
+
+/**
+* Looks key up for a read. Every splayPeriod_-th call splays; the rest
+* leave the tree untouched.
+*/
+template<class Key, class Value, class Compare>
+Node<Key, Value>* SplayTree<Key, Value, Compare>::accessFind(const Key& key)
+{
+    if (++accesses_ < splayPeriod_) {
+        return this->internalFind(key);
+    }
+    accesses_ = 0;
+    // a miss the filter catches is not worth splaying for
+    if (this->filterRejects(key)) return NULL;
+    bool found;
+    this->root_ = splay(this->root_, key, &found);
+    return found ? this->root_ : NULL;
+}
+
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+SplayTree<Key, Value, Compare>::find(const Key& key)
+{
+    BST_STAT(this->counters_.begin(TREE_OP_FIND));
+    BST_TRACE_SCOPE(trace, TRACE_FIND, &key);
+    BST_RECORD_OP(TRACE_FIND, &key);
+    Node<Key, Value>* found = accessFind(key);
+    BST_TRACE_AT(trace, found, 0);
+    return this->makeIterator(found);
+}
+
+/**
+ * @precondition The key exists in the map
+ * Returns the value associated with the key
+ */
+template<class Key, class Value, class Compare>
+Value& SplayTree<Key, Value, Compare>::operator[](const Key& key)
+{
+    BST_STAT(this->counters_.begin(TREE_OP_FIND));
+    BST_TRACE_SCOPE(trace, TRACE_FIND, &key);
+    BST_RECORD_OP(TRACE_FIND, &key);
+    Node<Key, Value>* found = accessFind(key);
+    BST_TRACE_AT(trace, found, 0);
+    if (found == NULL) throw std::out_of_range("Invalid key");
+    return found->getValue();
+}
+
+/**
+* Splays key to the root; if it is already there the value is
+* overwritten, otherwise the new node becomes the root and the old root
+* goes to its left or right.
+*/
+template<class Key, class Value, class Compare>
+void SplayTree<Key, Value, Compare>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+    BST_STAT(this->counters_.begin(TREE_OP_INSERT));
+    BST_TRACE_SCOPE(trace, TRACE_INSERT, &keyValuePair.first);
+    BST_RECORD_OP(TRACE_INSERT, &keyValuePair.first);
+    this->maintainFilter();
+    const Key& key = keyValuePair.first;
+    bool found;
+    Node<Key, Value>* root = splay(this->root_, key, &found);
+    if (found) {
+        root->setValue(keyValuePair.second);
+        this->root_ = root;
+        BST_TRACE_AT(trace, root, 0);
+        return;
+    }
+
+    Node<Key, Value>* node = this->template createNode<Node<Key, Value> >(key, keyValuePair.second, NULL);
+    if (root != NULL) {
+        if (this->comp_(key, root->getKey())) {
+            node->setLeft(root->getLeft());
+            if (root->getLeft() != NULL) root->getLeft()->setParent(node);
+            root->setLeft(NULL);
+            node->setRight(root);
+        } else {
+            node->setRight(root->getRight());
+            if (root->getRight() != NULL) root->getRight()->setParent(node);
+            root->setRight(NULL);
+            node->setLeft(root);
+        }
+        root->setParent(node);
+    }
+    this->root_ = node;
+    BST_TRACE_AT(trace, node, 0);
+}
+
+/**
+* Splays key to the root and, if found, replaces it by the join of its
+* subtrees: the maximum of the left subtree is splayed to the top of
+* that subtree (leaving it without a right child) and adopts the right
+* subtree.
+*/
+template<class Key, class Value, class Compare>
+void SplayTree<Key, Value, Compare>::remove(const Key& key)
+{
+    BST_STAT(this->counters_.begin(TREE_OP_REMOVE));
+    BST_TRACE_SCOPE(trace, TRACE_REMOVE, &key);
+    BST_RECORD_OP(TRACE_REMOVE, &key);
+    bool found;
+    Node<Key, Value>* root = splay(this->root_, key, &found);
+    this->root_ = root;
+    if (!found) return;
+
+    Node<Key, Value>* newRoot = detachRoot();
+    BST_TRACE_AT(trace, newRoot, 0);
+    BST_TRACE_END(trace);  // key may refer into root
+    this->destroyNode(root);
+}
+
+template<class Key, class Value, class Compare>
+Node<Key, Value>* SplayTree<Key, Value, Compare>::detachRoot()
+{
+    Node<Key, Value>* root = this->root_;
+    Node<Key, Value>* left = root->getLeft();
+    Node<Key, Value>* right = root->getRight();
+    Node<Key, Value>* newRoot;
+    if (left == NULL) {
+        newRoot = right;
+    } else {
+        left->setParent(NULL);
+        // root's key is bigger than everything on the left, so this brings up the max
+        newRoot = splay(left, root->getKey());
+        newRoot->setRight(right);
+        if (right != NULL) right->setParent(newRoot);
+    }
+    if (newRoot != NULL) newRoot->setParent(NULL);
+    this->root_ = newRoot;
+    return newRoot;
+}
+
+/**
+* Keys are unique, so splaying node's key brings node itself to the root.
+*/
+template<class Key, class Value, class Compare>
+void SplayTree<Key, Value, Compare>::eraseNode(Node<Key, Value>* node)
+{
+    this->root_ = splay(this->root_, node->getKey());
+    detachRoot();
+    this->destroyNode(node);
+}
+
+/*
+---------------------------------------------
+End implementations for the SplayTree class.
+---------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,160 @@
+#ifndef STRINGAVLBST_H
+#define STRINGAVLBST_H
+
+#include <iostream>
+#include <cstdlib>
+#include <utility>
+#include <algorithm>
+#include "avlbst.h"
+#include "prefix_string.h"
+
+/**
+* An AVL tree keyed by PrefixString, for string keys with long shared
+* prefixes (URLs, paths). Keys are stored inline or prefix-split as
+* PrefixString does, and lookups and inserts skip bytes already known to
+* match: every key between the nearest ancestors on either side of the
+* search path shares with the searched key at least the shorter of its
+* common prefixes with those two, so each comparison starts there
+* instead of at byte 0. A descent therefore reads each byte of the key
+* about once rather than once per level.
+*
+* Balancing, removal and everything else are AVLTree's.
+*/
+template <class Value>
+class StringAVLTree : public AVLTree<PrefixString, Value>
+{
+public:
+    typedef typename BinarySearchTree<PrefixString, Value>::iterator iterator;
+
+    StringAVLTree();
+
+    virtual void insert(const std::pair<const PrefixString, Value>& new_item);
+    using BinarySearchTree<PrefixString, Value>::lower_bound;
+    iterator lower_bound(const PrefixString& key) const;
+
+protected:
+    // Where a descent for a key ended: the node holding it, or else the
+    // node to hang it from, which side, and the first node after it
+    struct Descent
+    {
+        Node<PrefixString, Value>* match;
+        Node<PrefixString, Value>* parent;
+        bool left;
+        Node<PrefixString, Value>* lowerBound;
+    };
+
+    void descend(const PrefixString& key, Descent& result) const;
+    virtual Node<PrefixString, Value>* internalFind(const PrefixString& key) const;
+
+    // the names the BST_* macros expect
+    typedef PrefixString Key;
+    typedef std::less<PrefixString> Compare;
+};
+
+/*
+---------------------------------------------------
+Begin implementations for the StringAVLTree class.
+---------------------------------------------------
+*/
+
+template<class Value>
+StringAVLTree<Value>::StringAVLTree() :
+    AVLTree<PrefixString, Value>()
+{
+}
+
+/**
+* AVLTree::insert with the prefix-skipping descent.
+*/
+template<class Value>
+void StringAVLTree<Value>::insert(const std::pair<const PrefixString, Value>& new_item)
+{
+    BST_STAT(this->counters_.begin(TREE_OP_INSERT));
+    BST_TRACE_SCOPE(trace, TRACE_INSERT, &new_item.first);
+    BST_RECORD_OP(TRACE_INSERT, &new_item.first);
+    this->maintainFilter();
+    if (this->root_ == nullptr) {
+        this->root_ = this->template createNode<AVLNode<Key, Value> >(new_item.first, new_item.second, nullptr);
+        return;
+    }
+
+    Descent found;
+    descend(new_item.first, found);
+    if (found.match != nullptr) {
+        found.match->setValue(new_item.second);
+        return;
+    }
+
+    AVLNode<Key, Value>* parent = static_cast<AVLNode<Key, Value>*>(found.parent);
+    AVLNode<Key, Value>* newNode = this->createNode(new_item.first, new_item.second, parent);
+    BST_TRACE_AT(trace, newNode, 0);
+    if (found.left) {
+        parent->setLeft(newNode);
+    } else {
+        parent->setRight(newNode);
+    }
+    this->adjustAfterInsert(newNode);
+}
+
+template<class Value>
+typename StringAVLTree<Value>::iterator
+StringAVLTree<Value>::lower_bound(const PrefixString& key) const
+{
+    BST_STAT(this->counters_.begin(TREE_OP_FIND));
+    Descent found;
+    descend(key, found);
+    return this->makeIterator(found.lowerBound);
+}
+
+/**
+* lcpLow and lcpHigh are the common prefix lengths of key with the last
+* node passed on the left and on the right; every node below lies
+* between those two, so it matches key on at least the smaller of them.
+*/
+template<class Value>
+void StringAVLTree<Value>::descend(const PrefixString& key, Descent& result) const
+{
+    result.match = nullptr;
+    result.parent = nullptr;
+    result.left = false;
+    result.lowerBound = nullptr;
+    size_t lcpLow = 0, lcpHigh = 0;
+    Node<PrefixString, Value>* current = this->root_;
+    while (current != nullptr) {
+        BST_STAT(++this->counters_.comparisons[this->counters_.current]);
+        size_t common;
+        int order = key.compareFrom(current->getKey(), std::min(lcpLow, lcpHigh), common);
+        if (order == 0) {
+            result.match = current;
+            result.lowerBound = current;
+            return;
+        }
+        result.parent = current;
+        result.left = (order < 0);
+        if (order < 0) {
+            result.lowerBound = current;
+            lcpHigh = common;
+            current = current->getLeft();
+        } else {
+            lcpLow = common;
+            current = current->getRight();
+        }
+    }
+}
+
+template<class Value>
+Node<PrefixString, Value>* StringAVLTree<Value>::internalFind(const PrefixString& key) const
+{
+    if (this->filterRejects(key)) return nullptr;
+    Descent found;
+    descend(key, found);
+    return found.match;
+}
+
+/*
+-------------------------------------------------
+End implementations for the StringAVLTree class.
+-------------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,217 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <cstddef>
+#include <vector>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+class ThreadPool;
+
+/**
+ * A set of tasks that can be waited on together. wait() runs queued
+ * tasks on the calling thread instead of blocking, so tasks may spawn
+ * and wait on their own groups (fork-join) without deadlocking the pool.
+ */
+class TaskGroup
+{
+public:
+    explicit TaskGroup(ThreadPool& pool);
+    ~TaskGroup();
+
+    void run(const std::function<void()>& task);
+    void wait();
+
+private:
+    friend class ThreadPool;
+    ThreadPool& pool_;
+    std::atomic<size_t> pending_;
+};
+
+/**
+ * A fixed-size work-stealing thread pool. Each worker pushes and pops
+ * tasks at the back of its own deque and, when that runs dry, steals
+ * from the front of the others'; tasks submitted from outside the pool
+ * are spread round-robin. A pool of size 1 has no worker threads and
+ * runs everything inside TaskGroup::wait() on the caller.
+ */
+class ThreadPool
+{
+public:
+    // 0 means one thread per hardware thread
+    explicit ThreadPool(unsigned threads = 0);
+    ~ThreadPool();
+
+    unsigned size() const;
+    // True when nothing is queued, so a worker may be waiting for work;
+    // lets long-running tasks decide when to split themselves
+    bool idle() const;
+
+private:
+    friend class TaskGroup;
+
+    struct Task {
+        std::function<void()> fn;
+        TaskGroup* group;
+    };
+    struct Queue {
+        std::mutex lock;
+        std::deque<Task> tasks;
+    };
+
+    void submit(const Task& task);
+    bool runOne();
+    bool takeTask(Task& task);
+    void workerLoop(unsigned index);
+    static int& workerIndex();
+
+    unsigned size_;
+    std::vector<Queue*> queues_;
+    std::vector<std::thread> workers_;
+    std::mutex sleepLock_;
+    std::condition_variable wake_;
+    std::atomic<size_t> queued_;
+    std::atomic<unsigned> nextQueue_;
+    bool stop_;
+};
+
+inline TaskGroup::TaskGroup(ThreadPool& pool) :
+    pool_(pool), pending_(0)
+{
+}
+
+inline TaskGroup::~TaskGroup()
+{
+    wait();
+}
+
+inline void TaskGroup::run(const std::function<void()>& task)
+{
+    pending_.fetch_add(1);
+    ThreadPool::Task t = { task, this };
+    pool_.submit(t);
+}
+
+inline void TaskGroup::wait()
+{
+    while (pending_.load() != 0) {
+        if (!pool_.runOne()) std::this_thread::yield();
+    }
+}
+
+inline ThreadPool::ThreadPool(unsigned threads) :
+    size_(threads), queued_(0), nextQueue_(0), stop_(false)
+{
+    if (size_ == 0) size_ = std::thread::hardware_concurrency();
+    if (size_ == 0) size_ = 1;
+    // the queue at index size_ - 1 collects tasks when there are no workers
+    for (unsigned i = 0; i < size_; ++i) queues_.push_back(new Queue);
+    if (size_ > 1) {
+        for (unsigned i = 0; i < size_; ++i) {
+            workers_.push_back(std::thread(&ThreadPool::workerLoop, this, i));
+        }
+    }
+}
+
+inline ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> guard(sleepLock_);
+        stop_ = true;
+    }
+    wake_.notify_all();
+    for (size_t i = 0; i < workers_.size(); ++i) workers_[i].join();
+    for (size_t i = 0; i < queues_.size(); ++i) delete queues_[i];
+}
+
+inline unsigned ThreadPool::size() const
+{
+    return size_;
+}
+
+inline bool ThreadPool::idle() const
+{
+    return queued_.load(std::memory_order_relaxed) == 0;
+}
+
+/**
+ * The index of the pool worker running on this thread, or -1.
+ */
+inline int& ThreadPool::workerIndex()
+{
+    static thread_local int index = -1;
+    return index;
+}
+
+inline void ThreadPool::submit(const Task& task)
+{
+    int self = workerIndex();
+    unsigned q = (self >= 0 && (unsigned)self < size_) ? (unsigned)self : nextQueue_.fetch_add(1) % size_;
+    {
+        std::lock_guard<std::mutex> guard(queues_[q]->lock);
+        queues_[q]->tasks.push_back(task);
+    }
+    queued_.fetch_add(1);
+    if (!workers_.empty()) {
+        std::lock_guard<std::mutex> guard(sleepLock_);
+        wake_.notify_one();
+    }
+}
+
+/**
+ * Pops from the calling worker's own queue (newest first), otherwise
+ * steals the oldest task from another queue.
+ */
+inline bool ThreadPool::takeTask(Task& task)
+{
+    if (queued_.load() == 0) return false;
+    int self = workerIndex();
+    if (self >= 0 && (unsigned)self < size_) {
+        Queue& own = *queues_[self];
+        std::lock_guard<std::mutex> guard(own.lock);
+        if (!own.tasks.empty()) {
+            task = own.tasks.back();
+            own.tasks.pop_back();
+            queued_.fetch_sub(1);
+            return true;
+        }
+    }
+    unsigned start = (self >= 0) ? (unsigned)self + 1 : 0;
+    for (unsigned i = 0; i < size_; ++i) {
+        Queue& victim = *queues_[(start + i) % size_];
+        std::lock_guard<std::mutex> guard(victim.lock);
+        if (!victim.tasks.empty()) {
+            task = victim.tasks.front();
+            victim.tasks.pop_front();
+            queued_.fetch_sub(1);
+            return true;
+        }
+    }
+    return false;
+}
+
+inline bool ThreadPool::runOne()
+{
+    Task task;
+    if (!takeTask(task)) return false;
+    task.fn();
+    task.group->pending_.fetch_sub(1);
+    return true;
+}
+
+inline void ThreadPool::workerLoop(unsigned index)
+{
+    workerIndex() = (int)index;
+    while (true) {
+        if (runOne()) continue;
+        std::unique_lock<std::mutex> lock(sleepLock_);
+        wake_.wait(lock, [this]() { return stop_ || queued_.load() != 0; });
+        if (stop_ && queued_.load() == 0) return;
+    }
+}
+
+#endif
@@ -0,0 +1,529 @@
+#ifndef TOMBSTONEAVLBST_H
+#define TOMBSTONEAVLBST_H
+
+#include <iostream>
+#include <cstddef>
+#include <utility>
+#include <vector>
+#include <stdexcept>
+#include "avlbst.h"
+
+/**
+* An AVL tree with lazy deletion. remove() only marks the item's node as
+* a tombstone, so it costs one lookup and no swap or rebalancing, and
+* inserting the key again revives the node in place. Once tombstones make
+* up more than maxDeadShare of the nodes, purge() frees them all and
+* relinks the live nodes into a perfectly balanced tree in O(n), which
+* amortizes to O(1) per removal. Live nodes are only relinked, never
+* moved, so iterators to live items stay valid across a purge.
+*
+* Lookups (also through a BinarySearchTree reference or a Cursor),
+* iteration, the parallel walks, size() and empty() skip tombstones;
+* print(), stats() and validate() see the physical tree, tombstones
+* included.
+*/
+template <class Key, class Value, class Compare = std::less<Key> >
+class TombstoneAVLTree : public AVLTree<Key, Value, Compare>
+{
+public:
+    /**
+    * Iterates over live items only.
+    */
+    class iterator : public BinarySearchTree<Key, Value, Compare>::iterator
+    {
+    public:
+        iterator();
+        iterator& operator++();
+
+    private:
+        friend class TombstoneAVLTree;
+        // The first live item at or after node
+        explicit iterator(Node<Key, Value>* node);
+        // it as it is, tombstone or not
+        explicit iterator(const typename BinarySearchTree<Key, Value, Compare>::iterator& it);
+        void skipDead();
+    };
+
+    explicit TombstoneAVLTree(double maxDeadShare = 0.25, const Compare& comp = Compare());
+    // Copies keep the tombstones, as AVLTree copies keep the balances
+    TombstoneAVLTree(const TombstoneAVLTree& other);
+    TombstoneAVLTree(TombstoneAVLTree&& other);
+    TombstoneAVLTree& operator=(const TombstoneAVLTree& other);
+    TombstoneAVLTree& operator=(TombstoneAVLTree&& other);
+
+    // Inserts or overwrites; a tombstone for the key is revived
+    virtual void insert(const std::pair<const Key, Value>& new_item);
+    // Marks key's node as a tombstone, purging if they are then too many
+    virtual void remove(const Key& key);
+    // The same for the item at pos; returns the next live item
+    iterator erase(iterator pos);
+    // Physically removes [first, last), like AVLTree
+    iterator erase(iterator first, iterator last);
+    // As AVLTree's; removing a tombstoned key frees its node, upserting
+    // one revives it
+    virtual void applyBatch(const std::vector<BatchOp<Key, Value> >& sortedOps, unsigned int threads = 1);
+    virtual void clear();
+
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const Key& key) const;
+    iterator find_from(iterator finger, const Key& key) const;
+    iterator lower_bound(const Key& key) const;
+    iterator upper_bound(const Key& key) const;
+
+    // Live items
+    size_t size() const;
+    bool empty() const;
+    // Nodes kept for removed items
+    size_t tombstones() const;
+    // Frees every tombstone now and rebalances perfectly
+    void purge();
+    // The tombstone share above which remove() purges; 0 purges on every
+    // removal, which makes removals O(n)
+    void setMaxDeadShare(double share);
+
+protected:
+    virtual Node<Key, Value>* internalFind(const Key& key) const;
+    // Tombstones
+    virtual bool hidden(const Node<Key, Value>* node) const;
+    // Keep the counts right for erase paths inherited from the base trees
+    virtual void eraseNode(Node<Key, Value>* node);
+    virtual size_t eraseSpan(Node<Key, Value>* first, Node<Key, Value>* last);
+    virtual void cloneNodes(const BinarySearchTree<Key, Value, Compare>& other, unsigned int threads);
+    virtual void swapExtra(BinarySearchTree<Key, Value, Compare>& other);
+    // buildFrom() starts with no tombstones
+    virtual void linkSorted(std::vector<std::pair<Key, Value> >& items, ThreadPool* pool, int forkDepth);
+
+    void markDead(AVLNode<Key, Value>* node);
+    bool overDeadShare() const;
+
+    size_t live_;
+    size_t dead_;
+    double maxDeadShare_;
+};
+
+/*
+--------------------------------------------------------------
+Begin implementations for the TombstoneAVLTree::iterator class.
+--------------------------------------------------------------
+*/
+
+template<class Key, class Value, class Compare>
+TombstoneAVLTree<Key, Value, Compare>::iterator::iterator() :
+    BinarySearchTree<Key, Value, Compare>::iterator()
+{
+}
+
+template<class Key, class Value, class Compare>
+TombstoneAVLTree<Key, Value, Compare>::iterator::iterator(Node<Key, Value>* node) :
+    BinarySearchTree<Key, Value, Compare>::iterator(node)
+{
+    skipDead();
+}
+
+template<class Key, class Value, class Compare>
+TombstoneAVLTree<Key, Value, Compare>::iterator::iterator(
+    const typename BinarySearchTree<Key, Value, Compare>::iterator& it) :
+    BinarySearchTree<Key, Value, Compare>::iterator(it)
+{
+}
+
+template<class Key, class Value, class Compare>
+typename TombstoneAVLTree<Key, Value, Compare>::iterator&
+TombstoneAVLTree<Key, Value, Compare>::iterator::operator++()
+{
+    BinarySearchTree<Key, Value, Compare>::iterator::operator++();
+    skipDead();
+    return *this;
+}
+
+template<class Key, class Value, class Compare>
+void TombstoneAVLTree<Key, Value, Compare>::iterator::skipDead()
+{
+    while (this->current_ != nullptr && static_cast<AVLNode<Key, Value>*>(this->current_)->isDead()) {
+        BinarySearchTree<Key, Value, Compare>::iterator::operator++();
+    }
+}
+
+/*
+------------------------------------------------------------
+End implementations for the TombstoneAVLTree::iterator class.
+------------------------------------------------------------
+*/
+
+/*
+-----------------------------------------------------
+Begin implementations for the TombstoneAVLTree class.
+-----------------------------------------------------
+*/
+
+template<class Key, class Value, class Compare>
+TombstoneAVLTree<Key, Value, Compare>::TombstoneAVLTree(double maxDeadShare, const Compare& comp) :
+    AVLTree<Key, Value, Compare>(comp), live_(0), dead_(0), maxDeadShare_(maxDeadShare)
+{
+}
+
+template<class Key, class Value, class Compare>
+TombstoneAVLTree<Key, Value, Compare>::TombstoneAVLTree(const TombstoneAVLTree& other) :
+    AVLTree<Key, Value, Compare>(other), live_(other.live_), dead_(other.dead_),
+    maxDeadShare_(other.maxDeadShare_)
+{
+}
+
+template<class Key, class Value, class Compare>
+TombstoneAVLTree<Key, Value, Compare>::TombstoneAVLTree(TombstoneAVLTree&& other) :
+    AVLTree<Key, Value, Compare>(std::move(other)), live_(other.live_), dead_(other.dead_),
+    maxDeadShare_(other.maxDeadShare_)
+{
+    other.live_ = 0;
+    other.dead_ = 0;
+}
+
+template<class Key, class Value, class Compare>
+TombstoneAVLTree<Key, Value, Compare>& TombstoneAVLTree<Key, Value, Compare>::operator=(const TombstoneAVLTree& other)
+{
+    AVLTree<Key, Value, Compare>::operator=(other);
+    return *this;
+}
+
+template<class Key, class Value, class Compare>
+TombstoneAVLTree<Key, Value, Compare>& TombstoneAVLTree<Key, Value, Compare>::operator=(TombstoneAVLTree&& other)
+{
+    AVLTree<Key, Value, Compare>::operator=(std::move(other));
+    return *this;
+}
+
+/**
+* AVLTree::insert, except that finding the key's tombstone revives it.
+*/
+template<class Key, class Value, class Compare>
+void TombstoneAVLTree<Key, Value, Compare>::insert(const std::pair<const Key, Value>& new_item)
+{
+    BST_STAT(this->counters_.begin(TREE_OP_INSERT));
+    BST_TRACE_SCOPE(trace, TRACE_INSERT, &new_item.first);
+    BST_RECORD_OP(TRACE_INSERT, &new_item.first);
+    this->maintainFilter();
+    AVLNode<Key, Value>* current = static_cast<AVLNode<Key, Value>*>(this->root_);
+    AVLNode<Key, Value>* parent = nullptr;
+    AVLNode<Key, Value>* candidate = nullptr;  // last node we went right at
+    bool left = false;
+    while (current != nullptr) {
+        parent = current;
+        BST_STAT(++this->counters_.comparisons[TREE_OP_INSERT]);
+        left = this->comp_(new_item.first, current->getKey());
+        if (left) {
+            current = current->getLeft();
+        } else {
+            candidate = current;
+            current = current->getRight();
+        }
+    }
+
+    BST_STAT(if (candidate != nullptr) ++this->counters_.comparisons[TREE_OP_INSERT]);
+    if (candidate != nullptr && !this->comp_(candidate->getKey(), new_item.first)) {
+        candidate->setValue(new_item.second);
+        if (candidate->isDead()) {
+            candidate->setDead(false);
+            --dead_;
+            ++live_;
+        }
+        return;
+    }
+
+    AVLNode<Key, Value>* newNode =
+        this->template createNode<AVLNode<Key, Value> >(new_item.first, new_item.second, parent);
+    BST_TRACE_AT(trace, newNode, 0);
+    ++live_;
+    if (parent == nullptr) {
+        this->root_ = newNode;
+        return;
+    }
+    if (left) {
+        parent->setLeft(newNode);
+    } else {
+        parent->setRight(newNode);
+    }
+    this->adjustAfterInsert(newNode);
+}
+
+template<class Key, class Value, class Compare>
+void TombstoneAVLTree<Key, Value, Compare>::remove(const Key& key)
+{
+    BST_STAT(this->counters_.begin(TREE_OP_REMOVE));
+    BST_TRACE_SCOPE(trace, TRACE_REMOVE, &key);
+    BST_RECORD_OP(TRACE_REMOVE, &key);
+    AVLNode<Key, Value>* node = static_cast<AVLNode<Key, Value>*>(internalFind(key));
+    BST_TRACE_AT(trace, node, 0);
+    if (node == nullptr) return;
+    BST_TRACE_END(trace);  // key may refer into node, which a purge frees
+    markDead(node);
+}
+
+/**
+* The next live item is found first; a purge only relinks live nodes, so
+* it stays valid.
+*/
+template<class Key, class Value, class Compare>
+typename TombstoneAVLTree<Key, Value, Compare>::iterator
+TombstoneAVLTree<Key, Value, Compare>::erase(iterator pos)
+{
+    BST_STAT(this->counters_.begin(TREE_OP_REMOVE));
+    BST_TRACE_SCOPE(trace, TRACE_REMOVE, &pos->first);  // the node stays
+    BST_RECORD_OP(TRACE_REMOVE, &pos->first);
+    iterator next = pos;
+    ++next;
+    markDead(static_cast<AVLNode<Key, Value>*>(pos.current_));
+    return next;
+}
+
+template<class Key, class Value, class Compare>
+typename TombstoneAVLTree<Key, Value, Compare>::iterator
+TombstoneAVLTree<Key, Value, Compare>::erase(iterator first, iterator last)
+{
+    BinarySearchTree<Key, Value, Compare>::erase(first, last);
+    return last;
+}
+
+/**
+* Settles each key's last op against its node here: revivals are done
+* in place and dropped from the batch, and the counts are adjusted for
+* the rest, which AVLTree then applies. Still O(k log n) for k ops.
+*/
+template<class Key, class Value, class Compare>
+void TombstoneAVLTree<Key, Value, Compare>::applyBatch(const std::vector<BatchOp<Key, Value> >& sortedOps,
+                                                       unsigned int threads)
+{
+    for (size_t i = 1; i < sortedOps.size(); ++i) {
+        if (this->comp_(sortedOps[i].key, sortedOps[i - 1].key)) {
+            throw std::invalid_argument("applyBatch: ops are not sorted by key");
+        }
+    }
+    std::vector<BatchOp<Key, Value> > ops;
+    ops.reserve(sortedOps.size());
+    for (size_t i = 0; i < sortedOps.size(); ++i) {
+        // the last op on this key decides
+        if (i + 1 < sortedOps.size() && !this->comp_(sortedOps[i].key, sortedOps[i + 1].key)) continue;
+        const BatchOp<Key, Value>& op = sortedOps[i];
+        AVLNode<Key, Value>* node = static_cast<AVLNode<Key, Value>*>(this->findNode(op.key));
+        if (node != nullptr && node->isDead()) {
+            --dead_;
+            if (op.kind == BATCH_UPSERT) {
+                node->setValue(op.value);
+                node->setDead(false);
+                ++live_;
+                continue;
+            }
+        } else if (node != nullptr) {
+            if (op.kind == BATCH_REMOVE) --live_;
+        } else if (op.kind == BATCH_UPSERT) {
+            ++live_;
+        }
+        ops.push_back(op);
+    }
+    AVLTree<Key, Value, Compare>::applyBatch(ops, threads);
+}
+
+template<class Key, class Value, class Compare>
+void TombstoneAVLTree<Key, Value, Compare>::clear()
+{
+    BinarySearchTree<Key, Value, Compare>::clear();
+    live_ = 0;
+    dead_ = 0;
+}
+
+template<class Key, class Value, class Compare>
+typename TombstoneAVLTree<Key, Value, Compare>::iterator
+TombstoneAVLTree<Key, Value, Compare>::begin() const
+{
+    return iterator(this->getSmallestNode());
+}
+
+template<class Key, class Value, class Compare>
+typename TombstoneAVLTree<Key, Value, Compare>::iterator
+TombstoneAVLTree<Key, Value, Compare>::end() const
+{
+    return iterator();
+}
+
+template<class Key, class Value, class Compare>
+typename TombstoneAVLTree<Key, Value, Compare>::iterator
+TombstoneAVLTree<Key, Value, Compare>::find(const Key& key) const
+{
+    // the base find() goes through internalFind(), which skips tombstones
+    return iterator(BinarySearchTree<Key, Value, Compare>::find(key));
+}
+
+template<class Key, class Value, class Compare>
+typename TombstoneAVLTree<Key, Value, Compare>::iterator
+TombstoneAVLTree<Key, Value, Compare>::find_from(iterator finger, const Key& key) const
+{
+    // the base find_from() treats a tombstone as a miss
+    return iterator(BinarySearchTree<Key, Value, Compare>::find_from(finger, key));
+}
+
+template<class Key, class Value, class Compare>
+typename TombstoneAVLTree<Key, Value, Compare>::iterator
+TombstoneAVLTree<Key, Value, Compare>::lower_bound(const Key& key) const
+{
+    BST_STAT(this->counters_.begin(TREE_OP_FIND));
+    return iterator(this->lowerBoundNode(key));
+}
+
+template<class Key, class Value, class Compare>
+typename TombstoneAVLTree<Key, Value, Compare>::iterator
+TombstoneAVLTree<Key, Value, Compare>::upper_bound(const Key& key) const
+{
+    BST_STAT(this->counters_.begin(TREE_OP_FIND));
+    return iterator(this->upperBoundNode(key));
+}
+
+template<class Key, class Value, class Compare>
+size_t TombstoneAVLTree<Key, Value, Compare>::size() const
+{
+    return live_;
+}
+
+template<class Key, class Value, class Compare>
+bool TombstoneAVLTree<Key, Value, Compare>::empty() const
+{
+    return live_ == 0;
+}
+
+template<class Key, class Value, class Compare>
+size_t TombstoneAVLTree<Key, Value, Compare>::tombstones() const
+{
+    return dead_;
+}
+
+/**
+* The live nodes are collected in order and linked into a perfectly
+* balanced tree, as AVLTree's batch rebuild does; the tombstones are
+* freed once nothing walks the old links any more.
+*/
+template<class Key, class Value, class Compare>
+void TombstoneAVLTree<Key, Value, Compare>::purge()
+{
+    if (dead_ == 0) return;
+    std::vector<AVLNode<Key, Value>*> live;
+    std::vector<AVLNode<Key, Value>*> dead;
+    live.reserve(live_);
+    dead.reserve(dead_);
+    for (Node<Key, Value>* n = this->getSmallestNode(); n != nullptr; n = this->successor(n)) {
+        AVLNode<Key, Value>* node = static_cast<AVLNode<Key, Value>*>(n);
+        (node->isDead() ? dead : live).push_back(node);
+    }
+
+    int height;
+    auto nodeAt = [&live](size_t i) { return live[i]; };
+    AVLNode<Key, Value>* root = this->buildBalanced(nodeAt, 0, live.size(), height, nullptr, 0);
+    if (root != nullptr) root->setParent(nullptr);
+    this->root_ = root;
+    for (size_t i = 0; i < dead.size(); ++i) this->destroyNode(dead[i]);
+    dead_ = 0;
+}
+
+template<class Key, class Value, class Compare>
+void TombstoneAVLTree<Key, Value, Compare>::setMaxDeadShare(double share)
+{
+    maxDeadShare_ = share;
+    if (overDeadShare()) purge();
+}
+
+template<class Key, class Value, class Compare>
+Node<Key, Value>* TombstoneAVLTree<Key, Value, Compare>::internalFind(const Key& key) const
+{
+    Node<Key, Value>* node = BinarySearchTree<Key, Value, Compare>::internalFind(key);
+    if (node != nullptr && static_cast<AVLNode<Key, Value>*>(node)->isDead()) return nullptr;
+    return node;
+}
+
+template<class Key, class Value, class Compare>
+bool TombstoneAVLTree<Key, Value, Compare>::hidden(const Node<Key, Value>* node) const
+{
+    return static_cast<const AVLNode<Key, Value>*>(node)->isDead();
+}
+
+template<class Key, class Value, class Compare>
+void TombstoneAVLTree<Key, Value, Compare>::eraseNode(Node<Key, Value>* node)
+{
+    if (static_cast<AVLNode<Key, Value>*>(node)->isDead()) {
+        --dead_;
+    } else {
+        --live_;
+    }
+    AVLTree<Key, Value, Compare>::eraseNode(node);
+}
+
+/**
+* Counts what the span holds, which costs no more than freeing it does,
+* and reports only the live items as erased.
+*/
+template<class Key, class Value, class Compare>
+size_t TombstoneAVLTree<Key, Value, Compare>::eraseSpan(Node<Key, Value>* first, Node<Key, Value>* last)
+{
+    size_t live = 0, dead = 0;
+    for (Node<Key, Value>* n = first; n != last; n = this->successor(n)) {
+        if (static_cast<AVLNode<Key, Value>*>(n)->isDead()) {
+            ++dead;
+        } else {
+            ++live;
+        }
+    }
+    AVLTree<Key, Value, Compare>::eraseSpan(first, last);
+    live_ -= live;
+    dead_ -= dead;
+    return live;
+}
+
+template<class Key, class Value, class Compare>
+void TombstoneAVLTree<Key, Value, Compare>::cloneNodes(const BinarySearchTree<Key, Value, Compare>& other,
+                                                       unsigned int threads)
+{
+    AVLTree<Key, Value, Compare>::cloneNodes(other, threads);
+    const TombstoneAVLTree& rhs = static_cast<const TombstoneAVLTree&>(other);
+    live_ = rhs.live_;
+    dead_ = rhs.dead_;
+    maxDeadShare_ = rhs.maxDeadShare_;
+}
+
+template<class Key, class Value, class Compare>
+void TombstoneAVLTree<Key, Value, Compare>::swapExtra(BinarySearchTree<Key, Value, Compare>& other)
+{
+    AVLTree<Key, Value, Compare>::swapExtra(other);
+    TombstoneAVLTree& rhs = static_cast<TombstoneAVLTree&>(other);
+    std::swap(live_, rhs.live_);
+    std::swap(dead_, rhs.dead_);
+    std::swap(maxDeadShare_, rhs.maxDeadShare_);
+}
+
+template<class Key, class Value, class Compare>
+void TombstoneAVLTree<Key, Value, Compare>::linkSorted(std::vector<std::pair<Key, Value> >& items,
+                                                       ThreadPool* pool, int forkDepth)
+{
+    AVLTree<Key, Value, Compare>::linkSorted(items, pool, forkDepth);
+    live_ = items.size();
+    dead_ = 0;
+}
+
+template<class Key, class Value, class Compare>
+void TombstoneAVLTree<Key, Value, Compare>::markDead(AVLNode<Key, Value>* node)
+{
+    node->setDead(true);
+    --live_;
+    ++dead_;
+    if (overDeadShare()) purge();
+}
+
+template<class Key, class Value, class Compare>
+bool TombstoneAVLTree<Key, Value, Compare>::overDeadShare() const
+{
+    return dead_ > 0 && (double)dead_ > maxDeadShare_ * (double)(live_ + dead_);
+}
+
+/*
+---------------------------------------------------
+End implementations for the TombstoneAVLTree class.
+---------------------------------------------------
+*/
+
+#endif